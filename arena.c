@@ -0,0 +1,62 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Bump allocator: one block of memory carved up and freed all at once
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+struct _Arena {
+	char *base;
+	size_t size;
+	size_t used;
+};
+
+/**
+ * Create an arena holding 'size' bytes. Size it with ARENA_SIZE() for each
+ * object that will be allocated from it.
+ */
+Arena *arena_create(size_t size) {
+	Arena *arena = malloc(sizeof(Arena));
+	
+	if (arena == NULL) {
+		return NULL;
+	}
+	
+	arena->size = ARENA_SIZE(size);
+	arena->used = 0;
+	
+	if (posix_memalign((void **)&arena->base, ARENA_ALIGN, arena->size) != 0) {
+		free(arena);
+		return NULL;
+	}
+	
+	return arena;
+}
+
+/**
+ * Hand out the next 'size' bytes, zeroed and cache-line aligned.
+ * Returns NULL once the arena is used up.
+ */
+void *arena_alloc(Arena *arena, size_t size) {
+	size = ARENA_SIZE(size);
+	
+	if (size > arena->size - arena->used) {
+		return NULL;
+	}
+	
+	void *p = arena->base + arena->used;
+	arena->used += size;
+	memset(p, 0, size);
+	
+	return p;
+}
+
+void arena_destroy(Arena *arena) {
+	if (arena != NULL) {
+		free(arena->base);
+		free(arena);
+	}
+}
@@ -0,0 +1,22 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Bump allocator: one block of memory carved up and freed all at once
+ */
+
+#ifndef Arena_h
+#define Arena_h
+
+#include <stddef.h>
+
+#define ARENA_ALIGN 64
+
+typedef struct _Arena Arena;
+
+Arena *arena_create(size_t size);
+void *arena_alloc(Arena *arena, size_t size);
+void arena_destroy(Arena *arena);
+
+/* bytes arena_alloc() needs for an object of this size, padding included */
+#define ARENA_SIZE(size) (((size) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+#endif
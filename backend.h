@@ -0,0 +1,54 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Memory backends: what sits behind a cache's fills and write-backs
+ *
+ * A backend takes block sized requests at a cycle and decides when each
+ * one completes. Requests are submitted in time order; complete() runs the
+ * backend until the request it is given has been served and returns the
+ * cycle that happened. Nothing waits on a write-back, so those are only
+ * submitted, and are served as the backend gets to them or at drain().
+ *
+ * Each kind of backend embeds a Mem_Backend as its first member and fills
+ * in the operations.
+ */
+
+#ifndef Backend_h
+#define Backend_h
+
+#include <stdint.h>
+
+typedef struct _Mem_Backend Mem_Backend;
+
+struct _Mem_Backend {
+	const char *name;
+	uint64_t (*submit)(Mem_Backend *backend, uint64_t cycle, uint64_t address, int is_write);
+	uint64_t (*complete)(Mem_Backend *backend, uint64_t id);
+	void (*drain)(Mem_Backend *backend);
+	void (*print_stats)(Mem_Backend *backend);
+	void (*destroy)(Mem_Backend *backend);
+};
+
+/* returns an id for mem_complete() */
+static inline uint64_t mem_submit(Mem_Backend *backend, uint64_t cycle, uint64_t address, int is_write) {
+	return backend->submit(backend, cycle, address, is_write);
+}
+
+static inline uint64_t mem_complete(Mem_Backend *backend, uint64_t id) {
+	return backend->complete(backend, id);
+}
+
+static inline void mem_drain(Mem_Backend *backend) {
+	backend->drain(backend);
+}
+
+static inline void print_mem_stats(Mem_Backend *backend) {
+	backend->print_stats(backend);
+}
+
+static inline void mem_destroy(Mem_Backend *backend) {
+	if (backend != NULL) {
+		backend->destroy(backend);
+	}
+}
+
+#endif
@@ -0,0 +1,120 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Benchmark harness shared by the *_bench programs
+ *
+ * Each benchmark runs a few untimed warmup passes, then a number of timed
+ * repetitions. One tab separated line is printed per benchmark:
+ *
+ *   name  unit  items  reps  min_ns  median_ns  items_per_sec
+ *
+ * items_per_sec is computed from the median so one noisy rep doesn't move it.
+ * Lines starting with '#' are comments; bench/compare.sh skips them.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench.h"
+
+#define BENCH_MAX_REPS 1000
+
+volatile uint64_t bench_sink;
+
+static int warmup = 2;
+static int reps = 10;
+static const char *filter = NULL;
+
+static uint64_t now_ns() {
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int compare_u64(const void *a, const void *b) {
+	uint64_t x = *(const uint64_t *)a;
+	uint64_t y = *(const uint64_t *)b;
+	
+	return (x > y) - (x < y);
+}
+
+/**
+ * -w <n> warmup passes, -r <n> timed repetitions, -f <substr> only run
+ * benchmarks whose name contains substr
+ */
+void bench_parse_args(int argc, char *argv[]) {
+	for (int i=1; i < argc; i++) {
+		if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+			warmup = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+			reps = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+			filter = argv[++i];
+		} else {
+			fprintf(stderr, "usage: %s [-w warmup] [-r reps] [-f filter]\n", argv[0]);
+			exit(2);
+		}
+	}
+	
+	if (reps < 1) {
+		reps = 1;
+	} else if (reps > BENCH_MAX_REPS) {
+		reps = BENCH_MAX_REPS;
+	}
+	
+	if (warmup < 0) {
+		warmup = 0;
+	}
+	
+	printf("# name\tunit\titems\treps\tmin_ns\tmedian_ns\titems_per_sec\n");
+}
+
+void bench_run(const char *name, const char *unit, Bench_Fn fn, void *arg) {
+	uint64_t times[BENCH_MAX_REPS];
+	uint64_t items = 0;
+	
+	if (filter != NULL && strstr(name, filter) == NULL) {
+		return;
+	}
+	
+	for (int i=0; i < warmup; i++) {
+		bench_sink += fn(arg);
+	}
+	
+	for (int i=0; i < reps; i++) {
+		uint64_t start = now_ns();
+		items = fn(arg);
+		times[i] = now_ns() - start;
+		bench_sink += items;
+	}
+	
+	qsort(times, reps, sizeof(uint64_t), compare_u64);
+	
+	uint64_t median = times[reps / 2];
+	double per_sec = (median > 0) ? (double)items * 1e9 / (double)median : 0.0;
+	
+	printf("%s\t%s\t%llu\t%d\t%llu\t%llu\t%.0f\n",
+		name, unit,
+		(unsigned long long)items, reps,
+		(unsigned long long)times[0],
+		(unsigned long long)median,
+		per_sec);
+	fflush(stdout);
+}
+
+/**
+ * xorshift64*, so traces are the same on every machine
+ */
+uint64_t bench_rand(uint64_t *state) {
+	uint64_t x = *state;
+	
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+	
+	return x * 0x2545F4914F6CDD1Dull;
+}
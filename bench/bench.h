@@ -0,0 +1,22 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Benchmark harness shared by the *_bench programs
+ */
+
+#ifndef Bench_h
+#define Bench_h
+
+#include <stdint.h>
+
+/* a benchmark body; returns the number of items (accesses, cycles, ...) it processed */
+typedef uint64_t (*Bench_Fn)(void *arg);
+
+/* results are folded into this so the compiler can't drop the work */
+extern volatile uint64_t bench_sink;
+
+void bench_parse_args(int argc, char *argv[]);
+void bench_run(const char *name, const char *unit, Bench_Fn fn, void *arg);
+
+uint64_t bench_rand(uint64_t *state);
+
+#endif
@@ -0,0 +1,119 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Cache model throughput: accesses per second under a few address patterns
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "../cache.h"
+
+#define TRACE_LENGTH (1 << 20)
+
+typedef struct _Trace {
+	Cache *cache;
+	Cache_Op ops[TRACE_LENGTH];
+	Cache_Result results[TRACE_LENGTH];
+} Trace;
+
+/* one call per access, the way an interactive session drives the cache */
+static uint64_t replay(void *arg) {
+	Trace *trace = arg;
+	uint64_t hits = 0;
+	
+	cache_invalidate(trace->cache);
+	
+	for (int i=0; i < TRACE_LENGTH; i++) {
+		int is_cache_hit = 0;
+		
+		if (trace->ops[i].is_write) {
+			is_cache_hit = cache_write(trace->cache, trace->ops[i].address, trace->ops[i].byte);
+		} else {
+			cache_read(trace->cache, trace->ops[i].address, &is_cache_hit);
+		}
+		
+		hits += is_cache_hit;
+	}
+	
+	bench_sink += hits;
+	return TRACE_LENGTH;
+}
+
+static uint64_t replay_batch(void *arg) {
+	Trace *trace = arg;
+	
+	cache_invalidate(trace->cache);
+	bench_sink += cache_access_batch(trace->cache, trace->ops, TRACE_LENGTH, trace->results);
+	
+	return TRACE_LENGTH;
+}
+
+/* the same batch without the kernel for the cache's geometry */
+static uint64_t replay_batch_generic(void *arg) {
+	Trace *trace = arg;
+	Cache_Kernel kernel = trace->cache->kernel;
+	
+	trace->cache->kernel = NULL;
+	replay_batch(arg);
+	trace->cache->kernel = kernel;
+	
+	return TRACE_LENGTH;
+}
+
+int main(int argc, char *argv[]) {
+	Trace *trace = malloc(sizeof(Trace));
+	uint64_t seed = 0x9E3779B97F4A7C15ull;
+	Cache_Config config;
+	
+	bench_parse_args(argc, argv);
+	
+	cache_default_config(&config);
+	trace->cache = cache_create(&config);
+	
+	/* sequential reads walk memory byte by byte */
+	for (int i=0; i < TRACE_LENGTH; i++) {
+		trace->ops[i].address = i % CACHE_MEMORY_SIZE;
+		trace->ops[i].is_write = 0;
+	}
+	bench_run("cache/sequential", "accesses", replay, trace);
+	
+	/* random, one write in four */
+	for (int i=0; i < TRACE_LENGTH; i++) {
+		uint64_t r = bench_rand(&seed);
+		trace->ops[i].address = r % CACHE_MEMORY_SIZE;
+		trace->ops[i].is_write = ((r >> 32) & 3) == 0;
+		trace->ops[i].byte = (unsigned char)i;
+	}
+	bench_run("cache/random", "accesses", replay, trace);
+	bench_run("cache/random-batch", "accesses", replay_batch, trace);
+	bench_run("cache/random-batch-generic", "accesses", replay_batch_generic, trace);
+	
+	/* strided reads, one block apart plus a byte so every set is visited */
+	for (int i=0; i < TRACE_LENGTH; i++) {
+		trace->ops[i].address = ((long)i * (CACHE_BLOCK_SIZE + 1)) % CACHE_MEMORY_SIZE;
+		trace->ops[i].is_write = 0;
+	}
+	bench_run("cache/strided", "accesses", replay, trace);
+	cache_destroy(trace->cache);
+	
+	/* a 64K tag-only cache, 64 byte blocks and 4 ways, over a megabyte */
+	config.block_size = 64;
+	config.num_sets = 256;
+	config.ways = 4;
+	config.memory_size = 0;
+	trace->cache = cache_create(&config);
+	
+	for (int i=0; i < TRACE_LENGTH; i++) {
+		uint64_t r = bench_rand(&seed);
+		trace->ops[i].address = r % (1 << 20);
+		trace->ops[i].is_write = ((r >> 32) & 3) == 0;
+	}
+	bench_run("cache/4way-batch", "accesses", replay_batch, trace);
+	bench_run("cache/4way-batch-generic", "accesses", replay_batch_generic, trace);
+	
+	cache_destroy(trace->cache);
+	free(trace);
+	return 0;
+}
@@ -0,0 +1,53 @@
+#!/bin/sh
+#
+# Niall Kavanagh <niall@kst.com>
+# Compare two benchmark result files written by the *_bench programs.
+#
+# usage: bench/compare.sh <baseline> <current> [threshold-percent]
+#
+# Prints one line per benchmark with the change in items_per_sec and flags
+# anything slower than the baseline by more than the threshold (default 5%).
+# Exits 1 if any benchmark regressed, so it can gate a build.
+
+if [ $# -lt 2 ]; then
+	echo "usage: $0 <baseline> <current> [threshold-percent]" >&2
+	exit 2
+fi
+
+baseline=$1
+current=$2
+threshold=${3:-5}
+
+awk -F '\t' -v threshold="$threshold" '
+	BEGIN { printf "%-28s %14s %14s %8s\n", "benchmark", "baseline/s", "current/s", "change" }
+	/^#/ || NF < 7 { next }
+	FNR == NR { base[$1] = $7; next }
+	{
+		name = $1
+		if (!(name in base)) {
+			printf "%-28s %14.0f %14s %8s  new\n", name, $7, "-", "-"
+			next
+		}
+		seen[name] = 1
+		change = (base[name] > 0) ? ($7 - base[name]) * 100.0 / base[name] : 0
+		flag = ""
+		if (change < -threshold) {
+			flag = "REGRESSION"
+			regressions++
+		} else if (change > threshold) {
+			flag = "faster"
+		}
+		printf "%-28s %14.0f %14.0f %+7.1f%%  %s\n", name, base[name], $7, change, flag
+	}
+	END {
+		for (name in base) {
+			if (!(name in seen)) {
+				printf "%-28s %14.0f %14s %8s  missing\n", name, base[name], "-", "-"
+			}
+		}
+		if (regressions > 0) {
+			printf "%d benchmark(s) regressed by more than %s%%\n", regressions, threshold
+			exit 1
+		}
+	}
+' "$baseline" "$current"
@@ -0,0 +1,177 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Disassembler throughput: instructions decoded and formatted per second
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "../decode.h"
+
+#define IMAGE_LENGTH (1 << 18)
+
+/* 16MB of text, to see whether bulk decoding keeps up with memory */
+#define TEXT_LENGTH (1 << 22)
+
+/* one of each instruction format_inst() knows, plus an unknown one */
+static const uint32_t templates[] = {
+	0x022DA822, // sub
+	0x12A70003, // beq
+	0x8D930018, // lw
+	0x02689820, // add
+	0xAD930018, // sw
+	0x02697824, // and
+	0x02A4A825, // or
+	0x158FFFF6, // bne
+	0x0109502A, // slt
+	0xFC000000  // unknown opcode
+};
+
+static uint64_t disassemble(void *arg) {
+	uint32_t *image = arg;
+	char line[INST_TEXT_SIZE];
+	uint64_t length = 0;
+	uint32_t addr = 0x7a060;
+	
+	for (int i=0; i < IMAGE_LENGTH; i++) {
+		length += format_inst(image[i], addr, line, sizeof(line));
+		addr += sizeof(uint32_t);
+	}
+	
+	bench_sink += length;
+	return IMAGE_LENGTH;
+}
+
+typedef struct _Bulk_Arg {
+	const unsigned char *text;
+	size_t length;
+	Decoded *decoded;
+	int kernel;
+} Bulk_Arg;
+
+static uint64_t decode(void *arg) {
+	Bulk_Arg *bulk = arg;
+	
+	decode_bulk(bulk->text, bulk->length, bulk->decoded, bulk->kernel);
+	bench_sink += bulk->decoded->funct[bulk->length - 1];
+	return bulk->length;
+}
+
+/* disassemble() by way of decode_bulk() */
+static uint64_t disassemble_bulk(void *arg) {
+	Bulk_Arg *bulk = arg;
+	char line[INST_TEXT_SIZE];
+	uint64_t length = 0;
+	uint32_t addr = 0x7a060;
+	
+	decode_bulk(bulk->text, IMAGE_LENGTH, bulk->decoded, bulk->kernel);
+	for (int i=0; i < IMAGE_LENGTH; i++) {
+		length += format_decoded(bulk->decoded, i, addr, line, sizeof(line));
+		addr += sizeof(uint32_t);
+	}
+	
+	bench_sink += length;
+	return IMAGE_LENGTH;
+}
+
+static int same_decoded(const Decoded *a, const Decoded *b, size_t i) {
+	return a->bits[i] == b->bits[i] && a->opcode[i] == b->opcode[i] && a->rs[i] == b->rs[i]
+		&& a->rt[i] == b->rt[i] && a->rd[i] == b->rd[i] && a->shamt[i] == b->shamt[i]
+		&& a->funct[i] == b->funct[i] && a->immediate[i] == b->immediate[i]
+		&& a->target[i] == b->target[i];
+}
+
+/**
+ * Every kernel the host has must split the text just as the scalar one
+ * does, big endian or in host order, at lengths that leave a tail too
+ */
+static int check_kernels(const unsigned char *text, const uint32_t *words) {
+	static const size_t lengths[] = { 0, 1, 7, 8, 9, 15, 16, 17, 31, 33, 63, 1000, 4099 };
+	int best = decode_kernel(DECODE_BEST);
+	
+	for (size_t l=0; l < sizeof(lengths)/sizeof(size_t); l++) {
+		size_t n = lengths[l];
+		Decoded *scalar = decoded_create(n);
+		Decoded *bulk = decoded_create(n);
+		Decoded *host = decoded_create(n);
+		
+		if (scalar == NULL || bulk == NULL || host == NULL) {
+			fprintf(stderr, "[!] Unable to allocate %zu decoded instructions.\n", n);
+			return 1;
+		}
+		
+		decode_bulk(text, n, scalar, DECODE_SCALAR);
+		
+		for (int kernel=DECODE_SCALAR; kernel <= best; kernel++) {
+			decode_bulk(text, n, bulk, kernel);
+			decode_words(words, n, host, kernel);
+			
+			for (size_t i=0; i < n; i++) {
+				if (!same_decoded(scalar, bulk, i) || !same_decoded(scalar, host, i)) {
+					fprintf(stderr, "[!] decode/%s differs from scalar at %zu of %zu.\n",
+							decode_kernel_name(kernel), i, n);
+					return 1;
+				}
+			}
+		}
+		
+		decoded_destroy(scalar);
+		decoded_destroy(bulk);
+		decoded_destroy(host);
+	}
+	
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	uint32_t *image = malloc(sizeof(uint32_t) * IMAGE_LENGTH);
+	uint64_t seed = 0x2545F4914F6CDD1Dull;
+	size_t num_templates = sizeof(templates)/sizeof(uint32_t);
+	
+	bench_parse_args(argc, argv);
+	
+	/* vary the register and immediate fields, keep the opcode mix */
+	for (int i=0; i < IMAGE_LENGTH; i++) {
+		uint64_t r = bench_rand(&seed);
+		uint32_t bits = templates[r % num_templates];
+		image[i] = (bits & 0xFC00003F) | ((uint32_t)(r >> 32) & 0x03FFFFC0);
+	}
+	bench_run("disasm/mixed", "instructions", disassemble, image);
+	
+	/* the same mix over and over, big endian as in memory */
+	unsigned char *text = malloc(sizeof(uint32_t) * TEXT_LENGTH);
+	for (int i=0; i < TEXT_LENGTH; i++) {
+		uint32_t bits = image[i % IMAGE_LENGTH];
+		text[4 * i] = bits >> 24;
+		text[4 * i + 1] = bits >> 16;
+		text[4 * i + 2] = bits >> 8;
+		text[4 * i + 3] = bits;
+	}
+	
+	if (check_kernels(text, image) != 0) {
+		return 1;
+	}
+	
+	Bulk_Arg bulk = { text, TEXT_LENGTH, decoded_create(TEXT_LENGTH), DECODE_BEST };
+	if (bulk.decoded == NULL) {
+		fprintf(stderr, "[!] Unable to allocate %d decoded instructions.\n", TEXT_LENGTH);
+		return 1;
+	}
+	bench_run("disasm/bulk", "instructions", disassemble_bulk, &bulk);
+	
+	/* each kernel the host has */
+	for (int kernel=DECODE_SCALAR; kernel <= decode_kernel(DECODE_BEST); kernel++) {
+		char name[32];
+		
+		snprintf(name, sizeof(name), "decode/%s", decode_kernel_name(kernel));
+		bulk.kernel = kernel;
+		bench_run(name, "instructions", decode, &bulk);
+	}
+	
+	decoded_destroy(bulk.decoded);
+	free(text);
+	free(image);
+	return 0;
+}
@@ -0,0 +1,91 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Pipeline throughput: simulated clock cycles per second, with memory
+ * free and with every load and store missing a slow data cache
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+
+#include "bench.h"
+#include "../core.h"
+
+#define RUNS 20000
+
+/* cycles for a data cache miss in the memory-bound runs */
+#define MISS_LATENCY 300
+
+/* the same fragment pipeline.c runs */
+static const uint32_t fragment[] = {
+	0xa1020000, // sb $2,0($8)
+	0x810AFFFC, // lb $10,-4($8)
+	0x00831820, // add $3,$4,$3
+	0x01263820, // add $7,$9,$6
+	0x01224820, // add $9,$9,$2
+	0x81180000, // lb $24,0($8)
+	0x81510010, // lb $17,16($10)
+	0x00624022, // sub $8,$3,$2
+	0x00000000,
+	0x00000000,
+	0x00000000,
+	0x00000000
+};
+
+static uint64_t simulate(void *arg) {
+	Core *core = arg;
+	uint64_t cycles = 0;
+	
+	for (int run=0; run < RUNS; run++) {
+		core_reset(core);
+		cycles += core_run(core);
+		
+		bench_sink += core->registers[17];
+	}
+	
+	return cycles;
+}
+
+/**
+ * Every run starts with a cold cache, so the pipeline spends nearly all
+ * its cycles stalled in MEM
+ */
+static uint64_t simulate_memory_bound(void *arg) {
+	Core *core = arg;
+	uint64_t cycles = 0;
+	
+	for (int run=0; run < RUNS; run++) {
+		core_reset(core);
+		cache_invalidate(core->dcache->cache);
+		mshr_reset(core->dcache);
+		cycles += core_run(core);
+		
+		bench_sink += core->registers[17];
+	}
+	
+	return cycles;
+}
+
+int main(int argc, char *argv[]) {
+	Core *core = core_create(fragment, sizeof(fragment)/sizeof(uint32_t), MEMORY_SIZE);
+	
+	bench_parse_args(argc, argv);
+	bench_run("pipeline/fragment", "cycles", simulate, core);
+	
+	Cache_Config cache_config;
+	cache_default_config(&cache_config);
+	cache_config.memory_size = 0;
+	
+	Mshr_Config mshr_config;
+	mshr_default_config(&mshr_config);
+	mshr_config.miss_latency = MISS_LATENCY;
+	
+	Cache *cache = cache_create(&cache_config);
+	core->dcache = mshr_create(cache, &mshr_config);
+	bench_run("pipeline/memory-bound", "cycles", simulate_memory_bound, core);
+	
+	mshr_destroy(core->dcache);
+	cache_destroy(cache);
+	core_destroy(core);
+	return 0;
+}
@@ -0,0 +1,155 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Trace ingestion throughput: text and binary trace records decoded per second
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "bench.h"
+#include "../text_trace.h"
+#include "../trace.h"
+
+#define TRACE_LINES (1 << 20)
+#define BATCH 4096
+
+typedef struct _Text {
+	char *text;
+	size_t size;
+	int format;
+} Text;
+
+static uint64_t parse_text(void *arg) {
+	Text *t = arg;
+	Cache_Op ops[BATCH];
+	uint64_t total = 0;
+	size_t n;
+	
+	FILE *file = fmemopen(t->text, t->size, "r");
+	Text_Reader *reader = text_reader_open(file, t->format, 0);
+	
+	while ((n = text_read(reader, ops, BATCH)) > 0) {
+		total += n;
+		bench_sink += ops[n - 1].address;
+	}
+	
+	text_reader_close(reader);
+	fclose(file);
+	
+	return total;
+}
+
+static uint64_t decode_binary(void *arg) {
+	Text *t = arg;
+	Trace_Record record;
+	uint64_t total = 0;
+	
+	FILE *file = fmemopen(t->text, t->size, "r");
+	Trace_Reader *reader = trace_reader_open(file);
+	
+	while (trace_read(reader, &record) == 1) {
+		total++;
+		bench_sink += record.address;
+	}
+	
+	trace_reader_close(reader);
+	fclose(file);
+	
+	return total;
+}
+
+/**
+ * A lackey-like mix: mostly sequential fetches, loads and stores around a
+ * stack and a heap
+ */
+static void make_records(Trace_Record *records) {
+	uint64_t seed = 0x853C49E6748FEA9Bull;
+	uint64_t pc = 0x4010000;
+	
+	for (int i=0; i < TRACE_LINES; i++) {
+		uint64_t r = bench_rand(&seed);
+		
+		records[i].cycle = i;
+		records[i].value = 0;
+		
+		switch (r & 3) {
+			case 0:
+			case 1:
+				records[i].type = TRACE_IFETCH;
+				records[i].address = pc;
+				records[i].size = 4;
+				pc += 4;
+				break;
+				
+			case 2:
+				records[i].type = TRACE_READ;
+				records[i].address = 0x1ffefff000 + ((r >> 8) & 0xFF8);
+				records[i].size = 8;
+				break;
+				
+			default:
+				records[i].type = TRACE_WRITE;
+				records[i].address = 0x5204000 + ((r >> 8) & 0xFFFF8);
+				records[i].size = 8;
+				break;
+		}
+	}
+}
+
+static void make_text(const Trace_Record *records, Text *t, int format) {
+	FILE *file = open_memstream(&t->text, &t->size);
+	static const char lackey_kind[] = { 'L', 'S', 'I' };
+	
+	for (int i=0; i < TRACE_LINES; i++) {
+		if (format == TEXT_FORMAT_DIN) {
+			fprintf(file, "%d %llx\n", records[i].type, (unsigned long long)records[i].address);
+		} else if (records[i].type == TRACE_IFETCH) {
+			fprintf(file, "I  %08llx,%d\n", (unsigned long long)records[i].address, records[i].size);
+		} else {
+			fprintf(file, " %c %08llx,%d\n", lackey_kind[records[i].type],
+				(unsigned long long)records[i].address, records[i].size);
+		}
+	}
+	
+	fclose(file);
+	t->format = format;
+}
+
+static void make_binary(const Trace_Record *records, Text *t) {
+	FILE *file = open_memstream(&t->text, &t->size);
+	Trace_Writer *writer = trace_writer_open(file);
+	
+	for (int i=0; i < TRACE_LINES; i++) {
+		trace_write(writer, &records[i]);
+	}
+	
+	trace_writer_close(writer);
+	fclose(file);
+}
+
+int main(int argc, char *argv[]) {
+	Trace_Record *records = malloc(sizeof(Trace_Record) * TRACE_LINES);
+	Text lackey, din, binary;
+	
+	bench_parse_args(argc, argv);
+	make_records(records);
+	
+	make_text(records, &lackey, TEXT_FORMAT_LACKEY);
+	bench_run("trace/lackey", "records", parse_text, &lackey);
+	
+	make_text(records, &din, TEXT_FORMAT_DIN);
+	bench_run("trace/din", "records", parse_text, &din);
+	
+	make_binary(records, &binary);
+	bench_run("trace/binary", "records", decode_binary, &binary);
+	
+	free(lackey.text);
+	free(din.text);
+	free(binary.text);
+	free(records);
+	return 0;
+}
@@ -0,0 +1,472 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * MIPS Cache model
+ * Compiled and run on OS X
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "cache.h"
+#include "classify.h"
+
+static int is_power_of_two(unsigned int n) {
+	return n != 0 && (n & (n - 1)) == 0;
+}
+
+static unsigned int log2_of(unsigned int n) {
+	unsigned int bits = 0;
+	
+	while ((1u << bits) < n) {
+		bits++;
+	}
+	
+	return bits;
+}
+
+static Cache_Kernel kernel_for(const Cache_Config *config);
+
+/**
+ * The original simulator: 2K of memory behind 16 direct mapped 16 byte slots
+ */
+void cache_default_config(Cache_Config *config) {
+	config->block_size = CACHE_BLOCK_SIZE;
+	config->num_sets = CACHE_SLOTS;
+	config->ways = 1;
+	config->memory_size = CACHE_MEMORY_SIZE;
+}
+
+/**
+ * Create a cache with the given geometry. The handle, slots, per set
+ * counters, block data and main memory come from one cache-line aligned
+ * arena. Returns NULL if the geometry is invalid or memory runs out.
+ */
+Cache *cache_create(const Cache_Config *config) {
+	if (!is_power_of_two(config->block_size) || !is_power_of_two(config->num_sets) || config->ways == 0) {
+		return NULL;
+	}
+	
+	size_t num_slots = (size_t)config->num_sets * config->ways;
+	size_t data_size = (config->memory_size > 0) ? num_slots * config->block_size : 0;
+	
+	Arena *arena = arena_create(ARENA_SIZE(sizeof(Cache))
+		+ ARENA_SIZE(sizeof(Cache_Slot) * num_slots)
+		+ ARENA_SIZE(sizeof(Cache_Set) * config->num_sets)
+		+ ARENA_SIZE(data_size)
+		+ ARENA_SIZE(config->memory_size));
+	if (arena == NULL) {
+		return NULL;
+	}
+	
+	Cache *cache = arena_alloc(arena, sizeof(Cache));
+	cache->arena = arena;
+	cache->config = *config;
+	cache->offset_bits = log2_of(config->block_size);
+	cache->index_bits = log2_of(config->num_sets);
+	
+	cache->slots = arena_alloc(arena, sizeof(Cache_Slot) * num_slots);
+	cache->sets = arena_alloc(arena, sizeof(Cache_Set) * config->num_sets);
+	cache->data = NULL;
+	cache->memory = NULL;
+	cache->classifier = NULL;
+	cache->kernel = kernel_for(config);
+	
+	if (config->memory_size > 0) {
+		cache->data = arena_alloc(arena, data_size);
+		cache->memory = arena_alloc(arena, config->memory_size);
+	}
+	
+	return cache;
+}
+
+void cache_destroy(Cache *cache) {
+	if (cache != NULL) {
+		arena_destroy(cache->arena);
+	}
+}
+
+static inline Cache_Slot *set_slots(Cache *cache, unsigned int index) {
+	return &cache->slots[(size_t)index * cache->config.ways];
+}
+
+static inline unsigned char *slot_data(Cache *cache, unsigned int index, unsigned int way) {
+	return &cache->data[((size_t)index * cache->config.ways + way) * cache->config.block_size];
+}
+
+/**
+ * Flush a (presumably dirty) cache slot out to main memory
+ */
+static void flush_slot(Cache *cache, unsigned int index, unsigned int way) {
+	Cache_Slot *slot = &set_slots(cache, index)[way];
+	uint64_t base_addr = ((slot->tag << cache->index_bits) | index) << cache->offset_bits;
+	
+	if (cache->memory != NULL) {
+		/* blocks beyond the end of main memory have nowhere to go */
+		if (base_addr + cache->config.block_size <= cache->config.memory_size) {
+			memcpy(&cache->memory[base_addr], slot_data(cache, index, way), cache->config.block_size);
+		}
+	}
+	
+	cache->sets[index].writebacks++;
+	cache->sets[index].victim = base_addr;
+	slot->dirty = 0;
+}
+
+/**
+ * The way a new block goes in: the first empty one, or the least recently
+ * used
+ */
+static inline unsigned int choose_victim(const Cache_Slot *slots, unsigned int ways) {
+	unsigned int victim = 0;
+	
+	for (unsigned int way=0; way < ways; way++) {
+		if (!slots[way].valid) {
+			return way;
+		}
+		
+		if (slots[way].lru < slots[victim].lru) {
+			victim = way;
+		}
+	}
+	
+	return victim;
+}
+
+/**
+ * Fetch a block of data from main memory into a way of its set. If a
+ * dirty block occupies that way, flush it first.
+ */
+static void place_block(Cache *cache, uint64_t address, unsigned int index, unsigned int victim) {
+	Cache_Slot *slots = set_slots(cache, index);
+	
+	if (slots[victim].valid && slots[victim].dirty) {
+		flush_slot(cache, index, victim);
+	}
+	
+	slots[victim].tag = address_tag(cache, address);
+	slots[victim].dirty = 0;
+	slots[victim].valid = 1;
+	
+	if (cache->memory != NULL) {
+		uint64_t base_addr = address_block_base(cache, address);
+		unsigned char *data = slot_data(cache, index, victim);
+		
+		if (base_addr + cache->config.block_size <= cache->config.memory_size) {
+			memcpy(data, &cache->memory[base_addr], cache->config.block_size);
+		} else {
+			memset(data, 0, cache->config.block_size);
+		}
+	}
+}
+
+/**
+ * Fetch a block into the least recently used way of its set
+ */
+static unsigned int fetch_block(Cache *cache, uint64_t address) {
+	unsigned int index = address_index(cache, address);
+	unsigned int victim = choose_victim(set_slots(cache, index), cache->config.ways);
+	
+	place_block(cache, address, index, victim);
+	return victim;
+}
+
+/**
+ * Find the way holding an address, fetching it on a miss. Updates the
+ * set's counters and LRU state.
+ */
+static inline unsigned int lookup(Cache *cache, uint64_t address, int is_write, int *is_cache_hit) {
+	unsigned int index = address_index(cache, address);
+	uint64_t tag = address_tag(cache, address);
+	Cache_Set *set = &cache->sets[index];
+	Cache_Slot *slots = set_slots(cache, index);
+	unsigned int way;
+	
+	*is_cache_hit = 0;
+	
+	for (way=0; way < cache->config.ways; way++) {
+		if (slots[way].valid && slots[way].tag == tag) {
+			*is_cache_hit = 1;
+			break;
+		}
+	}
+	
+	if (*is_cache_hit) {
+		set->hits++;
+	} else {
+		way = fetch_block(cache, address);
+		set->misses++;
+	}
+	
+	if (cache->classifier != NULL) {
+		classify_access(cache->classifier, address, index, *is_cache_hit);
+	}
+	
+	if (is_write) {
+		set->writes++;
+		slots[way].dirty = 1;
+	} else {
+		set->reads++;
+	}
+	
+	slots[way].lru = ++set->clock;
+	
+	return way;
+}
+
+/**
+ * Read a byte of data from an address
+ */
+unsigned char cache_read(Cache *cache, uint64_t address, int *is_cache_hit) {
+	unsigned int way = lookup(cache, address, 0, is_cache_hit);
+	
+	if (cache->data == NULL) {
+		return 0;
+	}
+	
+	return slot_data(cache, address_index(cache, address), way)[address_offset(cache, address)];
+}
+
+/**
+ * Write a byte of data to an address
+ */
+int cache_write(Cache *cache, uint64_t address, unsigned char byte) {
+	int is_cache_hit;
+	unsigned int way = lookup(cache, address, 1, &is_cache_hit);
+	
+	if (cache->data != NULL) {
+		slot_data(cache, address_index(cache, address), way)[address_offset(cache, address)] = byte;
+	}
+	
+	return is_cache_hit;
+}
+
+/**
+ * cache_access_batch() for a geometry known at compile time. Every
+ * parameter after 'results' is a constant in each instance below, so the
+ * shifts and masks are immediates and the way loops unroll. Counters, LRU
+ * state and results match the generic path exactly.
+ */
+static inline __attribute__((always_inline))
+size_t batch_kernel(Cache *cache, const Cache_Op *ops, size_t n, Cache_Result *results,
+					const unsigned int block_size, const unsigned int num_sets, const unsigned int ways) {
+	const unsigned int offset_bits = __builtin_ctz(block_size);
+	const unsigned int index_bits = __builtin_ctz(num_sets);
+	size_t hits = 0;
+	
+	for (size_t i=0; i < n; i++) {
+		uint64_t address = ops[i].address;
+		unsigned int index = (address >> offset_bits) & (num_sets - 1);
+		uint64_t tag = address >> (offset_bits + index_bits);
+		Cache_Set *set = &cache->sets[index];
+		Cache_Slot *slots = &cache->slots[(size_t)index * ways];
+		unsigned int way = ways;
+		
+		/* tags in a set are unique, so at most one way matches */
+#pragma GCC unroll 16
+		for (unsigned int w=0; w < ways; w++) {
+			if (slots[w].valid && slots[w].tag == tag) {
+				way = w;
+			}
+		}
+		
+		int is_cache_hit = way < ways;
+		
+		if (is_cache_hit) {
+			set->hits++;
+		} else {
+			way = choose_victim(slots, ways);
+			place_block(cache, address, index, way);
+			set->misses++;
+		}
+		
+		unsigned char *byte = cache->data != NULL
+			? &cache->data[((size_t)index * ways + way) * block_size + (address & (block_size - 1))] : NULL;
+		unsigned char value = 0;
+		
+		if (ops[i].is_write) {
+			set->writes++;
+			slots[way].dirty = 1;
+			value = ops[i].byte;
+			if (byte != NULL) {
+				*byte = value;
+			}
+		} else {
+			set->reads++;
+			if (byte != NULL) {
+				value = *byte;
+			}
+		}
+		
+		slots[way].lru = ++set->clock;
+		
+		if (results != NULL) {
+			results[i].hit = is_cache_hit;
+			results[i].byte = value;
+			results[i].miss_class = MISS_NONE;
+		}
+		
+		hits += is_cache_hit;
+	}
+	
+	return hits;
+}
+
+/* block sizes, set counts and ways that get a kernel of their own */
+#define KERNEL_WAYS(X, block, sets) X(block, sets, 1) X(block, sets, 2) X(block, sets, 4) X(block, sets, 8)
+#define KERNEL_SETS(X, block) KERNEL_WAYS(X, block, 16) KERNEL_WAYS(X, block, 64) \
+	KERNEL_WAYS(X, block, 256) KERNEL_WAYS(X, block, 1024)
+#define KERNEL_GEOMETRIES(X) KERNEL_SETS(X, 16) KERNEL_SETS(X, 32) KERNEL_SETS(X, 64)
+
+#define DEFINE_KERNEL(block, sets, ways) \
+	static size_t batch_##block##_##sets##_##ways(Cache *cache, const Cache_Op *ops, size_t n, Cache_Result *results) { \
+		return batch_kernel(cache, ops, n, results, block, sets, ways); \
+	}
+
+KERNEL_GEOMETRIES(DEFINE_KERNEL)
+
+#define KERNEL_ENTRY(block, sets, ways) { block, sets, ways, batch_##block##_##sets##_##ways },
+
+static const struct {
+	unsigned int block_size;
+	unsigned int num_sets;
+	unsigned int ways;
+	Cache_Kernel kernel;
+} kernels[] = {
+	KERNEL_GEOMETRIES(KERNEL_ENTRY)
+};
+
+/**
+ * The kernel for a geometry, or NULL to take the generic path
+ */
+static Cache_Kernel kernel_for(const Cache_Config *config) {
+	for (size_t n=0; n < sizeof(kernels) / sizeof(kernels[0]); n++) {
+		if (kernels[n].block_size == config->block_size && kernels[n].num_sets == config->num_sets
+			&& kernels[n].ways == config->ways) {
+			return kernels[n].kernel;
+		}
+	}
+	
+	return NULL;
+}
+
+/**
+ * Run n accesses in order, writing one result per access. Saves a call and
+ * the caller's bookkeeping per access when replaying traces.
+ * 'results' may be NULL if only the counters are wanted. Common geometries
+ * have a kernel of their own; set cache->kernel to NULL for the generic
+ * path.
+ */
+size_t cache_access_batch(Cache *cache, const Cache_Op *ops, size_t n, Cache_Result *results) {
+	size_t hits = 0;
+	
+	/* the kernels don't classify */
+	if (cache->kernel != NULL && cache->classifier == NULL) {
+		return cache->kernel(cache, ops, n, results);
+	}
+	
+	for (size_t i=0; i < n; i++) {
+		int is_cache_hit;
+		unsigned char byte;
+		
+		if (ops[i].is_write) {
+			is_cache_hit = cache_write(cache, ops[i].address, ops[i].byte);
+			byte = ops[i].byte;
+		} else {
+			byte = cache_read(cache, ops[i].address, &is_cache_hit);
+		}
+		
+		if (results != NULL) {
+			results[i].hit = is_cache_hit;
+			results[i].byte = byte;
+			results[i].miss_class = (cache->classifier != NULL) ? classifier_last_class(cache->classifier) : MISS_NONE;
+		}
+		
+		hits += is_cache_hit;
+	}
+	
+	return hits;
+}
+
+/**
+ * Whether the block holding an address is in the cache, leaving the
+ * counters and LRU state alone
+ */
+int cache_probe(const Cache *cache, uint64_t address) {
+	unsigned int index = address_index(cache, address);
+	uint64_t tag = address_tag(cache, address);
+	const Cache_Slot *slots = &cache->slots[(size_t)index * cache->config.ways];
+	
+	for (unsigned int way=0; way < cache->config.ways; way++) {
+		if (slots[way].valid && slots[way].tag == tag) {
+			return 1;
+		}
+	}
+	
+	return 0;
+}
+
+/**
+ * Drop the block holding an address, if it is there, without writing it
+ * back. Returns non-zero if it was.
+ */
+int cache_evict(Cache *cache, uint64_t address) {
+	unsigned int index = address_index(cache, address);
+	uint64_t tag = address_tag(cache, address);
+	Cache_Slot *slots = set_slots(cache, index);
+	
+	for (unsigned int way=0; way < cache->config.ways; way++) {
+		if (slots[way].valid && slots[way].tag == tag) {
+			slots[way].valid = 0;
+			slots[way].dirty = 0;
+			slots[way].lru = 0;
+			return 1;
+		}
+	}
+	
+	return 0;
+}
+
+/**
+ * Drop everything in the cache without writing it back
+ */
+void cache_invalidate(Cache *cache) {
+	size_t num_slots = (size_t)cache->config.num_sets * cache->config.ways;
+	
+	memset(cache->slots, 0, sizeof(Cache_Slot) * num_slots);
+	memset(cache->sets, 0, sizeof(Cache_Set) * cache->config.num_sets);
+	
+	if (cache->data != NULL) {
+		memset(cache->data, 0, num_slots * cache->config.block_size);
+	}
+}
+
+/**
+ * Write every dirty block back to main memory
+ */
+void cache_flush(Cache *cache) {
+	for (unsigned int index=0; index < cache->config.num_sets; index++) {
+		Cache_Slot *slots = set_slots(cache, index);
+		
+		for (unsigned int way=0; way < cache->config.ways; way++) {
+			if (slots[way].valid && slots[way].dirty) {
+				flush_slot(cache, index, way);
+			}
+		}
+	}
+}
+
+/**
+ * Sum the per set counters
+ */
+void cache_totals(const Cache *cache, Cache_Set *totals) {
+	memset(totals, 0, sizeof(Cache_Set));
+	
+	for (unsigned int index=0; index < cache->config.num_sets; index++) {
+		totals->reads += cache->sets[index].reads;
+		totals->writes += cache->sets[index].writes;
+		totals->hits += cache->sets[index].hits;
+		totals->misses += cache->sets[index].misses;
+		totals->writebacks += cache->sets[index].writebacks;
+	}
+}
@@ -0,0 +1,128 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * MIPS Cache model
+ *
+ * A set associative, write-back, write-allocate cache with LRU replacement
+ * in front of a byte-addressable main memory. Everything the model needs
+ * hangs off a Cache handle, so a program can run as many caches as it
+ * likes, and threads can share one cache as long as each set is only ever
+ * touched by one thread.
+ */
+
+#ifndef Cache_h
+#define Cache_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+
+/* the original geometry: 2K main memory, 16 direct mapped slots of 16 bytes */
+#define CACHE_MEMORY_SIZE 2048
+
+#define CACHE_BLOCK_SIZE 16
+#define CACHE_SLOTS 16
+
+typedef struct _Cache_Config {
+	unsigned int block_size; /* bytes per block, a power of two */
+	unsigned int num_sets;   /* a power of two */
+	unsigned int ways;       /* blocks per set; 1 is direct mapped */
+	size_t memory_size;      /* bytes of main memory; 0 for a tag-only cache */
+} Cache_Config;
+
+/* One cache block. Lines for a set are contiguous. */
+typedef struct _Cache_Slot {
+	uint64_t tag;
+	uint32_t lru;
+	unsigned char valid;
+	unsigned char dirty;
+} Cache_Slot;
+
+/* per set bookkeeping, one cache line each so sets can live on different threads */
+typedef struct _Cache_Set {
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t writebacks;
+	uint64_t victim; /* address of the last block written back */
+	uint32_t clock;  /* LRU timestamp */
+} __attribute__((aligned(64))) Cache_Set;
+
+/* see classify.h */
+typedef struct _Miss_Classifier Miss_Classifier;
+
+struct _Cache;
+struct _Cache_Op;
+struct _Cache_Result;
+
+/* cache_access_batch() for one geometry */
+typedef size_t (*Cache_Kernel)(struct _Cache *cache, const struct _Cache_Op *ops, size_t n, struct _Cache_Result *results);
+
+typedef struct _Cache {
+	Arena *arena;
+	Cache_Config config;
+	
+	unsigned int offset_bits;
+	unsigned int index_bits;
+	
+	Cache_Slot *slots;     /* num_sets * ways */
+	Cache_Set *sets;       /* num_sets */
+	unsigned char *data;   /* num_sets * ways * block_size, NULL if tag-only */
+	unsigned char *memory; /* memory_size bytes, NULL if tag-only */
+	
+	/* if set, every access is classified; single-threaded use only */
+	Miss_Classifier *classifier;
+	
+	/* cache_access_batch() specialised for this geometry, or NULL */
+	Cache_Kernel kernel;
+} Cache;
+
+/* one access for cache_access_batch() */
+typedef struct _Cache_Op {
+	uint64_t address;
+	uint64_t cycle;     /* when it was made, for timed replay */
+	unsigned char is_write;
+	unsigned char is_fetch; /* an instruction fetch, a read */
+	unsigned char byte; /* value to write */
+} Cache_Op;
+
+typedef struct _Cache_Result {
+	unsigned char hit;
+	unsigned char byte;       /* value read, or written */
+	unsigned char miss_class; /* MISS_* from classify.h, if a classifier is attached */
+} Cache_Result;
+
+void cache_default_config(Cache_Config *config);
+
+Cache *cache_create(const Cache_Config *config);
+void cache_destroy(Cache *cache);
+
+void cache_invalidate(Cache *cache);
+void cache_flush(Cache *cache);
+
+unsigned char cache_read(Cache *cache, uint64_t address, int *is_cache_hit);
+int cache_write(Cache *cache, uint64_t address, unsigned char byte);
+int cache_probe(const Cache *cache, uint64_t address);
+int cache_evict(Cache *cache, uint64_t address);
+size_t cache_access_batch(Cache *cache, const Cache_Op *ops, size_t n, Cache_Result *results);
+
+void cache_totals(const Cache *cache, Cache_Set *totals);
+
+static inline uint64_t address_tag(const Cache *cache, uint64_t address) {
+	return address >> (cache->offset_bits + cache->index_bits);
+}
+
+static inline unsigned int address_index(const Cache *cache, uint64_t address) {
+	return (address >> cache->offset_bits) & (cache->config.num_sets - 1);
+}
+
+static inline unsigned int address_offset(const Cache *cache, uint64_t address) {
+	return address & (cache->config.block_size - 1);
+}
+
+static inline uint64_t address_block_base(const Cache *cache, uint64_t address) {
+	return address & ~(uint64_t)(cache->config.block_size - 1);
+}
+
+#endif
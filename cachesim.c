@@ -10,23 +10,26 @@
 #include <string.h>
 #include "cachesim.h"
 
-/* Cache block */
-struct _Cache_Slot {
-	short valid;
-	short dirty;
-	unsigned char tag;
-	unsigned char data[CACHE_BLOCK_SIZE];
-};
-
 /* main */
 int main(int argc, char *argv[]) {
-	slots = NULL;
 	char input[INPUT_BUFFER_SIZE];
 	char *uargv[INPUT_ARGS]; 
 	int uargc;
 	
-	initialize_memory();
-	initialize_cache();
+	if (argc > 1) {
+		return replay_main(argc, argv);
+	}
+	
+	Cache_Config config;
+	cache_default_config(&config);
+	
+	Cache *cache = cache_create(&config);
+	if (cache == NULL) {
+		fprintf(stderr, "[!] Unable to allocate the cache.\n");
+		return 1;
+	}
+	
+	initialize_memory(cache);
 	
 	/* input loop */
 	printf("Enter '?' for help.\n");
@@ -44,24 +47,25 @@ int main(int argc, char *argv[]) {
 			
 			if ((strcmp(uargv[0], "exit") == 0) || (strcmp(uargv[0], "q") == 0)) {
 				/* normal exit */
+				cache_destroy(cache);
 				return 0; 
 			} else if (strcmp(uargv[0], "?") == 0) {
 				print_help();
 			} else if (strcmp(uargv[0], "pm") == 0) {
-				print_memory();
+				print_memory(cache);
 			} else if (strcmp(uargv[0], "pc") == 0) {
-				print_cache();
+				print_cache(cache);
 			} else if (strcmp(uargv[0], "im") == 0) {
-				initialize_memory();
+				initialize_memory(cache);
 			} else if (strcmp(uargv[0], "ic") == 0) {
-				initialize_cache();
+				cache_invalidate(cache);
 			} else if (strcmp(uargv[0], "r") == 0) {
 				if (uargc == 2) {
 					/* strtol *could* overflow our short address */
 					short address = strtol(uargv[1], NULL, 16); 
 					
 					int is_cache_hit = 0;
-					unsigned char byte = read_byte(address, &is_cache_hit);
+					unsigned char byte = cache_read(cache, (unsigned short)address, &is_cache_hit);
 					printf("Address\tData\tHit/Miss\n0x%X\t%X\t%s\n", address, byte, (is_cache_hit) ? "HIT" : "MISS");
 				} else {
 					printf("Invalid command. To read a byte: r <address>; e.g. 'r 7ae'\n");
@@ -71,7 +75,7 @@ int main(int argc, char *argv[]) {
 					/* strtol *could* overflow */
 					short address = strtol(uargv[1], NULL, 16); 
 					unsigned char byte = strtol(uargv[2], NULL, 16);
-					int is_cache_hit = write_byte(address, byte);
+					int is_cache_hit = cache_write(cache, (unsigned short)address, byte);
 					printf("Address\tData\tHit/Miss\n0x%X\t%X\t%s\n", address, byte, (is_cache_hit) ? "HIT" : "MISS");
 				} else {
 					printf("Invalid command. To write a byte: w <address> <value>; e.g. 'w 7ae 2b'\n");
@@ -86,6 +90,233 @@ int main(int argc, char *argv[]) {
     return 0;
 }
 
+/**
+ * cachesim [-j threads] [-b block] [-s sets] [-a ways] [-m memory]
+ *          [-f cmd|din|lackey] [-d] [-k record] [-c] [-g region]
+ *          [-M mshrs] [-T targets] [-l latency] [-o]
+ *          [-D open|closed] [-I page|block] [-C channels] [-V 4k|2m] <trace>
+ * Replay a text or binary trace instead of reading commands interactively.
+ * A trace of '-' is read from stdin. -f names the text format when it
+ * can't be guessed, -d skips instruction fetches and -k starts at a
+ * record of a binary trace. -c classifies every miss as compulsory,
+ * capacity or conflict, per set and per region of -g bytes. -M times the
+ * replay through a non-blocking cache with that many MSHRs (see mshr.h),
+ * of -T targets each and -l cycles per miss; reads block the trace unless
+ * -o keeps it to its own times. -D fills the cache from DRAM (see dram.h)
+ * with that page policy instead, interleaved by -I over -C channels. -V
+ * treats addresses as virtual and translates them through TLBs and page
+ * tables of that page size (see mmu.h).
+ */
+int replay_main(int argc, char *argv[]) {
+	int threads = 1;
+	int data_only = 0;
+	int format = TEXT_FORMAT_AUTO;
+	long long start = -1;
+	int classify = 0;
+	unsigned long region_size = 1ul << CLASSIFY_REGION_BITS;
+	const char *path = NULL;
+	Cache_Config config;
+	Mshr_Config mshr_config;
+	int timed = 0;
+	int blocking = 1;
+	Dram_Config dram_config;
+	int dram = 0;
+	Mmu_Config mmu_config;
+	int virtual = 0;
+	
+	cache_default_config(&config);
+	mmu_default_config(&mmu_config);
+	mshr_default_config(&mshr_config);
+	dram_default_config(&dram_config);
+	
+	for (int i=1; i < argc; i++) {
+		if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+			config.block_size = strtoul(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+			config.num_sets = strtoul(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+			config.ways = strtoul(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) {
+			config.memory_size = strtoul(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+			start = strtoll(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+			format = text_format_from_name(argv[++i]);
+		} else if (strcmp(argv[i], "-d") == 0) {
+			data_only = 1;
+		} else if (strcmp(argv[i], "-c") == 0) {
+			classify = 1;
+		} else if (strcmp(argv[i], "-g") == 0 && i + 1 < argc) {
+			region_size = strtoul(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "-M") == 0 && i + 1 < argc) {
+			mshr_config.num_mshrs = strtoul(argv[++i], NULL, 0);
+			timed = 1;
+		} else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc) {
+			mshr_config.targets = strtoul(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+			mshr_config.miss_latency = strtoul(argv[++i], NULL, 0);
+			timed = 1;
+		} else if (strcmp(argv[i], "-o") == 0) {
+			blocking = 0;
+		} else if (strcmp(argv[i], "-D") == 0 && i + 1 < argc) {
+			dram_config.page_policy = dram_policy_from_name(argv[++i]);
+			dram = timed = 1;
+		} else if (strcmp(argv[i], "-I") == 0 && i + 1 < argc) {
+			dram_config.mapping = dram_mapping_from_name(argv[++i]);
+		} else if (strcmp(argv[i], "-C") == 0 && i + 1 < argc) {
+			dram_config.channels = strtoul(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "-V") == 0 && i + 1 < argc) {
+			mmu_config.page_bits = mmu_page_bits_from_name(argv[++i]);
+			virtual = 1;
+		} else if (path == NULL) {
+			path = argv[i];
+		} else {
+			path = NULL;
+			break;
+		}
+	}
+	
+	if (path == NULL || format < 0 || dram_config.page_policy < 0 || dram_config.mapping < 0) {
+		fprintf(stderr, "usage: %s [-j threads] [-b block] [-s sets] [-a ways] [-m memory] [-f cmd|din|lackey] [-d] [-k record] [-c] [-g region] [-M mshrs] [-T targets] [-l latency] [-o] [-D open|closed] [-I page|block] [-C channels] [-V 4k|2m] <trace>\n", argv[0]);
+		return 2;
+	}
+	
+	Cache *cache = cache_create(&config);
+	if (cache == NULL) {
+		fprintf(stderr, "[!] Block size and set count must be powers of two.\n");
+		return 2;
+	}
+	initialize_memory(cache);
+	
+	if (classify) {
+		unsigned int region_bits = 0;
+		
+		while ((2ul << region_bits) <= region_size) {
+			region_bits++;
+		}
+		
+		cache->classifier = classifier_create(cache, region_bits);
+		if (cache->classifier == NULL) {
+			fprintf(stderr, "[!] Unable to allocate the miss classifier.\n");
+			return 1;
+		}
+		
+		/* the shadow cache covers every set, so no splitting the trace */
+		if (threads > 1) {
+			fprintf(stderr, "[!] Miss classification replays on one thread.\n");
+			threads = 1;
+		}
+	}
+	
+	Mshr_File *mshrs = NULL;
+	
+	if (timed) {
+		mshrs = mshr_create(cache, &mshr_config);
+		if (mshrs == NULL) {
+			fprintf(stderr, "[!] Between 1 and %d MSHRs of at least one target.\n", MSHR_MAX);
+			return 2;
+		}
+		
+		if (dram) {
+			dram_config.block_size = config.block_size;
+			mshrs->backend = dram_create(&dram_config);
+			
+			if (mshrs->backend == NULL) {
+				fprintf(stderr, "[!] DRAM channels must be a power of two.\n");
+				return 2;
+			}
+		}
+		
+		/* time only makes sense in trace order */
+		if (threads > 1) {
+			fprintf(stderr, "[!] Timed replay runs on one thread.\n");
+			threads = 1;
+		}
+	}
+	
+	Mmu *mmu = NULL;
+	
+	if (virtual) {
+		mmu = mmu_create(&mmu_config, cache);
+		if (mmu == NULL) {
+			fprintf(stderr, "[!] Pages are 4k or 2m.\n");
+			return 2;
+		}
+		mmu->timing = mshrs;
+		
+		/* the TLBs and page tables are shared by every set */
+		if (threads > 1) {
+			fprintf(stderr, "[!] Virtual addresses are replayed on one thread.\n");
+			threads = 1;
+		}
+	}
+	
+	FILE *trace = (strcmp(path, "-") == 0) ? stdin : fopen(path, "rb");
+	if (trace == NULL) {
+		perror(path);
+		cache_destroy(cache);
+		return 1;
+	}
+	
+	Replay_Source source;
+	if (replay_source_open(&source, trace, format, data_only) < 0) {
+		fprintf(stderr, "[!] %s is not a trace this version can read.\n", path);
+		return 1;
+	}
+	
+	if (start >= 0 && (source.binary == NULL || trace_seek(source.binary, start) < 0)) {
+		fprintf(stderr, "[!] Can't start %s at record %lld.\n", path, start);
+		return 1;
+	}
+	
+	source.mmu = mmu;
+	
+	Replay_Stats stats;
+	if (mshrs != NULL) {
+		replay_timed(mshrs, &source, blocking, &stats);
+	} else {
+		replay_trace(cache, &source, threads, &stats);
+	}
+	print_replay_stats(cache, &stats);
+	
+	if (mmu != NULL) {
+		printf("\n");
+		print_mmu_stats(mmu);
+		mmu_destroy(mmu);
+	}
+	
+	if (mshrs != NULL) {
+		printf("\n%llu cycles, %llu of them waiting on memory\n",
+			(unsigned long long)stats.cycles,
+			(unsigned long long)stats.delay);
+		print_mshr_stats(mshrs);
+		
+		if (mshrs->backend != NULL) {
+			mem_drain(mshrs->backend);
+			printf("\n");
+			print_mem_stats(mshrs->backend);
+			mem_destroy(mshrs->backend);
+		}
+		mshr_destroy(mshrs);
+	}
+	
+	if (cache->classifier != NULL) {
+		printf("\n");
+		print_miss_classes(cache->classifier, 20);
+		classifier_destroy(cache->classifier);
+	}
+	
+	replay_source_close(&source);
+	if (trace != stdin) {
+		fclose(trace);
+	}
+	cache_destroy(cache);
+	
+	return 0;
+}
+
 int parse_command(const char *cmdline, char *arglist[]) {
 	static char array[INPUT_BUFFER_SIZE]; /* holds local copy of command line */
 	char *buf = array;          /* ptr that traverses command line */
@@ -114,11 +345,11 @@ int parse_command(const char *cmdline, char *arglist[]) {
 /** 
  * "Zero" out main memory using 0x00–0xFF
  */
-void initialize_memory() {
+void initialize_memory(Cache *cache) {
 	unsigned char current_value = 0;
 	
-	for (int n=0; n < MEMORY_SIZE; n++) {
-		main_memory[n] = current_value;
+	for (size_t n=0; n < cache->config.memory_size; n++) {
+		cache->memory[n] = current_value;
 		current_value++;
 	}
 }
@@ -126,188 +357,34 @@ void initialize_memory() {
 /**
  * Dump the contents of main memory
  */
-void print_memory() {
+void print_memory(Cache *cache) {
 	printf("Address\t\tContents\n");
-	for (int n=0; n < MEMORY_SIZE; n++) {
-		printf("0x%X\t\t0x%X\n", n, main_memory[n]);
+	for (size_t n=0; n < cache->config.memory_size; n++) {
+		printf("0x%zX\t\t0x%X\n", n, cache->memory[n]);
 	}
 }
 
 /**
- * Initialize the cache slots
+ * Dump out the current contents of the cache
  */
-void initialize_cache() {
-	if (slots != NULL) {
-		free(slots);
-		slots = NULL;
-	}
+void print_cache(Cache *cache) {
+	unsigned int num_slots = cache->config.num_sets * cache->config.ways;
 	
-	slots = malloc(sizeof(Cache_Slot*) * CACHE_SLOTS);
+	printf("Slot\tValid\tDirty\tTag\tData\n");
 	
-	for (int n=0; n < CACHE_SLOTS; n++) {
-		slots[n].valid = 0;
-		slots[n].dirty = 0;
-		slots[n].tag = 0;
-		
-		for (int i=0; i < CACHE_BLOCK_SIZE; i++) {
-			slots[n].data[i] = 0x0;
-		}
-	}
-}
-
-/**
- * Dump out the current contents of the cache
- */
-void print_cache() {
-	if (slots != NULL) {
-		printf("Slot\tValid\tDirty\tTag\tData\n");
-		
-		for (int n=0; n < CACHE_SLOTS; n++) {
-			printf("%x\t%d\t%d\t%2X\t",
-				n, 
-				slots[n].valid, 
-				slots[n].dirty,
-				slots[n].tag);
-				
-			for (int i=0; i < CACHE_BLOCK_SIZE; i++) {
-				printf("%2X ", slots[n].data[i]);
-			}
+	for (unsigned int n=0; n < num_slots; n++) {
+		printf("%x\t%d\t%d\t%2llX\t",
+			n, 
+			cache->slots[n].valid, 
+			cache->slots[n].dirty,
+			(unsigned long long)cache->slots[n].tag);
 			
-			printf("\n");
+		for (unsigned int i=0; cache->data != NULL && i < cache->config.block_size; i++) {
+			printf("%2X ", cache->data[(size_t)n * cache->config.block_size + i]);
 		}
-	} else {
-		printf("[!] Cache is not initialized.\n");
-	}
-}
-
-/**
- * Extracting cache slot fields from addresses:
- * 16 byte block size
- * 16 blocks of 16 "addresses" is 2048 bits
- * Single address as short is 16 bits
- * Single cache slot holds 16 addresses for 128 bits
- * Direct mapped, 16 sets
- * Displacement is 4
- * Block bits is 4
- * 8 bit tag
- */
-unsigned char address_tag(short address) {
-	unsigned char tag = address >> 8;
-	return tag;
-}
-
-short address_index(short address) {
-	short index = (address >> 4) & 0x000F;
-	return index;
-}
-
-short address_offset(short address) {
-	short offset = address & 0x000F;
-	return offset;
-}
-
-short address_block_base(short address) {
-	short base_addr = address & 0x0FF0;
-	return base_addr;
-}
-
-/**
- * Read a byte of data from an address
- */
-unsigned char read_byte(short address, int *is_cache_hit) {
-	*is_cache_hit = 0;
-	unsigned char byte = 0;
-	
-	unsigned char tag = address_tag(address);
-	short index = address_index(address);
-	short offset = address_offset(address);
-	short base_addr = address_block_base(address);
-	
-	if ((slots[index].tag == tag) && (slots[index].valid == 1)) {
-		/* block is in the cache and valid */
-		*is_cache_hit = 1;
-	} else {
-		/* fetch the block from main memory */
-		fetch_block(address);	
-	}
-	
-	byte = slots[index].data[offset];
-	
-	return byte;
-}
-
-/**
- * Write a byte of data to an address
- */
-int write_byte(short address, unsigned char byte) {
-	int is_cache_hit = 0;
-	
-	unsigned char tag = address_tag(address);
-	short index = address_index(address);
-	short offset = address_offset(address);
-	short base_addr = address_block_base(address);
-	
-	/* first, check the cache */
-	if ((slots[index].tag == tag) && (slots[index].valid == 1)) {
-		/* block is in the cache and valid */
-		is_cache_hit = 1;
-	} else {
-		/* fetch block and put it in the cache */
-		fetch_block(address);	
-	}
-	
-	/* set the byte */
-	slots[index].data[offset] = byte;
-	slots[index].dirty = 1;
-	
-	return is_cache_hit;
-}
-
-/**
- * Fetch a block of data from main memory and place it in the cache
- * If a dirty block occupies the slot, flush it
- */
-void fetch_block(short address) {
-	unsigned char tag = address_tag(address);
-	short index = address_index(address);
-	short offset = address_offset(address);
-	short base_addr = address_block_base(address);
-	
-	/* If the cache slot is dirty, flush it */
-	if (slots[index].dirty == 1) {
-		flush_slot(index);
-	}
-	
-	/* Reset the slot */
-	slots[index].dirty = 0;
-	slots[index].tag = tag;
-	
-	short current = base_addr;
-	for (int i=0; i < CACHE_BLOCK_SIZE; i++) {
-		slots[index].data[i] = main_memory[current];
-		current += sizeof(unsigned char);
-	}
-	
-	slots[index].valid = 1;
-}
-
-/**
- * Flush a (presumably dirty) cache slot out to main memory
- */
-void flush_slot(short index) {
-	short base_addr = ((slots[index].tag << 8) & 0x0F00) | ((index << 4) & 0x00F0);
-	
-	slots[index].valid = 0;
-	
-	short current = base_addr;
-	for (int i=0; i < CACHE_BLOCK_SIZE; i++) {
-		main_memory[current] = slots[index].data[i];
-		slots[index].data[i] = 0;
-		current += sizeof(unsigned char);
+		
+		printf("\n");
 	}
-	
-	slots[index].dirty = 0;
-	slots[index].tag = 0;
 }
 
 /**
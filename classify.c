@@ -0,0 +1,411 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * 3C miss classification: compulsory, capacity and conflict misses
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "classify.h"
+
+#define NIL UINT32_MAX
+
+/*
+ * Open addressing hash table from 64 bit keys to 32 bit values. Keys are
+ * stored plus one so that zero marks an empty slot.
+ */
+typedef struct _U64_Map {
+	uint64_t *keys;
+	uint32_t *values;
+	size_t size; /* a power of two */
+	size_t used;
+	int grows;   /* fixed size tables never grow */
+} U64_Map;
+
+struct _Miss_Classifier {
+	unsigned int offset_bits;
+	unsigned int region_bits;
+	
+	/* every block ever touched */
+	U64_Map seen;
+	
+	/* fully associative LRU shadow cache: a list of blocks, MRU first */
+	uint32_t capacity;
+	uint32_t count;
+	uint64_t *blocks;
+	uint32_t *prev;
+	uint32_t *next;
+	uint32_t head;
+	uint32_t tail;
+	U64_Map shadow; /* block -> list node */
+	
+	unsigned int num_sets;
+	Miss_Counts *sets;
+	
+	U64_Map regions; /* region -> index into region_counts */
+	uint64_t *region_ids;
+	Miss_Counts *region_counts;
+	size_t num_regions;
+	size_t max_regions;
+	
+	int last_class;
+};
+
+static inline size_t hash_u64(uint64_t key, size_t size) {
+	return (size_t)((key * 0x9E3779B97F4A7C15ull) >> 17) & (size - 1);
+}
+
+static int map_init(U64_Map *map, size_t size, int grows) {
+	map->size = size;
+	map->used = 0;
+	map->grows = grows;
+	map->keys = calloc(size, sizeof(uint64_t));
+	map->values = malloc(size * sizeof(uint32_t));
+	
+	return (map->keys != NULL && map->values != NULL) ? 0 : -1;
+}
+
+static void map_free(U64_Map *map) {
+	free(map->keys);
+	free(map->values);
+}
+
+/**
+ * Slot holding key, or the empty slot where it would go
+ */
+static inline size_t map_slot(const U64_Map *map, uint64_t key) {
+	size_t i = hash_u64(key, map->size);
+	
+	while (map->keys[i] != 0 && map->keys[i] != key + 1) {
+		i = (i + 1) & (map->size - 1);
+	}
+	
+	return i;
+}
+
+static inline int map_find(const U64_Map *map, uint64_t key, uint32_t *value) {
+	size_t i = map_slot(map, key);
+	
+	if (map->keys[i] == 0) {
+		return 0;
+	}
+	
+	*value = map->values[i];
+	return 1;
+}
+
+static void map_put(U64_Map *map, uint64_t key, uint32_t value);
+
+static void map_grow(U64_Map *map) {
+	U64_Map bigger;
+	
+	if (map_init(&bigger, map->size * 2, 1) < 0) {
+		fprintf(stderr, "[!] Out of memory classifying misses.\n");
+		exit(1);
+	}
+	
+	for (size_t i=0; i < map->size; i++) {
+		if (map->keys[i] != 0) {
+			map_put(&bigger, map->keys[i] - 1, map->values[i]);
+		}
+	}
+	
+	map_free(map);
+	*map = bigger;
+}
+
+static void map_put(U64_Map *map, uint64_t key, uint32_t value) {
+	size_t i = map_slot(map, key);
+	
+	if (map->keys[i] == 0) {
+		map->keys[i] = key + 1;
+		map->used++;
+	}
+	map->values[i] = value;
+	
+	if (map->grows && map->used * 2 > map->size) {
+		map_grow(map);
+	}
+}
+
+/**
+ * Remove a key, shifting later entries of its probe run back so lookups
+ * never need tombstones
+ */
+static void map_remove(U64_Map *map, uint64_t key) {
+	size_t i = map_slot(map, key);
+	size_t mask = map->size - 1;
+	
+	if (map->keys[i] == 0) {
+		return;
+	}
+	
+	map->keys[i] = 0;
+	map->used--;
+	
+	for (size_t j = (i + 1) & mask; map->keys[j] != 0; j = (j + 1) & mask) {
+		size_t home = hash_u64(map->keys[j] - 1, map->size);
+		
+		/* move j into the hole at i unless its home lies in (i, j] */
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			map->keys[i] = map->keys[j];
+			map->values[i] = map->values[j];
+			map->keys[j] = 0;
+			i = j;
+		}
+	}
+}
+
+static size_t table_size_for(size_t entries) {
+	size_t size = 16;
+	
+	while (size < entries * 2) {
+		size *= 2;
+	}
+	
+	return size;
+}
+
+/**
+ * Build a classifier for this cache's geometry. Per-region counts use
+ * regions of 2^region_bits bytes.
+ */
+Miss_Classifier *classifier_create(const Cache *cache, unsigned int region_bits) {
+	Miss_Classifier *classifier = calloc(1, sizeof(Miss_Classifier));
+	
+	if (classifier == NULL) {
+		return NULL;
+	}
+	
+	classifier->offset_bits = cache->offset_bits;
+	classifier->region_bits = region_bits;
+	classifier->num_sets = cache->config.num_sets;
+	classifier->capacity = cache->config.num_sets * cache->config.ways;
+	classifier->head = NIL;
+	classifier->tail = NIL;
+	
+	classifier->blocks = malloc(sizeof(uint64_t) * classifier->capacity);
+	classifier->prev = malloc(sizeof(uint32_t) * classifier->capacity);
+	classifier->next = malloc(sizeof(uint32_t) * classifier->capacity);
+	classifier->sets = calloc(classifier->num_sets, sizeof(Miss_Counts));
+	
+	if (classifier->blocks == NULL || classifier->prev == NULL || classifier->next == NULL || classifier->sets == NULL
+		|| map_init(&classifier->seen, 1024, 1) < 0
+		|| map_init(&classifier->shadow, table_size_for(classifier->capacity), 0) < 0
+		|| map_init(&classifier->regions, 64, 1) < 0) {
+		classifier_destroy(classifier);
+		return NULL;
+	}
+	
+	return classifier;
+}
+
+void classifier_destroy(Miss_Classifier *classifier) {
+	if (classifier == NULL) {
+		return;
+	}
+	
+	map_free(&classifier->seen);
+	map_free(&classifier->shadow);
+	map_free(&classifier->regions);
+	free(classifier->blocks);
+	free(classifier->prev);
+	free(classifier->next);
+	free(classifier->sets);
+	free(classifier->region_ids);
+	free(classifier->region_counts);
+	free(classifier);
+}
+
+static void list_unlink(Miss_Classifier *c, uint32_t node) {
+	if (c->prev[node] != NIL) {
+		c->next[c->prev[node]] = c->next[node];
+	} else {
+		c->head = c->next[node];
+	}
+	
+	if (c->next[node] != NIL) {
+		c->prev[c->next[node]] = c->prev[node];
+	} else {
+		c->tail = c->prev[node];
+	}
+}
+
+static void list_push_front(Miss_Classifier *c, uint32_t node) {
+	c->prev[node] = NIL;
+	c->next[node] = c->head;
+	
+	if (c->head != NIL) {
+		c->prev[c->head] = node;
+	}
+	c->head = node;
+	
+	if (c->tail == NIL) {
+		c->tail = node;
+	}
+}
+
+/**
+ * Touch a block in the shadow cache; returns 1 if it was there
+ */
+static int shadow_access(Miss_Classifier *c, uint64_t block) {
+	uint32_t node;
+	
+	if (map_find(&c->shadow, block, &node)) {
+		if (c->head != node) {
+			list_unlink(c, node);
+			list_push_front(c, node);
+		}
+		return 1;
+	}
+	
+	if (c->count < c->capacity) {
+		node = c->count++;
+	} else {
+		/* evict the LRU block and reuse its node */
+		node = c->tail;
+		list_unlink(c, node);
+		map_remove(&c->shadow, c->blocks[node]);
+	}
+	
+	c->blocks[node] = block;
+	map_put(&c->shadow, block, node);
+	list_push_front(c, node);
+	
+	return 0;
+}
+
+static Miss_Counts *region_counts(Miss_Classifier *c, uint64_t region) {
+	uint32_t n;
+	
+	if (map_find(&c->regions, region, &n)) {
+		return &c->region_counts[n];
+	}
+	
+	if (c->num_regions == c->max_regions) {
+		size_t max_regions = c->max_regions ? c->max_regions * 2 : 64;
+		uint64_t *ids = realloc(c->region_ids, sizeof(uint64_t) * max_regions);
+		Miss_Counts *counts = realloc(c->region_counts, sizeof(Miss_Counts) * max_regions);
+		
+		if (ids == NULL || counts == NULL) {
+			fprintf(stderr, "[!] Out of memory classifying misses.\n");
+			exit(1);
+		}
+		c->region_ids = ids;
+		c->region_counts = counts;
+		c->max_regions = max_regions;
+	}
+	
+	n = c->num_regions++;
+	c->region_ids[n] = region;
+	memset(&c->region_counts[n], 0, sizeof(Miss_Counts));
+	map_put(&c->regions, region, n);
+	
+	return &c->region_counts[n];
+}
+
+/**
+ * Record one access to the cache; 'index' is the set it went to. Returns
+ * the MISS_* class, MISS_NONE for a hit.
+ */
+int classify_access(Miss_Classifier *c, uint64_t address, unsigned int index, int is_cache_hit) {
+	uint64_t block = address >> c->offset_bits;
+	uint32_t ignored;
+	int first_touch = !map_find(&c->seen, block, &ignored);
+	int shadow_hit = shadow_access(c, block);
+	int miss_class = MISS_NONE;
+	
+	if (first_touch) {
+		map_put(&c->seen, block, 0);
+	}
+	
+	if (!is_cache_hit) {
+		if (first_touch) {
+			miss_class = MISS_COMPULSORY;
+		} else if (!shadow_hit) {
+			miss_class = MISS_CAPACITY;
+		} else {
+			miss_class = MISS_CONFLICT;
+		}
+	}
+	
+	c->sets[index].counts[miss_class]++;
+	region_counts(c, address >> c->region_bits)->counts[miss_class]++;
+	c->last_class = miss_class;
+	
+	return miss_class;
+}
+
+int classifier_last_class(const Miss_Classifier *classifier) {
+	return classifier->last_class;
+}
+
+void classifier_totals(const Miss_Classifier *classifier, Miss_Counts *totals) {
+	memset(totals, 0, sizeof(Miss_Counts));
+	
+	for (unsigned int n=0; n < classifier->num_sets; n++) {
+		for (int k=0; k < 4; k++) {
+			totals->counts[k] += classifier->sets[n].counts[k];
+		}
+	}
+}
+
+static const Miss_Counts *sort_counts;
+
+static uint64_t misses(const Miss_Counts *counts) {
+	return counts->counts[MISS_COMPULSORY] + counts->counts[MISS_CAPACITY] + counts->counts[MISS_CONFLICT];
+}
+
+static int by_misses(const void *a, const void *b) {
+	uint64_t x = misses(&sort_counts[*(const size_t *)a]);
+	uint64_t y = misses(&sort_counts[*(const size_t *)b]);
+	
+	return (x < y) - (x > y);
+}
+
+static void print_counts(const Miss_Counts *counts) {
+	printf("%llu\t%llu\t%llu\t%llu\n",
+		(unsigned long long)counts->counts[MISS_NONE],
+		(unsigned long long)counts->counts[MISS_COMPULSORY],
+		(unsigned long long)counts->counts[MISS_CAPACITY],
+		(unsigned long long)counts->counts[MISS_CONFLICT]);
+}
+
+/**
+ * Misses by kind for each set, then for the regions with the most misses
+ */
+void print_miss_classes(const Miss_Classifier *classifier, int max_regions) {
+	Miss_Counts totals;
+	
+	printf("Set\tHits\tCompulsory\tCapacity\tConflict\n");
+	for (unsigned int n=0; n < classifier->num_sets; n++) {
+		printf("%x\t", n);
+		print_counts(&classifier->sets[n]);
+	}
+	
+	classifier_totals(classifier, &totals);
+	printf("Total\t");
+	print_counts(&totals);
+	
+	size_t *order = malloc(sizeof(size_t) * (classifier->num_regions + 1));
+	for (size_t n=0; n < classifier->num_regions; n++) {
+		order[n] = n;
+	}
+	
+	sort_counts = classifier->region_counts;
+	qsort(order, classifier->num_regions, sizeof(size_t), by_misses);
+	
+	printf("\nRegion (%u bytes)\tHits\tCompulsory\tCapacity\tConflict\n", 1u << classifier->region_bits);
+	for (size_t n=0; n < classifier->num_regions && (int)n < max_regions; n++) {
+		printf("0x%llx\t", (unsigned long long)(classifier->region_ids[order[n]] << classifier->region_bits));
+		print_counts(&classifier->region_counts[order[n]]);
+	}
+	
+	if (classifier->num_regions > (size_t)max_regions) {
+		printf("(%zu more regions)\n", classifier->num_regions - max_regions);
+	}
+	
+	free(order);
+}
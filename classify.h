@@ -0,0 +1,44 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * 3C miss classification: compulsory, capacity and conflict misses
+ *
+ * A miss is compulsory if its block has never been touched before. Any
+ * other miss is a capacity miss if a fully associative LRU cache of the
+ * same size would also have missed, and a conflict miss if it would have
+ * hit. The classifier keeps the set of blocks seen so far and that shadow
+ * cache, updated on every access, and counts misses of each kind per cache
+ * set and per address region.
+ *
+ * The shadow cache spans every set, so a cache with a classifier attached
+ * must only be driven from one thread.
+ */
+
+#ifndef Classify_h
+#define Classify_h
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "cache.h"
+
+#define MISS_NONE 0
+#define MISS_COMPULSORY 1
+#define MISS_CAPACITY 2
+#define MISS_CONFLICT 3
+
+/* default region for per-region counts: a 4K page */
+#define CLASSIFY_REGION_BITS 12
+
+typedef struct _Miss_Counts {
+	uint64_t counts[4]; /* indexed by MISS_*; MISS_NONE counts hits */
+} Miss_Counts;
+
+Miss_Classifier *classifier_create(const Cache *cache, unsigned int region_bits);
+void classifier_destroy(Miss_Classifier *classifier);
+
+int classify_access(Miss_Classifier *classifier, uint64_t address, unsigned int index, int is_cache_hit);
+int classifier_last_class(const Miss_Classifier *classifier);
+void classifier_totals(const Miss_Classifier *classifier, Miss_Counts *totals);
+void print_miss_classes(const Miss_Classifier *classifier, int max_regions);
+
+#endif
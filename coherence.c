@@ -0,0 +1,502 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * A shared L2 behind private L1s, kept coherent by a directory
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "coherence.h"
+
+#define DIR_INITIAL 1024
+
+void l2_default_config(L2_Config *config) {
+	config->block_size = CACHE_BLOCK_SIZE;
+	config->num_sets = 1024;
+	config->ways = 8;
+	config->hit_latency = 12;
+	config->miss_latency = 100;
+	config->forward_latency = 20;
+}
+
+static uint64_t port_submit(Mem_Backend *backend, uint64_t cycle, uint64_t address, int is_write);
+static uint64_t port_complete(Mem_Backend *backend, uint64_t id);
+static void port_drain(Mem_Backend *backend);
+static void port_print_stats(Mem_Backend *backend);
+static void port_destroy(Mem_Backend *backend);
+
+/**
+ * An L2 with 'num_ports' ports, up to L2_MAX_PORTS, for l2_attach() to
+ * give to L1s
+ */
+Shared_L2 *l2_create(const L2_Config *config, unsigned int num_ports, int deterministic) {
+	if (num_ports < 1 || num_ports > L2_MAX_PORTS) {
+		return NULL;
+	}
+	
+	Shared_L2 *l2 = calloc(1, sizeof(Shared_L2));
+	if (l2 == NULL) {
+		return NULL;
+	}
+	
+	Cache_Config geometry = { config->block_size, config->num_sets, config->ways, 0 };
+	
+	l2->config = *config;
+	l2->deterministic = deterministic;
+	l2->cache = cache_create(&geometry);
+	l2->ports = calloc(num_ports, sizeof(L2_Port));
+	l2->num_ports = num_ports;
+	l2->dir_size = DIR_INITIAL;
+	l2->directory = calloc(l2->dir_size, sizeof(Dir_Entry));
+	
+	if (l2->cache == NULL || l2->ports == NULL || l2->directory == NULL) {
+		l2_destroy(l2);
+		return NULL;
+	}
+	
+	pthread_mutex_init(&l2->lock, NULL);
+	
+	for (unsigned int n=0; n < num_ports; n++) {
+		L2_Port *port = &l2->ports[n];
+		
+		port->backend.name = "l2";
+		port->backend.submit = port_submit;
+		port->backend.complete = port_complete;
+		port->backend.drain = port_drain;
+		port->backend.print_stats = port_print_stats;
+		port->backend.destroy = port_destroy;
+		port->l2 = l2;
+		port->id = n;
+	}
+	
+	return l2;
+}
+
+void l2_destroy(Shared_L2 *l2) {
+	if (l2 == NULL) {
+		return;
+	}
+	
+	if (l2->ports != NULL) {
+		for (unsigned int n=0; n < l2->num_ports; n++) {
+			free(l2->ports[n].log);
+			free(l2->ports[n].inbox);
+		}
+		pthread_mutex_destroy(&l2->lock);
+	}
+	
+	cache_destroy(l2->cache);
+	free(l2->ports);
+	free(l2->directory);
+	free(l2);
+}
+
+/**
+ * Make an L1 use a port. Its addresses are offset by 'space' in the L2,
+ * so L1s only share blocks with others given the same space. Returns
+ * non-zero if the port doesn't exist or the block sizes differ.
+ */
+int l2_attach(Shared_L2 *l2, unsigned int port, Mshr_File *l1, uint64_t space) {
+	if (port >= l2->num_ports || l1->cache->config.block_size != l2->config.block_size) {
+		return -1;
+	}
+	
+	l2->ports[port].l1 = l1;
+	l2->ports[port].space = space;
+	l1->backend = &l2->ports[port].backend;
+	return 0;
+}
+
+/* the directory */
+
+static size_t dir_slot(const Shared_L2 *l2, uint64_t block) {
+	uint64_t hash = (block >> l2->cache->offset_bits) * 0x9e3779b97f4a7c15ull;
+	size_t mask = l2->dir_size - 1;
+	size_t n = (hash >> 32) & mask;
+	
+	while (l2->directory[n].block != 0 && l2->directory[n].block != block + 1) {
+		n = (n + 1) & mask;
+	}
+	
+	return n;
+}
+
+/* the entry for a block, or NULL if it has none */
+static const Dir_Entry *dir_find(const Shared_L2 *l2, uint64_t block) {
+	const Dir_Entry *entry = &l2->directory[dir_slot(l2, block)];
+	
+	return entry->block != 0 ? entry : NULL;
+}
+
+/* the entry for a block, made if it has none; NULL if memory runs out */
+static Dir_Entry *dir_get(Shared_L2 *l2, uint64_t block) {
+	if (2 * (l2->dir_used + 1) > l2->dir_size) {
+		/* keep it at most half full */
+		Dir_Entry *old = l2->directory;
+		size_t old_size = l2->dir_size;
+		Dir_Entry *directory = calloc(old_size * 2, sizeof(Dir_Entry));
+		
+		if (directory == NULL) {
+			return NULL;
+		}
+		
+		l2->directory = directory;
+		l2->dir_size = old_size * 2;
+		
+		for (size_t n=0; n < old_size; n++) {
+			if (old[n].block != 0) {
+				l2->directory[dir_slot(l2, old[n].block - 1)] = old[n];
+			}
+		}
+		free(old);
+	}
+	
+	Dir_Entry *entry = &l2->directory[dir_slot(l2, block)];
+	
+	if (entry->block == 0) {
+		entry->block = block + 1;
+		entry->sharers = 0;
+		entry->owner = -1;
+		l2->dir_used++;
+	}
+	
+	return entry;
+}
+
+/* the L1s */
+
+static void send(L2_Port *port, uint64_t block, unsigned char kind) {
+	if (port->inbox_length == port->inbox_size) {
+		size_t size = port->inbox_size ? port->inbox_size * 2 : 64;
+		L2_Message *inbox = realloc(port->inbox, sizeof(L2_Message) * size);
+		
+		if (inbox == NULL) {
+			return; /* the L1 keeps a copy it shouldn't, which only costs accuracy */
+		}
+		
+		port->inbox = inbox;
+		port->inbox_size = size;
+	}
+	
+	port->inbox[port->inbox_length++] = (L2_Message){ block, kind };
+}
+
+static inline uint64_t *owned_slot(L2_Port *port, uint64_t block) {
+	return &port->owned[(block >> port->l2->cache->offset_bits) % L2_OWNED];
+}
+
+/**
+ * Serve a request from a port and return the cycles it takes. Unless
+ * 'apply' is set, nothing changes: the request is only timed against the
+ * L2 and directory as they are.
+ */
+static uint64_t serve(Shared_L2 *l2, L2_Port *port, unsigned char kind, uint64_t block, int apply) {
+	const L2_Config *config = &l2->config;
+	uint64_t bit = 1ull << port->id;
+	uint64_t latency = 0;
+	Dir_Entry *entry = NULL;
+	const Dir_Entry *seen;
+	
+	if (apply) {
+		seen = entry = dir_get(l2, block);
+	} else {
+		seen = dir_find(l2, block);
+	}
+	
+	int owner = seen != NULL ? seen->owner : -1;
+	uint64_t sharers = seen != NULL ? seen->sharers : 0;
+	
+	switch (kind) {
+		case L2_FILL: {
+			unsigned int index = address_index(l2->cache, block);
+			uint64_t writebacks = l2->cache->sets[index].writebacks;
+			int hit;
+			
+			latency = config->hit_latency;
+			
+			if (apply) {
+				cache_read(l2->cache, block, &hit);
+				l2->memory_writes += l2->cache->sets[index].writebacks - writebacks;
+			} else {
+				hit = cache_probe(l2->cache, block);
+			}
+			
+			if (!hit) {
+				latency += config->miss_latency;
+			}
+			
+			if (owner >= 0 && (unsigned int)owner != port->id) {
+				latency += config->forward_latency;
+			}
+			
+			if (!apply) {
+				break;
+			}
+			
+			port->stats.fills++;
+			port->stats.fill_hits += hit;
+			
+			if (entry == NULL) {
+				break;
+			}
+			
+			if (owner >= 0 && (unsigned int)owner != port->id) {
+				/* the owner keeps a shared copy and must ask again to write */
+				port->stats.forwards++;
+				send(&l2->ports[owner], block, L2_DOWNGRADE);
+				entry->owner = -1;
+			}
+			entry->sharers |= bit;
+			break;
+		}
+		
+		case L2_WRITEBACK: {
+			if (!apply) {
+				break;
+			}
+			
+			unsigned int index = address_index(l2->cache, block);
+			uint64_t writebacks = l2->cache->sets[index].writebacks;
+			
+			port->stats.writebacks++;
+			cache_write(l2->cache, block, 0);
+			l2->memory_writes += l2->cache->sets[index].writebacks - writebacks;
+			
+			if (entry != NULL) {
+				entry->sharers &= ~bit;
+				if (entry->owner == (int)port->id) {
+					entry->owner = -1;
+				}
+			}
+			break;
+		}
+		
+		case L2_UPGRADE:
+			latency = config->hit_latency;
+			
+			if (owner >= 0 && (unsigned int)owner != port->id) {
+				latency += config->forward_latency;
+			}
+			
+			if (!apply) {
+				break;
+			}
+			
+			port->stats.upgrades++;
+			
+			if (entry == NULL) {
+				break;
+			}
+			
+			for (unsigned int n=0; n < l2->num_ports; n++) {
+				if (n != port->id && ((sharers >> n) & 1 || owner == (int)n)) {
+					send(&l2->ports[n], block, L2_INVALIDATE);
+					port->stats.invalidations++;
+				}
+			}
+			entry->sharers = bit;
+			entry->owner = port->id;
+			break;
+	}
+	
+	return latency;
+}
+
+/**
+ * A request made at 'cycle'; returns its latency. Deterministic requests
+ * are timed against the L2 as of the last sync and logged for it.
+ */
+static uint64_t request(L2_Port *port, uint64_t cycle, unsigned char kind, uint64_t block) {
+	Shared_L2 *l2 = port->l2;
+	uint64_t latency;
+	
+	if (!l2->deterministic) {
+		pthread_mutex_lock(&l2->lock);
+		latency = serve(l2, port, kind, block, 1);
+		pthread_mutex_unlock(&l2->lock);
+		return latency;
+	}
+	
+	latency = serve(l2, port, kind, block, 0);
+	
+	if (port->log_length == port->log_size) {
+		size_t size = port->log_size ? port->log_size * 2 : 256;
+		L2_Request *log = realloc(port->log, sizeof(L2_Request) * size);
+		
+		if (log == NULL) {
+			return latency; /* untimed by the L2, but the L1 carries on */
+		}
+		
+		port->log = log;
+		port->log_size = size;
+	}
+	
+	port->log[port->log_length++] = (L2_Request){ cycle, block, port->id, port->seq++, kind };
+	return latency;
+}
+
+/* an L1 fill or write-back */
+static uint64_t port_submit(Mem_Backend *backend, uint64_t cycle, uint64_t address, int is_write) {
+	L2_Port *port = (L2_Port *)backend;
+	uint64_t block = address_block_base(port->l2->cache, address + port->space);
+	
+	if (is_write) {
+		*owned_slot(port, block) = 0; /* it has left the L1 */
+		request(port, cycle, L2_WRITEBACK, block);
+		return 0;
+	}
+	
+	port->ready = cycle + request(port, cycle, L2_FILL, block);
+	return 0;
+}
+
+/* fills are served as they are submitted */
+static uint64_t port_complete(Mem_Backend *backend, uint64_t id) {
+	(void)id;
+	return ((L2_Port *)backend)->ready;
+}
+
+static void port_drain(Mem_Backend *backend) {
+	(void)backend;
+}
+
+static void port_print_stats(Mem_Backend *backend) {
+	const L2_Port *port = (L2_Port *)backend;
+	
+	printf("Port %u: %llu fills, %llu write-backs, %llu upgrades\n", port->id,
+		(unsigned long long)port->stats.fills,
+		(unsigned long long)port->stats.writebacks,
+		(unsigned long long)port->stats.upgrades);
+}
+
+/* ports belong to the L2 */
+static void port_destroy(Mem_Backend *backend) {
+	(void)backend;
+}
+
+/**
+ * A store at 'cycle' to 'address' in the L1; returns the cycle the L1 has
+ * the block to write
+ */
+uint64_t l2_store(L2_Port *port, uint64_t cycle, uint64_t address) {
+	uint64_t block = address_block_base(port->l2->cache, address + port->space);
+	uint64_t *owned = owned_slot(port, block);
+	
+	if (*owned == block + 1) {
+		return cycle;
+	}
+	
+	*owned = block + 1;
+	return cycle + request(port, cycle, L2_UPGRADE, block);
+}
+
+static int by_cycle(const void *a, const void *b) {
+	const L2_Request *x = a;
+	const L2_Request *y = b;
+	
+	if (x->cycle != y->cycle) {
+		return x->cycle < y->cycle ? -1 : 1;
+	}
+	
+	if (x->port != y->port) {
+		return x->port < y->port ? -1 : 1;
+	}
+	
+	return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+/**
+ * With every port stopped: apply the logged requests, oldest first, and
+ * hand each L1 the invalidations and downgrades for it
+ */
+void l2_sync(Shared_L2 *l2) {
+	if (l2->deterministic) {
+		size_t length = 0;
+		
+		for (unsigned int n=0; n < l2->num_ports; n++) {
+			length += l2->ports[n].log_length;
+		}
+		
+		L2_Request *requests = malloc(sizeof(L2_Request) * (length ? length : 1));
+		
+		if (requests != NULL) {
+			length = 0;
+			for (unsigned int n=0; n < l2->num_ports; n++) {
+				memcpy(&requests[length], l2->ports[n].log, sizeof(L2_Request) * l2->ports[n].log_length);
+				length += l2->ports[n].log_length;
+			}
+			
+			qsort(requests, length, sizeof(L2_Request), by_cycle);
+			
+			for (size_t n=0; n < length; n++) {
+				serve(l2, &l2->ports[requests[n].port], requests[n].kind, requests[n].block, 1);
+			}
+		} else {
+			fprintf(stderr, "[!] Unable to allocate the L2 requests.\n");
+		}
+		
+		free(requests);
+		for (unsigned int n=0; n < l2->num_ports; n++) {
+			l2->ports[n].log_length = 0;
+		}
+	}
+	
+	for (unsigned int n=0; n < l2->num_ports; n++) {
+		L2_Port *port = &l2->ports[n];
+		
+		for (size_t i=0; i < port->inbox_length; i++) {
+			uint64_t block = port->inbox[i].block;
+			uint64_t *owned = owned_slot(port, block);
+			
+			if (*owned == block + 1) {
+				*owned = 0;
+			}
+			
+			if (port->inbox[i].kind == L2_INVALIDATE && port->l1 != NULL
+				&& cache_evict(port->l1->cache, block - port->space)) {
+				port->stats.invalidated++;
+			}
+		}
+		port->inbox_length = 0;
+	}
+	
+	l2->syncs++;
+}
+
+void print_l2_stats(const Shared_L2 *l2) {
+	const L2_Config *config = &l2->config;
+	L2_Port_Stats total;
+	
+	memset(&total, 0, sizeof(total));
+	
+	printf("L2 of %u sets of %u ways of %u bytes, %u cycle hits, %u cycle misses, %u cycle forwards%s\n",
+		config->num_sets, config->ways, config->block_size, config->hit_latency,
+		config->miss_latency, config->forward_latency, l2->deterministic ? ", deterministic" : "");
+	printf("Port\tFills\tL2 hits\tForwards\tWBs\tUpgrades\tInvals\tLost\n");
+	
+	for (unsigned int n=0; n < l2->num_ports; n++) {
+		const L2_Port_Stats *stats = &l2->ports[n].stats;
+		
+		printf("%u\t%llu\t%llu\t%llu\t%llu\t%llu\t%llu\t%llu\n", n,
+			(unsigned long long)stats->fills,
+			(unsigned long long)stats->fill_hits,
+			(unsigned long long)stats->forwards,
+			(unsigned long long)stats->writebacks,
+			(unsigned long long)stats->upgrades,
+			(unsigned long long)stats->invalidations,
+			(unsigned long long)stats->invalidated);
+		
+		total.fills += stats->fills;
+		total.fill_hits += stats->fill_hits;
+		total.upgrades += stats->upgrades;
+		total.invalidations += stats->invalidations;
+	}
+	
+	printf("L2 hit rate %.2f%%, %llu upgrades, %llu invalidations, %llu blocks written to memory, %zu blocks in the directory\n",
+		total.fills ? 100.0 * total.fill_hits / total.fills : 0.0,
+		(unsigned long long)total.upgrades,
+		(unsigned long long)total.invalidations,
+		(unsigned long long)l2->memory_writes, l2->dir_used);
+}
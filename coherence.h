@@ -0,0 +1,145 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * A shared L2 behind private L1s, kept coherent by a directory
+ *
+ * Each L1 is an Mshr_File whose backend is its port on the L2: fills and
+ * write-backs go through the port, and a store asks the port for the block
+ * before it can finish. The directory keeps, per block, the L1s that may
+ * hold it and the one, if any, that may write it (MSI):
+ *
+ *   fill     L2 hit latency, plus the miss latency if the L2 misses, plus
+ *            the forward latency if another L1 has it modified; that L1
+ *            keeps a shared copy
+ *   store    free if this L1 already owns the block, else an upgrade: the
+ *            L2 hit latency, the other copies are invalidated, plus the
+ *            forward latency if one was modified
+ *
+ * Clean L1 evictions are silent, so the directory may name L1s that no
+ * longer hold a block; invalidating those does nothing. The L2 is a
+ * tag-only cache, neither inclusive nor exclusive, with a fixed memory
+ * latency behind it.
+ *
+ * Ports are meant to run on their own threads between sync points (see
+ * multicore.c). Invalidations and downgrades are queued for the L1s they
+ * are for and delivered by l2_sync(), so an L1 only ever changes on its
+ * own thread or while everything is stopped. In between, requests either
+ * update the L2 straight away under a lock, or, if the L2 is
+ * deterministic, see it as it was at the last sync and are logged; the
+ * sync then applies every port's log in cycle order, so results don't
+ * depend on how the threads were scheduled.
+ */
+
+#ifndef Coherence_h
+#define Coherence_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#include "cache.h"
+#include "mshr.h"
+#include "backend.h"
+
+/* sharers are a bit each */
+#define L2_MAX_PORTS 64
+
+/* blocks each port remembers owning, direct mapped */
+#define L2_OWNED 256
+
+/* requests from a port */
+#define L2_FILL 0
+#define L2_WRITEBACK 1
+#define L2_UPGRADE 2
+
+/* messages to an L1 */
+#define L2_INVALIDATE 0
+#define L2_DOWNGRADE 1
+
+typedef struct _L2_Config {
+	unsigned int block_size; /* must match the L1s' */
+	unsigned int num_sets;
+	unsigned int ways;
+	uint32_t hit_latency;     /* cycles for a request the L2 can serve */
+	uint32_t miss_latency;    /* more for one it has to go to memory for */
+	uint32_t forward_latency; /* more for one another L1 has modified */
+} L2_Config;
+
+typedef struct _L2_Request {
+	uint64_t cycle;
+	uint64_t block; /* with the port's space added */
+	unsigned int port;
+	unsigned int seq;  /* order within the port, to break ties */
+	unsigned char kind;
+} L2_Request;
+
+typedef struct _L2_Message {
+	uint64_t block;
+	unsigned char kind; /* L2_INVALIDATE or L2_DOWNGRADE */
+} L2_Message;
+
+typedef struct _L2_Port_Stats {
+	uint64_t fills;
+	uint64_t fill_hits;  /* ... the L2 had */
+	uint64_t forwards;   /* ... another L1 had modified */
+	uint64_t writebacks;
+	uint64_t upgrades;
+	uint64_t invalidations; /* copies this port's upgrades took from others */
+	uint64_t invalidated;   /* blocks this port's L1 lost to others */
+} L2_Port_Stats;
+
+typedef struct _Shared_L2 Shared_L2;
+
+typedef struct _L2_Port {
+	Mem_Backend backend; /* first, so the port is the L1's backend */
+	Shared_L2 *l2;
+	unsigned int id;
+	uint64_t space;  /* added to the L1's addresses, to keep address spaces apart */
+	Mshr_File *l1;
+	
+	uint64_t ready;  /* when the last fill arrives */
+	uint64_t owned[L2_OWNED]; /* block + 1, 0 for none */
+	
+	L2_Request *log; /* deterministic requests since the last sync */
+	size_t log_length, log_size;
+	unsigned int seq;
+	
+	L2_Message *inbox; /* for the L1, at the next sync */
+	size_t inbox_length, inbox_size;
+	
+	L2_Port_Stats stats;
+} L2_Port;
+
+typedef struct _Dir_Entry {
+	uint64_t block; /* + 1, 0 for an empty entry */
+	uint64_t sharers;
+	int owner; /* port with it modified, or -1 */
+} Dir_Entry;
+
+struct _Shared_L2 {
+	L2_Config config;
+	Cache *cache;
+	int deterministic;
+	pthread_mutex_t lock;
+	
+	Dir_Entry *directory; /* open addressed, a power of two long */
+	size_t dir_size, dir_used;
+	
+	L2_Port *ports;
+	unsigned int num_ports;
+	
+	uint64_t memory_writes; /* dirty blocks the L2 evicted */
+	uint64_t syncs;
+};
+
+void l2_default_config(L2_Config *config);
+
+Shared_L2 *l2_create(const L2_Config *config, unsigned int num_ports, int deterministic);
+void l2_destroy(Shared_L2 *l2);
+
+int l2_attach(Shared_L2 *l2, unsigned int port, Mshr_File *l1, uint64_t space);
+uint64_t l2_store(L2_Port *port, uint64_t cycle, uint64_t address);
+void l2_sync(Shared_L2 *l2);
+
+void print_l2_stats(const Shared_L2 *l2);
+
+#endif
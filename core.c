@@ -0,0 +1,1313 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * MIPS Pipeline core
+ * Compiled and run on OS X
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "core.h"
+#include "decode.h"
+
+/* wrap rather than run off the end of this core's memory */
+static inline size_t data_address(const Core *core, int32_t address) {
+	return ((uint32_t)address - core->data_base) % core->memory_size;
+}
+
+/* bytes a load or store moves */
+static unsigned int access_size(unsigned int opcode) {
+	switch (opcode) {
+		case 0x21: /* lh */
+		case 0x25: /* lhu */
+		case 0x29: /* sh */
+			return 2;
+		
+		case 0x23: /* lw */
+		case 0x2b: /* sw */
+			return 4;
+		
+		default:
+			return 1;
+	}
+}
+
+/**
+ * The registers an instruction reads in ID; 0 for none, as nothing waits
+ * on $0
+ */
+static void source_registers(const Predecode *pd, unsigned int *rs, unsigned int *rt) {
+	*rs = pd->rs;
+	*rt = pd->rt;
+	
+	switch (pd->opcode) {
+		case 0x0:
+			switch (pd->funct) {
+				case 0x00: /* sll */
+				case 0x02: /* srl */
+				case 0x03: /* sra */
+					*rs = 0;
+					break;
+				
+				case 0x08: /* jr */
+				case 0x09: /* jalr */
+				case 0x11: /* mthi */
+				case 0x13: /* mtlo */
+					*rt = 0;
+					break;
+				
+				case 0x10: /* mfhi */
+				case 0x12: /* mflo */
+					*rs = 0;
+					*rt = 0;
+					break;
+			}
+			break;
+		
+		case 0x2: /* j */
+		case 0x3: /* jal */
+		case 0xf: /* lui */
+			*rs = 0;
+			*rt = 0;
+			break;
+		
+		case 0x4: /* beq */
+		case 0x5: /* bne */
+		case 0x28: /* sb */
+		case 0x29: /* sh */
+		case 0x2b: /* sw */
+			break;
+		
+		default:
+			/* the rest only read rs: immediates, loads, compares with zero */
+			*rt = 0;
+			break;
+	}
+}
+
+/* the unit an instruction uses, or -1 */
+static int unit_of(unsigned int opcode, unsigned int funct) {
+	if (opcode != 0x0) {
+		return -1;
+	}
+	
+	switch (funct) {
+		case 0x18: /* mult */
+		case 0x19: /* multu */
+			return UNIT_MULT;
+		
+		case 0x1a: /* div */
+		case 0x1b: /* divu */
+			return UNIT_DIV;
+		
+		default:
+			return -1;
+	}
+}
+
+/**
+ * Fill in 'pd' for an instruction with these fields; NOOP is sll $0,$0,0,
+ * so its fields are all 0
+ */
+static void predecode_fields(Predecode *pd, unsigned int opcode, unsigned int rs, unsigned int rt,
+							 unsigned int rd, unsigned int shamt, unsigned int funct, int16_t immediate) {
+	unsigned int read_rs, read_rt;
+	
+	pd->immediate = immediate;
+	pd->opcode = opcode;
+	pd->funct = funct;
+	pd->rs = rs;
+	pd->rt = rt;
+	pd->rd = rd;
+	pd->shamt = shamt;
+	
+	source_registers(pd, &read_rs, &read_rt);
+	pd->read_rs = read_rs;
+	pd->read_rt = read_rt;
+	pd->size = access_size(opcode);
+	pd->unit = unit_of(opcode, funct);
+	
+	pd->flags = 0;
+	if (opcode == 0x0 && funct == 0x0c) {
+		pd->flags |= PREDECODE_SYSCALL;
+	}
+	if (opcode == 0x0 && (funct & 0x30) == 0x10) {
+		pd->flags |= PREDECODE_HI_LO;
+	}
+	if (opcode == 0x0 && (funct == 0x10 || funct == 0x12)) {
+		pd->flags |= PREDECODE_READS_HI_LO;
+	}
+}
+
+/**
+ * Split the whole program up front, so the stages look its fields up by
+ * pc instead of taking every instruction apart again each cycle
+ */
+static int predecode_program(Core *core) {
+	Decoded *decoded = decoded_create(core->program_length);
+	
+	if (decoded == NULL) {
+		return -1;
+	}
+	
+	decode_words(core->program, core->program_length, decoded, DECODE_BEST);
+	
+	for (size_t n=0; n < core->program_length; n++) {
+		predecode_fields(&core->predecode[n], decoded->opcode[n], decoded->rs[n], decoded->rt[n],
+						 decoded->rd[n], decoded->shamt[n], decoded->funct[n], decoded->immediate[n]);
+	}
+	predecode_fields(&core->predecode[core->program_length], 0, 0, 0, 0, 0, 0, 0);
+	
+	decoded_destroy(decoded);
+	return 0;
+}
+
+/**
+ * The Predecode for what a pipeline register holds. Anything but a NOOP
+ * was fetched from the program at its tag's pc; a NOOP's pc may be
+ * anywhere.
+ */
+static inline const Predecode *predecoded(const Core *core, uint32_t instr, uint32_t pc) {
+	if (instr == NOOP) {
+		return &core->predecode[core->program_length];
+	}
+	
+	return &core->predecode[(pc - core->text_base) / sizeof(uint32_t)];
+}
+
+/**
+ * An instruction waits in EX for a unit that can't take it yet, or for
+ * the result in HI and LO
+ */
+static int unit_stall(Core *core) {
+	const Predecode *pd = predecoded(core, core->ID_EX[PR_READ].instr, core->ID_EX[PR_READ].tag.pc);
+	int unit = pd->unit;
+	
+	if (unit >= 0 && core->units[unit].free_at > core->cycles) {
+		core->ex_ready = core->units[unit].free_at;
+	} else if ((pd->flags & PREDECODE_READS_HI_LO) && core->hilo_ready > core->cycles) {
+		core->ex_ready = core->hilo_ready;
+		unit = core->hilo_unit;
+	} else {
+		return 0;
+	}
+	
+	core->ex_unit = unit;
+	core->units[unit].stall_cycles++;
+	core->stall.pc = core->ID_EX[PR_READ].tag.pc;
+	core->stall.stall = STALL_UNIT;
+	return 1;
+}
+
+static int writes_register(short reg_write, short dest, unsigned int rs, unsigned int rt) {
+	return reg_write == 1 && dest > 0 && ((unsigned int)dest == rs || (unsigned int)dest == rt);
+}
+
+static int memory_stall(Core *core) {
+	const EX_MEM_Reg *access = &core->EX_MEM[PR_READ];
+	
+	if (core->dcache == NULL || access->instr == NOOP
+		|| (access->MemRead != 1 && access->MemWrite != 1)) {
+		return 0;
+	}
+	
+	if (!core->mem_issued) {
+		unsigned int size = predecoded(core, access->instr, access->tag.pc)->size;
+		Cache_Op op = { .address = core->data_base + (uint32_t)data_address(core, access->ALUResult),
+			.cycle = core->cycles, .is_write = access->MemWrite == 1,
+			.byte = (access->SWValue >> (8 * (size - 1))) & 0xff };
+		uint64_t issue = core->cycles;
+		
+		if (core->mmu != NULL) {
+			issue = mmu_translate(core->mmu, core->asid, op.address, 0, issue, &op.address);
+		}
+		
+		core->mem_ready = mshr_access(core->dcache, issue, &op);
+		core->mem_issued = 1;
+		
+		/* a store waits for the other L1s to give up the block */
+		if (core->l2 != NULL && op.is_write) {
+			uint64_t owned = l2_store(core->l2, issue, op.address);
+			
+			if (owned > core->mem_ready) {
+				core->mem_ready = owned;
+			}
+		}
+	}
+	
+	if (core->mem_ready > core->cycles + 1) {
+		core->stall.pc = access->tag.pc;
+		core->stall.stall = STALL_MEM;
+		return 1;
+	}
+	
+	core->mem_issued = 0; /* it leaves MEM this cycle */
+	return 0;
+}
+
+/**
+ * Hazard detection
+ * There is no forwarding, so an instruction in ID that reads a register an
+ * older instruction has yet to write back waits there, and IF waits behind
+ * it. WB writes after ID reads within a cycle, so WB counts as not written.
+ * The stall is charged to the instruction being waited on. Branches and
+ * jumps read their registers in ID too, so they wait the same way.
+ *
+ * With a data cache, a load or store stays in MEM until the cache says it
+ * is done, holding everything behind it; a hit takes the one cycle. Its
+ * address translation, if there is an MMU, is part of that wait.
+ */
+void detect_hazards(Core *core) {
+	uint32_t instr = core->IF_ID[PR_READ].instr;
+	
+	core->stall.stall = STALL_NONE;
+	
+	if (memory_stall(core) || unit_stall(core) || instr == NOOP) {
+		return;
+	}
+	
+	const Predecode *pd = predecoded(core, instr, core->IF_ID[PR_READ].tag.pc);
+	unsigned int rs = pd->read_rs;
+	unsigned int rt = pd->read_rt;
+	
+	const ID_EX_Reg *ex = &core->ID_EX[PR_READ];
+	const EX_MEM_Reg *mem = &core->EX_MEM[PR_READ];
+	const MEM_WB_Reg *wb = &core->MEM_WB[PR_READ];
+	
+	/* a syscall can read memory and any register, so it waits for everything */
+	if (pd->flags & PREDECODE_SYSCALL) {
+		if (ex->instr != NOOP || mem->instr != NOOP || wb->instr != NOOP) {
+			core->stall.pc = core->IF_ID[PR_READ].tag.pc;
+			core->stall.stall = STALL_SYSCALL;
+		}
+		return;
+	}
+	
+	if (ex->instr != NOOP
+		&& writes_register(ex->RegWrite, ex->RegDst == 1 ? ex->WriteReg2Num : ex->WriteReg1Num, rs, rt)) {
+		core->stall.pc = ex->tag.pc;
+	} else if (mem->instr != NOOP && writes_register(mem->RegWrite, mem->WriteRegNum, rs, rt)) {
+		core->stall.pc = mem->tag.pc;
+	} else if (wb->instr != NOOP && writes_register(wb->RegWrite, wb->WriteRegNum, rs, rt)) {
+		core->stall.pc = wb->tag.pc;
+	} else {
+		return;
+	}
+	
+	core->stall.stall = STALL_RAW;
+}
+
+/**
+ * IF - Instruction Fetch
+ * Fetch the next instruction out of the Instruction Cache.
+ * Put it in the WRITE version of the IF/ID pipeline register.
+ */
+void instr_fetch(Core *core) {
+	if (core->stall.stall != STALL_NONE) {
+		return; /* IF/ID still holds the instruction ID is waiting on */
+	}
+	
+	uint32_t pc = core->pc;
+	uint32_t instr = core->program[(pc - core->text_base) / sizeof(uint32_t)];
+	
+	if (core->mmu != NULL) {
+		if (!core->fetch_translated) {
+			uint64_t physical;
+			
+			core->fetch_ready = mmu_translate(core->mmu, core->asid, pc, 1, core->cycles, &physical);
+			core->fetch_translated = 1;
+		}
+		
+		if (core->fetch_ready > core->cycles) {
+			/* ID gets a bubble until the instruction TLB has the page */
+			core->IF_ID[PR_WRITE].instr = NOOP;
+			core->IF_ID[PR_WRITE].tag.pc = pc;
+			core->IF_ID[PR_WRITE].tag.stall = STALL_FETCH;
+			return;
+		}
+		
+		core->fetch_translated = 0;
+	}
+	
+	if (core->trace != NULL) {
+		Trace_Record record = { pc, core->cycles, TRACE_IFETCH, sizeof(uint32_t), 0 };
+		trace_write(core->trace, &record);
+	}
+	
+	/* this was a delay slot if a branch is waiting on it */
+	core->pc = core->branch_pending ? core->branch_target : pc + sizeof(uint32_t);
+	core->branch_pending = 0;
+	
+	core->IF_ID[PR_WRITE].instr = instr;
+	core->IF_ID[PR_WRITE].tag.pc = pc;
+	core->IF_ID[PR_WRITE].tag.stall = STALL_NONE;
+}
+
+static void set_control(ID_EX_Reg *id_ex, short reg_dst, short alu_src, short alu_op,
+						short mem_read, short mem_write, short mem_to_reg, short reg_write) {
+    id_ex->RegDst = reg_dst;
+    id_ex->ALUSrc = alu_src;
+    id_ex->ALUOp = alu_op;
+    id_ex->MemRead = mem_read;
+    id_ex->MemWrite = mem_write;
+    id_ex->MemToReg = mem_to_reg;
+    id_ex->RegWrite = reg_write;
+}
+
+/**
+ * Does the branch or jump at 'pc' go anywhere? If so its destination is
+ * stored in *target.
+ */
+static int branch_taken(const Predecode *pd, uint32_t instr, uint32_t pc, int32_t rs, int32_t rt,
+						uint32_t *target) {
+    int taken;
+    
+    switch (pd->opcode) {
+        case 0x0: /* jr, jalr */
+            *target = rs;
+            return 1;
+        
+        case 0x1: /* bltz, bgez */
+            taken = pd->rt == 1 ? rs >= 0 : rs < 0;
+            break;
+        
+        case 0x2: /* j */
+        case 0x3: /* jal */
+            *target = ((pc + 4) & 0xF0000000) | ((instr & 0x03FFFFFF) << 2);
+            return 1;
+        
+        case 0x4: /* beq */
+            taken = rs == rt;
+            break;
+        
+        case 0x5: /* bne */
+            taken = rs != rt;
+            break;
+        
+        case 0x6: /* blez */
+            taken = rs <= 0;
+            break;
+        
+        default: /* bgtz */
+            taken = rs > 0;
+            break;
+    }
+    
+    *target = pc + 4 + (uint32_t)((int32_t)pd->immediate * 4);
+    return taken;
+}
+
+/**
+ * Branches resolve in ID, so the instruction after one, its delay slot, is
+ * fetched and run whichever way it goes. Usually IF has just fetched the
+ * slot; if IF is waiting on a fetch instead, the new pc waits for it.
+ */
+static void take_branch(Core *core, uint32_t pc, uint32_t target) {
+    const Instr_Tag *fetched = &core->IF_ID[PR_WRITE].tag;
+    
+    if (fetched->stall == STALL_NONE && fetched->pc == pc + 4) {
+        core->pc = target;
+    } else {
+        core->branch_pending = 1;
+        core->branch_target = target;
+    }
+}
+
+/**
+ * ID - Instruction Decode
+ * read an instruction from the READ version of IF/ID pipeline register,
+ * do the decoding and register fetching and write the values to the
+ * WRITE version of the ID/EX pipeline register. Branches and jumps are
+ * resolved here.
+ */
+void instr_decode(Core *core) {
+	uint32_t instr = core->IF_ID[PR_READ].instr;
+	ID_EX_Reg *id_ex = &core->ID_EX[PR_WRITE];
+	
+	if (core->stall.stall == STALL_MEM || core->stall.stall == STALL_UNIT) {
+		return;
+	}
+	
+	if (core->stall.stall != STALL_NONE) {
+		/* send a bubble on and decode this instruction again next cycle */
+		memset(id_ex, 0, sizeof(ID_EX_Reg));
+		id_ex->instr = NOOP;
+		id_ex->tag = core->stall;
+		return;
+	}
+	
+	if (core->IF_ID[PR_READ].tag.stall != STALL_NONE || instr == NOOP) {
+		/* pass a bubble or nop on as it is, with no stale control signals */
+		memset(id_ex, 0, sizeof(ID_EX_Reg));
+		id_ex->instr = NOOP;
+		id_ex->tag = core->IF_ID[PR_READ].tag;
+		return;
+	}
+    
+    id_ex->instr = instr;
+    id_ex->tag = core->IF_ID[PR_READ].tag;
+    
+    const Predecode *pd = predecoded(core, instr, id_ex->tag.pc);
+	
+	/* fetch; the fields an instruction doesn't use go along unused */
+    id_ex->ReadReg1Value = core->registers[pd->rs];
+    id_ex->ReadReg2Value = core->registers[pd->rt];
+    id_ex->SEOffset = pd->immediate;
+    id_ex->WriteReg1Num = pd->rt;
+    id_ex->WriteReg2Num = pd->rs;
+	
+	/* decode */
+	switch (pd->opcode) {
+		case 0x0:
+            id_ex->SEOffset = X;
+            id_ex->WriteReg2Num = pd->rd;
+            
+            switch (pd->funct) {
+                case 0x08: /* jr */
+                case 0x0c: /* syscall */
+                case 0x11: /* mthi */
+                case 0x13: /* mtlo */
+                case 0x18: /* mult */
+                case 0x19: /* multu */
+                case 0x1a: /* div */
+                case 0x1b: /* divu */
+                    set_control(id_ex, X, 0, 2, 0, 0, X, 0);
+                    break;
+                
+                default:
+                    /* add, sub, logic, shifts, mfhi, mflo and jalr, which links in rd */
+                    set_control(id_ex, 1, 0, 2, 0, 0, 0, 1);
+                    break;
+            }
+            break;
+		
+		case 0x3: /* jal links in $31 */
+            id_ex->WriteReg2Num = 31;
+            set_control(id_ex, 1, 0, 1, 0, 0, 0, 1);
+            break;
+		
+		case 0x1: /* bltz, bgez */
+		case 0x2: /* j */
+		case 0x4: /* beq */
+		case 0x5: /* bne */
+		case 0x6: /* blez */
+		case 0x7: /* bgtz */
+            set_control(id_ex, X, 0, 1, 0, 0, X, 0);
+            break;
+		
+		case 0x20: /* lb */
+		case 0x21: /* lh */
+		case 0x23: /* lw */
+		case 0x24: /* lbu */
+		case 0x25: /* lhu */
+            set_control(id_ex, 0, 1, 0, 1, 0, 1, 1);
+            break;
+		
+		case 0x28: /* sb */
+		case 0x29: /* sh */
+		case 0x2b: /* sw */
+            set_control(id_ex, X, 1, 0, 0, 1, X, 0);
+            break;
+		
+		default:
+            if (pd->opcode >= 0x8 && pd->opcode <= 0xf) {
+                /* addi, addiu, slti, sltiu, andi, ori, xori, lui */
+                set_control(id_ex, 0, 1, 3, 0, 0, 0, 1);
+            } else {
+                set_control(id_ex, X, X, X, 0, 0, X, 0);
+            }
+            break;
+	}
+	
+	if (pd->flags & PREDECODE_SYSCALL) {
+		syscall_execute(core);
+		return;
+	}
+	
+	/* ALUOp 1 is a branch or jump, jr and jalr have funct 0x08 and 0x09 */
+	uint32_t target;
+	
+	if ((id_ex->ALUOp == 1 || (pd->opcode == 0x0 && (pd->funct & 0x3e) == 0x08))
+		&& branch_taken(pd, instr, id_ex->tag.pc, id_ex->ReadReg1Value, id_ex->ReadReg2Value, &target)) {
+		take_branch(core, id_ex->tag.pc, target);
+	}
+}
+
+/* the ALU, for whatever ID decoded */
+static int32_t alu(const Predecode *pd, const ID_EX_Reg *id_ex) {
+    uint32_t a = id_ex->ReadReg1Value;
+    uint32_t b = id_ex->ReadReg2Value;
+    uint32_t imm = id_ex->SEOffset;
+    
+    switch (pd->opcode) {
+        case 0x0:
+            switch (pd->funct) {
+                case 0x00: return b << pd->shamt; /* sll */
+                case 0x02: return b >> pd->shamt; /* srl */
+                case 0x03: return (int32_t)b >> pd->shamt; /* sra */
+                case 0x04: return b << (a & 31); /* sllv */
+                case 0x06: return b >> (a & 31); /* srlv */
+                case 0x07: return (int32_t)b >> (a & 31); /* srav */
+                case 0x09: return id_ex->tag.pc + 8; /* jalr */
+                case 0x20: /* add */
+                case 0x21: return a + b; /* addu */
+                case 0x22: /* sub */
+                case 0x23: return a - b; /* subu */
+                case 0x24: return a & b; /* and */
+                case 0x25: return a | b; /* or */
+                case 0x26: return a ^ b; /* xor */
+                case 0x27: return ~(a | b); /* nor */
+                case 0x2a: return (int32_t)a < (int32_t)b; /* slt */
+                case 0x2b: return a < b; /* sltu */
+                default: return 0;
+            }
+        
+        case 0x3: return id_ex->tag.pc + 8; /* jal */
+        case 0x8: /* addi */
+        case 0x9: return a + imm; /* addiu */
+        case 0xa: return (int32_t)a < (int32_t)imm; /* slti */
+        case 0xb: return a < imm; /* sltiu */
+        case 0xc: return a & (imm & 0xFFFF); /* andi */
+        case 0xd: return a | (imm & 0xFFFF); /* ori */
+        case 0xe: return a ^ (imm & 0xFFFF); /* xori */
+        case 0xf: return imm << 16; /* lui */
+        default: return a + imm; /* loads and stores: the address */
+    }
+}
+
+static void unit_issue(Func_Unit *unit, uint64_t cycle) {
+    uint64_t done = cycle + unit->config.latency;
+    
+    unit->ops++;
+    unit->busy_cycles += done - (unit->busy_until > cycle ? unit->busy_until : cycle);
+    unit->busy_until = done;
+    unit->free_at = unit->config.pipelined ? cycle + 1 : done;
+}
+
+/**
+ * The instructions that use HI and LO. The result is worked out now and
+ * kept from mfhi and mflo until the unit would have it.
+ */
+static void hi_lo(Core *core, const Predecode *pd, const ID_EX_Reg *id_ex, EX_MEM_Reg *ex_mem) {
+    int32_t a = id_ex->ReadReg1Value;
+    int32_t b = id_ex->ReadReg2Value;
+    int unit = pd->unit;
+    
+    switch (pd->funct) {
+        case 0x10: /* mfhi */
+            ex_mem->ALUResult = core->hi;
+            return;
+        
+        case 0x12: /* mflo */
+            ex_mem->ALUResult = core->lo;
+            return;
+        
+        case 0x11: /* mthi */
+            core->hi = a;
+            return;
+        
+        case 0x13: /* mtlo */
+            core->lo = a;
+            return;
+        
+        case 0x18: { /* mult */
+            int64_t product = (int64_t)a * b;
+            core->hi = (uint64_t)product >> 32;
+            core->lo = product;
+            break;
+        }
+        
+        case 0x19: { /* multu */
+            uint64_t product = (uint64_t)(uint32_t)a * (uint32_t)b;
+            core->hi = product >> 32;
+            core->lo = product;
+            break;
+        }
+        
+        case 0x1a: /* div; MIPS leaves dividing by zero undefined */
+            if (b == 0 || (a == INT32_MIN && b == -1)) {
+                core->lo = b == 0 ? 0 : a;
+                core->hi = b == 0 ? a : 0;
+            } else {
+                core->lo = a / b;
+                core->hi = a % b;
+            }
+            break;
+        
+        case 0x1b: /* divu */
+            core->lo = b == 0 ? 0 : (uint32_t)a / (uint32_t)b;
+            core->hi = b == 0 ? a : (int32_t)((uint32_t)a % (uint32_t)b);
+            break;
+        
+        default:
+            return;
+    }
+    
+    unit_issue(&core->units[unit], core->cycles);
+    core->hilo_ready = core->cycles + core->units[unit].config.latency;
+    core->hilo_unit = unit;
+}
+
+/**
+ * EX - Execute
+ * Perform the requested instruction on the specific operands read out of
+ * the READ version of the IDEX pipeline register and then write the
+ * appropriate values to the WRITE version of the EX/MEM pipeline register.
+ */
+void execute(Core *core) {
+	uint32_t instr = core->ID_EX[PR_READ].instr;
+	
+	if (core->stall.stall == STALL_MEM) {
+		return;
+	}
+	
+	if (core->stall.stall == STALL_UNIT) {
+		/* waiting on a unit: nothing for MEM this cycle */
+		memset(&core->EX_MEM[PR_WRITE], 0, sizeof(EX_MEM_Reg));
+		core->EX_MEM[PR_WRITE].instr = NOOP;
+		core->EX_MEM[PR_WRITE].tag = core->stall;
+		return;
+	}
+    
+    core->EX_MEM[PR_WRITE].instr = instr;
+    core->EX_MEM[PR_WRITE].tag = core->ID_EX[PR_READ].tag;
+    core->EX_MEM[PR_WRITE].MemRead = core->ID_EX[PR_READ].MemRead;
+    core->EX_MEM[PR_WRITE].MemWrite = core->ID_EX[PR_READ].MemWrite;
+    core->EX_MEM[PR_WRITE].MemToReg = core->ID_EX[PR_READ].MemToReg;
+    core->EX_MEM[PR_WRITE].RegWrite = core->ID_EX[PR_READ].RegWrite;
+    
+    if (core->ID_EX[PR_READ].RegDst == 0) {
+        core->EX_MEM[PR_WRITE].WriteRegNum = core->ID_EX[PR_READ].WriteReg1Num;
+    } else if (core->ID_EX[PR_READ].RegDst == 1) {
+        core->EX_MEM[PR_WRITE].WriteRegNum = core->ID_EX[PR_READ].WriteReg2Num;
+    } else {
+        core->EX_MEM[PR_WRITE].WriteRegNum = X;
+    }
+    
+    if (instr != NOOP) {
+        const Predecode *pd = predecoded(core, instr, core->ID_EX[PR_READ].tag.pc);
+        
+        core->EX_MEM[PR_WRITE].ALUResult = alu(pd, &core->ID_EX[PR_READ]);
+        core->EX_MEM[PR_WRITE].SWValue = core->ID_EX[PR_READ].ReadReg2Value;
+        
+        if (pd->flags & PREDECODE_HI_LO) {
+            hi_lo(core, pd, &core->ID_EX[PR_READ], &core->EX_MEM[PR_WRITE]);
+        }
+	}
+}
+
+/* big endian, wrapping at the end of memory like data_address() */
+static int32_t load(const Core *core, size_t address, const Predecode *pd) {
+    unsigned int size = pd->size;
+    uint32_t value = 0;
+    
+    for (unsigned int i=0; i < size; i++) {
+        value = (value << 8) | core->main_memory[(address + i) % core->memory_size];
+    }
+    
+    switch (pd->opcode) {
+        case 0x20: return (int8_t)value; /* lb */
+        case 0x21: return (int16_t)value; /* lh */
+        default: return value; /* lw, lbu, lhu */
+    }
+}
+
+static void store(Core *core, size_t address, const Predecode *pd, int32_t value) {
+    unsigned int size = pd->size;
+    
+    for (unsigned int i=0; i < size; i++) {
+        core->main_memory[(address + i) % core->memory_size] = (uint32_t)value >> (8 * (size - 1 - i));
+    }
+}
+
+/**
+ * MEM - Memory Access
+ * If the instruction is a load, then use the address you calculated in the
+ * EX stage as an index into your Main Memory array and get the value that
+ * is there.  Otherwise, just pass information from the READ version of the
+ * EX_MEM pipeline register to the WRITE version of MEM_WB.
+ */
+void memory_access(Core *core) {
+    uint32_t instr = core->EX_MEM[PR_READ].instr;
+    
+    if (core->stall.stall == STALL_MEM) {
+        /* still waiting on the cache: nothing for WB this cycle */
+        memset(&core->MEM_WB[PR_WRITE], 0, sizeof(MEM_WB_Reg));
+        core->MEM_WB[PR_WRITE].instr = NOOP;
+        core->MEM_WB[PR_WRITE].tag = core->stall;
+        return;
+    }
+    
+    core->MEM_WB[PR_WRITE].instr = instr;
+    core->MEM_WB[PR_WRITE].tag = core->EX_MEM[PR_READ].tag;
+    core->MEM_WB[PR_WRITE].MemRead = core->EX_MEM[PR_READ].MemRead;
+    core->MEM_WB[PR_WRITE].MemWrite = core->EX_MEM[PR_READ].MemWrite;
+    core->MEM_WB[PR_WRITE].MemToReg = core->EX_MEM[PR_READ].MemToReg;
+    core->MEM_WB[PR_WRITE].RegWrite = core->EX_MEM[PR_READ].RegWrite;
+    core->MEM_WB[PR_WRITE].ALUResult = core->EX_MEM[PR_READ].ALUResult;
+    core->MEM_WB[PR_WRITE].SWValue = core->EX_MEM[PR_READ].SWValue;
+    core->MEM_WB[PR_WRITE].WriteRegNum = core->EX_MEM[PR_READ].WriteRegNum;
+    
+    size_t address = data_address(core, core->MEM_WB[PR_WRITE].ALUResult);
+    const Predecode *pd = predecoded(core, instr, core->MEM_WB[PR_WRITE].tag.pc);
+    
+    if (core->MEM_WB[PR_WRITE].MemRead == 1) {
+        core->MEM_WB[PR_WRITE].LWDataValue = load(core, address, pd);
+    } else if (core->MEM_WB[PR_WRITE].MemWrite == 1) {
+        store(core, address, pd, core->MEM_WB[PR_WRITE].SWValue);
+    } else {
+        core->MEM_WB[PR_WRITE].LWDataValue = X;
+    }
+    
+    /* nops carry stale control signals, only trace real loads and stores */
+    if (core->trace != NULL && instr != NOOP
+        && (core->MEM_WB[PR_WRITE].MemRead == 1 || core->MEM_WB[PR_WRITE].MemWrite == 1)) {
+        unsigned int size = pd->size;
+        Trace_Record record = { core->data_base + (uint32_t)address, core->cycles, TRACE_READ, size, 0 };
+        
+        if (core->MEM_WB[PR_WRITE].MemWrite == 1) {
+            /* the byte at the address, the most significant */
+            record.type = TRACE_WRITE;
+            record.value = (core->MEM_WB[PR_WRITE].SWValue >> (8 * (size - 1))) & 0xff;
+        }
+        trace_write(core->trace, &record);
+    }
+}
+
+/**
+ * WB - Register Write Back
+ * Write to the registers based on information you read out of the
+ * READ version of MEM_WB
+ */
+void write_back(Core *core) {
+	/* $0 is always 0 */
+	if (core->MEM_WB[PR_READ].RegWrite == 1 && core->MEM_WB[PR_READ].WriteRegNum > 0) {
+        if (core->MEM_WB[PR_READ].MemToReg == 1) {
+            /* loads */
+            core->registers[core->MEM_WB[PR_READ].WriteRegNum] = core->MEM_WB[PR_READ].LWDataValue;
+        } else if (core->MEM_WB[PR_READ].MemToReg == 0){
+            /* everything else that writes a register */
+            core->registers[core->MEM_WB[PR_READ].WriteRegNum] = core->MEM_WB[PR_READ].ALUResult;
+        }
+    }
+}
+
+/**
+ *
+ */
+void copy_to_read(Core *core) {
+    core->IF_ID[PR_READ] = core->IF_ID[PR_WRITE];
+    core->ID_EX[PR_READ] = core->ID_EX[PR_WRITE];
+    core->EX_MEM[PR_READ] = core->EX_MEM[PR_WRITE];
+    core->MEM_WB[PR_READ] = core->MEM_WB[PR_WRITE];
+}
+
+/**
+ * Charge this cycle to whatever is in WB: the instruction retiring, or
+ * for a bubble the instruction that caused it. An array increment, so the
+ * profile is always on.
+ */
+static void profile_charge(Core *core, Instr_Tag tag, uint64_t cycles) {
+	size_t n = (tag.pc - core->text_base) / sizeof(uint32_t);
+	Pc_Counts *counts = &core->unattributed;
+	
+	if (tag.stall != STALL_FILL && tag.pc >= core->text_base && n < core->program_length) {
+		counts = &core->profile[n];
+	}
+	
+	if (tag.stall == STALL_NONE) {
+		counts->retired += cycles;
+	} else {
+		counts->stalls[tag.stall] += cycles;
+	}
+}
+
+void profile_cycle(Core *core) {
+	profile_charge(core, core->MEM_WB[PR_READ].tag, 1);
+}
+
+static inline int same_bubble(const Instr_Tag *a, const Instr_Tag *b) {
+	return a->stall != STALL_NONE && a->stall == b->stall && a->pc == b->pc;
+}
+
+/**
+ * Jump over cycles in which nothing can happen. Once a stall has drained
+ * everything behind it out of WB, each cycle until the stall ends is the
+ * same as the last: no stage changes state and the profile charges the
+ * same bubble again. That is so while MEM waits on the data cache and WB
+ * has its bubble, while EX waits on a multiply or divide unit and MEM and
+ * WB have its bubble, or while IF waits on the instruction TLB and every
+ * stage holds its bubble. Call after detect_hazards(); the skipped cycles are
+ * charged and counted as if they had been run, and the hazards are
+ * detected again for the cycle the core lands on. Returns the cycles
+ * skipped.
+ */
+uint64_t core_skip_stall(Core *core) {
+	const Instr_Tag *wb = &core->MEM_WB[PR_READ].tag;
+	uint64_t until = core->cycles;
+	
+	if (core->stall.stall == STALL_MEM) {
+		if (same_bubble(wb, &core->stall)) {
+			until = core->mem_ready - 1; /* the cycle MEM finishes in */
+		}
+	} else if (core->stall.stall == STALL_UNIT) {
+		if (same_bubble(wb, &core->stall) && same_bubble(&core->EX_MEM[PR_READ].tag, &core->stall)) {
+			until = core->ex_ready;
+		}
+	} else if (core->stall.stall == STALL_NONE && core->fetch_translated
+			   && core->fetch_ready > core->cycles) {
+		const Instr_Tag *fetch = &core->IF_ID[PR_READ].tag;
+		
+		if (fetch->stall == STALL_FETCH
+			&& same_bubble(&core->ID_EX[PR_READ].tag, fetch)
+			&& same_bubble(&core->EX_MEM[PR_READ].tag, fetch)
+			&& same_bubble(wb, fetch)) {
+			until = core->fetch_ready;
+		}
+	}
+	
+	if (until <= core->cycles) {
+		return 0;
+	}
+	
+	uint64_t skipped = until - core->cycles;
+	
+	if (core->stall.stall == STALL_UNIT) {
+		/* detect_hazards() counts the cycle it lands on */
+		core->units[core->ex_unit].stall_cycles += skipped - 1;
+	}
+	
+	profile_charge(core, *wb, skipped);
+	core->cycles = until;
+	detect_hazards(core);
+	
+	return skipped;
+}
+
+/**
+ * Create a core running 'program' with 'memory_size' bytes of main memory.
+ * The core, its pipeline registers and its memory come from a single arena,
+ * so core_destroy() is one free and cores never share state.
+ */
+Core *core_create(const uint32_t *program, size_t program_length, size_t memory_size) {
+	size_t size = ARENA_SIZE(sizeof(Core))
+		+ ARENA_SIZE(sizeof(IF_ID_Reg) * 2)
+		+ ARENA_SIZE(sizeof(ID_EX_Reg) * 2)
+		+ ARENA_SIZE(sizeof(EX_MEM_Reg) * 2)
+		+ ARENA_SIZE(sizeof(MEM_WB_Reg) * 2)
+		+ ARENA_SIZE(memory_size)
+		+ ARENA_SIZE(sizeof(Pc_Counts) * program_length)
+		+ ARENA_SIZE(sizeof(Predecode) * (program_length + 1));
+	
+	Arena *arena = arena_create(size);
+	if (arena == NULL) {
+		return NULL;
+	}
+	
+	Core *core = arena_alloc(arena, sizeof(Core));
+	core->arena = arena;
+	
+	core->IF_ID = arena_alloc(arena, sizeof(IF_ID_Reg) * 2);
+	core->ID_EX = arena_alloc(arena, sizeof(ID_EX_Reg) * 2);
+	core->EX_MEM = arena_alloc(arena, sizeof(EX_MEM_Reg) * 2);
+	core->MEM_WB = arena_alloc(arena, sizeof(MEM_WB_Reg) * 2);
+	core->main_memory = arena_alloc(arena, memory_size);
+	core->memory_size = memory_size;
+	core->shared_memory = 0;
+	core->data_base = 0;
+	
+	core->program = program;
+	core->program_length = program_length;
+	core->predecode = arena_alloc(arena, sizeof(Predecode) * (program_length + 1));
+	core->text_base = TEXT_BASE;
+	core->image = NULL;
+	core->profile = arena_alloc(arena, sizeof(Pc_Counts) * program_length);
+	
+	if (predecode_program(core) != 0) {
+		arena_destroy(arena);
+		return NULL;
+	}
+	core->register_base = 0x100;
+	core->trace = NULL;
+	core->dcache = NULL;
+	core->l2 = NULL;
+	core->mmu = NULL;
+	core->asid = 0;
+	
+	Unit_Config units[UNITS];
+	unit_default_config(units);
+	for (int n=0; n < UNITS; n++) {
+		core->units[n].config = units[n];
+	}
+	
+	core_reset(core);
+	
+	return core;
+}
+
+/**
+ * Create a core running a program image, with its text, data and memory
+ * layout. The image must outlive the core.
+ */
+Core *core_create_image(const Image *image) {
+	Core *core = core_create(image->text, image->text_words, image->memory_size);
+	
+	if (core == NULL) {
+		return NULL;
+	}
+	
+	core->text_base = image->text_base;
+	core->data_base = image->data_base;
+	core->image = image;
+	
+	core_reset(core);
+	
+	return core;
+}
+
+/**
+ * Create a core running a program image as another thread of 'owner's
+ * program: it has its own registers and pipeline but runs on the owner's
+ * memory, which must outlive it, and has none of its own
+ */
+Core *core_create_thread(const Image *image, const Core *owner) {
+	Core *core = core_create(image->text, image->text_words, 0);
+	
+	if (core == NULL) {
+		return NULL;
+	}
+	
+	core->text_base = image->text_base;
+	core->data_base = owner->data_base;
+	core->image = image;
+	core->main_memory = owner->main_memory;
+	core->memory_size = owner->memory_size;
+	core->shared_memory = 1;
+	
+	core_reset(core);
+	
+	return core;
+}
+
+/**
+ * Put the core back at the start of its program
+ */
+void core_reset(Core *core) {
+	core->pc = core->image != NULL ? core->image->entry : core->text_base;
+	core->branch_pending = 0;
+	core->cycles = 0;
+	core->stall.stall = STALL_NONE;
+	core->mem_issued = 0;
+	core->fetch_translated = 0;
+	
+	for (int n=0; n < UNITS; n++) {
+		Unit_Config config = core->units[n].config;
+		
+		memset(&core->units[n], 0, sizeof(Func_Unit));
+		core->units[n].config = config;
+	}
+	core->hi = core->lo = 0;
+	core->hilo_ready = 0;
+	core->ex_ready = 0;
+	
+	memset(core->profile, 0, sizeof(Pc_Counts) * core->program_length);
+	memset(&core->unattributed, 0, sizeof(Pc_Counts));
+	
+	initialize_memory(core);
+	initialize_registers(core);
+	syscall_reset(core);
+}
+
+/* a program ends by calling exit or running off the end of its text */
+int core_done(const Core *core) {
+	return core->syscalls.exited || core->pc - core->text_base >= core->program_length * sizeof(uint32_t);
+}
+
+/**
+ * Advance the pipeline one clock cycle
+ */
+void core_step(Core *core) {
+	detect_hazards(core);
+	core_skip_stall(core);
+	instr_fetch(core);
+	instr_decode(core);
+	execute(core);
+	memory_access(core);
+	write_back(core);
+	profile_cycle(core);
+	copy_to_read(core);
+	
+	core->cycles++;
+}
+
+/**
+ * Run until the program has been fetched; returns the cycles taken
+ */
+uint64_t core_run(Core *core) {
+	while (!core_done(core)) {
+		core_step(core);
+	}
+	
+	return core->cycles;
+}
+
+void core_destroy(Core *core) {
+	if (core != NULL) {
+		arena_destroy(core->arena);
+	}
+}
+
+/**
+ * A multiplier that takes an operation every cycle and a divider that
+ * takes one at a time, with latencies like the R4000's
+ */
+void unit_default_config(Unit_Config *units) {
+	units[UNIT_MULT].latency = 5;
+	units[UNIT_MULT].pipelined = 1;
+	units[UNIT_DIV].latency = 35;
+	units[UNIT_DIV].pipelined = 0;
+}
+
+int unit_from_name(const char *name) {
+	if (strcmp(name, "mult") == 0) {
+		return UNIT_MULT;
+	} else if (strcmp(name, "div") == 0) {
+		return UNIT_DIV;
+	}
+	
+	return -1;
+}
+
+/**
+ * Initialize main memory using 0x00–0xFF, or for an image with its data
+ * and the rest zero. Shared memory is left to the core it belongs to.
+ */
+void initialize_memory(Core *core) {
+	unsigned char current_value = 0;
+	
+	if (core->shared_memory) {
+		return;
+	}
+	
+	if (core->image != NULL) {
+		size_t size = core->image->data_size < core->memory_size ? core->image->data_size : core->memory_size;
+		
+		memset(core->main_memory, 0, core->memory_size);
+		memcpy(core->main_memory, core->image->data, size);
+		return;
+	}
+	
+	for (size_t n=0; n < core->memory_size; n++) {
+		core->main_memory[n] = current_value;
+		current_value++;
+	}
+}
+
+/**
+ * Initialize registers
+ * initial values of register_base (x100) plus the register number except
+ * for register 0. An image starts with them all 0 but $gp, at its data, and
+ * $sp, at the top of its memory.
+ */
+void initialize_registers(Core *core) {
+	core->registers[0] = 0;
+	
+	for (int n=1; n < NUM_REGISTERS; n++) {
+		core->registers[n] = core->image != NULL ? 0 : n + core->register_base;
+	}
+	
+	if (core->image != NULL) {
+		core->registers[28] = core->data_base;
+		core->registers[29] = (core->data_base + core->memory_size - 16) & ~7u;
+	}
+	
+	/* pipeline registers */
+	memset(core->IF_ID, 0, sizeof(IF_ID_Reg) * 2);
+	core->IF_ID[PR_WRITE].instr = NOOP;
+	core->IF_ID[PR_READ].instr = NOOP;
+	
+	memset(core->ID_EX, 0, sizeof(ID_EX_Reg) * 2);
+	core->ID_EX[PR_WRITE].instr = NOOP;
+	core->ID_EX[PR_READ].instr = NOOP;
+	
+	memset(core->EX_MEM, 0, sizeof(EX_MEM_Reg) * 2);
+	core->EX_MEM[PR_WRITE].instr = NOOP;
+	core->EX_MEM[PR_READ].instr = NOOP;
+    
+    memset(core->MEM_WB, 0, sizeof(MEM_WB_Reg) * 2);
+    core->MEM_WB[PR_WRITE].instr = NOOP;
+    core->MEM_WB[PR_READ].instr = NOOP;
+    
+    /* until the first instruction reaches WB, every cycle is a fill bubble */
+    for (int n=0; n < 2; n++) {
+        core->IF_ID[n].tag.stall = STALL_FILL;
+        core->ID_EX[n].tag.stall = STALL_FILL;
+        core->EX_MEM[n].tag.stall = STALL_FILL;
+        core->MEM_WB[n].tag.stall = STALL_FILL;
+    }
+}
+
+unsigned int get_opcode(uint32_t instr) {
+	unsigned int opcode = (instr & 0xFC000000) >> 26; // 26 - 31
+	return opcode;
+}
+
+unsigned int get_rs(uint32_t instr) {
+	unsigned int rs = (instr & 0x03E00000) >> 21; // 21 - 25
+	return rs;
+}
+
+unsigned int get_rt(uint32_t instr) {
+	unsigned int rt = (instr & 0x001F0000) >> 16; // 16 - 20
+	return rt;
+}
+
+unsigned int get_rd(uint32_t instr) {
+	unsigned int rd = (instr & 0x0000F800) >> 11; // 11 - 15
+	return rd;
+}
+
+unsigned int get_shamt(uint32_t instr) {
+	unsigned int shamt = (instr & 0x000007C0) >> 6; // 6 - 10
+	return shamt;
+}
+
+unsigned int get_funct(uint32_t instr) {
+	unsigned int funct = instr & 0x0000003F; // 0 - 5
+	return funct;
+}
+
+unsigned int get_immediate(uint32_t instr) {
+	short immediate = instr & 0x0000FFFF; // 0 - 15
+	return immediate;
+}
+
+static const char *funct_names[64] = {
+	[0x00] = "sll", [0x02] = "srl", [0x03] = "sra", [0x04] = "sllv",
+	[0x06] = "srlv", [0x07] = "srav", [0x08] = "jr", [0x09] = "jalr",
+	[0x0c] = "syscall", [0x10] = "mfhi", [0x11] = "mthi", [0x12] = "mflo",
+	[0x13] = "mtlo", [0x18] = "mult", [0x19] = "multu", [0x1a] = "div",
+	[0x1b] = "divu",
+	[0x20] = "add", [0x21] = "addu", [0x22] = "sub", [0x23] = "subu",
+	[0x24] = "and", [0x25] = "or", [0x26] = "xor", [0x27] = "nor",
+	[0x2a] = "slt", [0x2b] = "sltu"
+};
+
+static const char *opcode_names[64] = {
+	[0x02] = "j", [0x03] = "jal", [0x04] = "beq", [0x05] = "bne",
+	[0x06] = "blez", [0x07] = "bgtz", [0x08] = "addi", [0x09] = "addiu",
+	[0x0a] = "slti", [0x0b] = "sltiu", [0x0c] = "andi", [0x0d] = "ori",
+	[0x0e] = "xori", [0x0f] = "lui", [0x20] = "lb", [0x21] = "lh",
+	[0x23] = "lw", [0x24] = "lbu", [0x25] = "lhu", [0x28] = "sb",
+	[0x29] = "sh", [0x2b] = "sw"
+};
+
+/**
+ * Describe an instruction in assembler syntax into 'desc', which has room
+ * for INSTR_DESC_SIZE characters. Branch offsets are in instructions.
+ */
+void desc_instr(uint32_t instr, char *desc) {
+	unsigned int opcode = get_opcode(instr);
+	const char *name = opcode == 0x0 ? funct_names[get_funct(instr)] : opcode_names[opcode];
+	int immediate = (int)get_immediate(instr);
+	
+	if (instr == NOOP) {
+		strcpy(desc, "nop");
+	} else if (opcode == 0x1) {
+		snprintf(desc, INSTR_DESC_SIZE, "%s $%d,%d", get_rt(instr) == 1 ? "bgez" : "bltz",
+				 get_rs(instr), immediate);
+	} else if (name == NULL) {
+		strcpy(desc, opcode == 0x0 ? "Unknown funct!" : "Unknown opcode!");
+	} else if (opcode == 0x0) {
+		switch (get_funct(instr)) {
+			case 0x00: /* sll */
+			case 0x02: /* srl */
+			case 0x03: /* sra */
+				snprintf(desc, INSTR_DESC_SIZE, "%s $%d,$%d,%d", name,
+						 get_rd(instr), get_rt(instr), get_shamt(instr));
+				break;
+			
+			case 0x04: /* sllv */
+			case 0x06: /* srlv */
+			case 0x07: /* srav */
+				snprintf(desc, INSTR_DESC_SIZE, "%s $%d,$%d,$%d", name,
+						 get_rd(instr), get_rt(instr), get_rs(instr));
+				break;
+			
+			case 0x08: /* jr */
+				snprintf(desc, INSTR_DESC_SIZE, "jr $%d", get_rs(instr));
+				break;
+			
+			case 0x09: /* jalr */
+				snprintf(desc, INSTR_DESC_SIZE, "jalr $%d,$%d", get_rd(instr), get_rs(instr));
+				break;
+				
+			case 0x0c: /* syscall */
+				strcpy(desc, name);
+				break;
+			
+			case 0x10: /* mfhi */
+			case 0x12: /* mflo */
+				snprintf(desc, INSTR_DESC_SIZE, "%s $%d", name, get_rd(instr));
+				break;
+			
+			case 0x11: /* mthi */
+			case 0x13: /* mtlo */
+				snprintf(desc, INSTR_DESC_SIZE, "%s $%d", name, get_rs(instr));
+				break;
+			
+			case 0x18: /* mult */
+			case 0x19: /* multu */
+			case 0x1a: /* div */
+			case 0x1b: /* divu */
+				snprintf(desc, INSTR_DESC_SIZE, "%s $%d,$%d", name, get_rs(instr), get_rt(instr));
+				break;
+			
+			default: /* add, sub and the rest */
+				snprintf(desc, INSTR_DESC_SIZE, "%s $%d,$%d,$%d", name,
+						 get_rd(instr), get_rs(instr), get_rt(instr));
+				break;
+		}
+	} else {
+		switch (opcode) {
+			case 0x2: /* j */
+			case 0x3: /* jal */
+				snprintf(desc, INSTR_DESC_SIZE, "%s 0x%08x", name, (instr & 0x03FFFFFF) << 2);
+				break;
+			
+			case 0x4: /* beq */
+			case 0x5: /* bne */
+				snprintf(desc, INSTR_DESC_SIZE, "%s $%d,$%d,%d", name,
+						 get_rs(instr), get_rt(instr), immediate);
+				break;
+			
+			case 0x6: /* blez */
+			case 0x7: /* bgtz */
+				snprintf(desc, INSTR_DESC_SIZE, "%s $%d,%d", name, get_rs(instr), immediate);
+				break;
+			
+			case 0xc: /* andi */
+			case 0xd: /* ori */
+			case 0xe: /* xori */
+				snprintf(desc, INSTR_DESC_SIZE, "%s $%d,$%d,0x%x", name,
+						 get_rt(instr), get_rs(instr), instr & 0xFFFF);
+				break;
+			
+			case 0xf: /* lui */
+				snprintf(desc, INSTR_DESC_SIZE, "lui $%d,0x%x", get_rt(instr), instr & 0xFFFF);
+				break;
+			
+			default:
+				if (opcode >= 0x20) { /* lb, sb and the other loads and stores */
+					snprintf(desc, INSTR_DESC_SIZE, "%s $%d,%d($%d)", name,
+							 get_rt(instr), immediate, get_rs(instr));
+				} else { /* addi, addiu, slti, sltiu */
+					snprintf(desc, INSTR_DESC_SIZE, "%s $%d,$%d,%d", name,
+							 get_rt(instr), get_rs(instr), immediate);
+				}
+				break;
+		}
+	}
+}
@@ -0,0 +1,268 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * MIPS Pipeline core: pipeline registers, stages and instruction fields
+ */
+
+#ifndef Pipeline_core_h
+#define Pipeline_core_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "trace.h"
+#include "mshr.h"
+#include "coherence.h"
+#include "mmu.h"
+#include "image.h"
+#include "syscall.h"
+
+#define MEMORY_SIZE 1024 // 1K
+#define NUM_REGISTERS 32
+
+#define NOOP 0x00000000
+
+#define X -1
+
+#define PR_WRITE 0
+#define PR_READ 1
+
+#define TEXT_BASE 0x00400000 /* address of the first instruction */
+
+/* room for the longest desc_instr() */
+#define INSTR_DESC_SIZE 32
+
+/* why a pipeline register holds a bubble instead of an instruction */
+#define STALL_NONE 0 /* it doesn't, it holds a real instruction */
+#define STALL_FILL 1 /* the pipeline is still filling after a reset */
+#define STALL_RAW 2 /* an instruction waited in ID for a register to be written */
+#define STALL_MEM 3 /* a load or store waited in MEM for the data cache */
+#define STALL_FETCH 4 /* IF waited for the instruction TLB */
+#define STALL_SYSCALL 5 /* a syscall waited in ID for the pipeline to drain */
+#define STALL_UNIT 6 /* EX waited for the multiply or divide unit */
+#define STALL_KINDS 7
+
+/* the functional units beside the single cycle ALU */
+#define UNIT_MULT 0 /* mult, multu */
+#define UNIT_DIV 1  /* div, divu */
+#define UNITS 2
+
+/* what a Predecode knows about its instruction */
+#define PREDECODE_SYSCALL 1
+#define PREDECODE_HI_LO 2       /* functs 0x10-0x1f: mfhi, mthi, mflo, mtlo, mult and div */
+#define PREDECODE_READS_HI_LO 4 /* mfhi, mflo */
+
+/**
+ * One instruction of the program, split into its fields by decode_words()
+ * when the core is created, with what the stages ask of it every cycle
+ * worked out then too
+ */
+typedef struct _Predecode {
+	int16_t immediate;
+	uint8_t opcode;
+	uint8_t funct;
+	uint8_t rs, rt, rd, shamt;
+	uint8_t read_rs, read_rt; /* registers it reads in ID, 0 for none */
+	uint8_t size;             /* bytes a load or store moves */
+	int8_t unit;              /* UNIT_MULT, UNIT_DIV or -1 */
+	uint8_t flags;
+} Predecode;
+
+/**
+ * Which instruction a pipeline register holds. For a bubble, pc is the
+ * instruction that caused it and stall says why.
+ */
+typedef struct _Instr_Tag {
+	uint32_t pc;
+	short stall;
+} Instr_Tag;
+
+/* cycles charged to one instruction by the profiler */
+typedef struct _Pc_Counts {
+	uint64_t retired; /* times it reached WB */
+	uint64_t stalls[STALL_KINDS]; /* bubbles it caused, by reason */
+} Pc_Counts;
+
+typedef struct _Unit_Config {
+	uint32_t latency;  /* cycles until HI and LO have the result */
+	int pipelined;     /* takes a new operation every cycle, or waits */
+} Unit_Config;
+
+/**
+ * A multiply or divide unit. Operations leave EX in a cycle and finish in
+ * the unit; mfhi and mflo wait in EX for the result, and another operation
+ * waits in EX while the unit can't take it.
+ */
+typedef struct _Func_Unit {
+	Unit_Config config;
+	uint64_t free_at;    /* can take an operation from this cycle */
+	uint64_t busy_until; /* has an operation in flight until this cycle */
+	
+	uint64_t ops;
+	uint64_t busy_cycles;  /* with an operation in flight */
+	uint64_t stall_cycles; /* EX waited on it, for the unit or its result */
+} Func_Unit;
+
+typedef struct _IF_ID_Reg IF_ID_Reg;
+typedef struct _ID_EX_Reg ID_EX_Reg;
+typedef struct _EX_MEM_Reg EX_MEM_Reg;
+typedef struct _MEM_WB_Reg MEM_WB_Reg;
+
+struct _IF_ID_Reg {
+	uint32_t instr;
+	Instr_Tag tag;
+};
+
+struct _ID_EX_Reg {
+	uint32_t instr;
+    Instr_Tag tag;
+    short RegDst;
+    short ALUSrc;
+    short ALUOp;
+    short MemRead;
+    short MemWrite;
+    short MemToReg;
+    short RegWrite;
+    int32_t ReadReg1Value;
+    int32_t ReadReg2Value;
+    int32_t SEOffset;
+    short WriteReg1Num;
+    short WriteReg2Num;
+};
+
+struct _EX_MEM_Reg {
+    uint32_t instr;
+    Instr_Tag tag;
+    short MemRead;
+    short MemWrite;
+    short MemToReg;
+    short RegWrite;
+    int32_t ALUResult;
+    int32_t SWValue;
+    short WriteRegNum;
+};
+
+struct _MEM_WB_Reg {
+    uint32_t instr;
+    Instr_Tag tag;
+    short MemRead;
+    short MemWrite;
+    short MemToReg;
+    short RegWrite;
+    int32_t ALUResult;
+    int32_t SWValue;
+    int32_t LWDataValue;
+    short WriteRegNum;
+};
+
+/* everything one simulated pipeline needs; cores share nothing */
+typedef struct _Core {
+	Arena *arena; /* the core and everything it points to lives here */
+	
+	IF_ID_Reg *IF_ID;
+	ID_EX_Reg *ID_EX;
+	EX_MEM_Reg *EX_MEM;
+	MEM_WB_Reg *MEM_WB;
+	
+	/* byte addressed, big endian; address data_base is main_memory[0] */
+	uint8_t *main_memory;
+	size_t memory_size;
+	int shared_memory; /* main_memory is another core's, which resets it */
+	uint32_t data_base;
+	int32_t registers[NUM_REGISTERS];
+	int32_t register_base; /* registers start out as n + register_base */
+	
+	/* instruction stream fetched by instr_fetch() */
+	const uint32_t *program;
+	size_t program_length;
+	Predecode *predecode; /* one per instruction of the program, then one for NOOP */
+	
+	uint32_t text_base; /* pc of program[0] */
+	
+	/* if set, the program, data and stack come from here */
+	const Image *image;
+	
+	uint32_t pc; /* next instruction to fetch */
+	int branch_pending;     /* a taken branch waits for its delay slot ... */
+	uint32_t branch_target; /* ... to be fetched before going here */
+	
+	uint64_t cycles;
+	
+	/* if set, loads and stores are timed through this data cache */
+	Mshr_File *dcache;
+	int mem_issued;    /* the access in MEM has gone to the cache ... */
+	uint64_t mem_ready; /* ... and completes at this cycle */
+	
+	/* if set, the dcache is one of several L1s on a shared L2 */
+	L2_Port *l2;
+	
+	/**
+	 * If set, pcs and data addresses are virtual in address space asid and
+	 * are translated before they are used; needs a dcache to time the walks.
+	 */
+	Mmu *mmu;
+	unsigned int asid;
+	int fetch_translated; /* the fetch in IF has been translated ... */
+	uint64_t fetch_ready;  /* ... and can go at this cycle */
+	
+	/* multiply and divide, and the HI and LO registers they write */
+	Func_Unit units[UNITS];
+	int32_t hi, lo;
+	uint64_t hilo_ready; /* mfhi and mflo can read them from this cycle ... */
+	int hilo_unit;       /* ... when this unit is done */
+	uint64_t ex_ready;   /* with a STALL_UNIT, EX can go at this cycle ... */
+	int ex_unit;         /* ... once this unit is ready */
+	
+	/* heap, descriptors and counts for the program's syscalls */
+	Syscall_State syscalls;
+	
+	/* set by detect_hazards() when stages must hold this cycle */
+	Instr_Tag stall;
+	
+	/**
+	 * Every cycle is charged to the instruction in WB, or for a bubble to
+	 * the instruction that caused it: profile is indexed by
+	 * (pc - text_base) / 4, bubbles with no instruction go in unattributed.
+	 */
+	Pc_Counts *profile;
+	Pc_Counts unattributed;
+	
+	/* if set, instruction fetches and data accesses are recorded here */
+	Trace_Writer *trace;
+} Core;
+
+Core *core_create(const uint32_t *program, size_t program_length, size_t memory_size);
+Core *core_create_image(const Image *image);
+Core *core_create_thread(const Image *image, const Core *owner);
+void core_reset(Core *core);
+int core_done(const Core *core);
+void core_step(Core *core);
+uint64_t core_skip_stall(Core *core);
+uint64_t core_run(Core *core);
+void core_destroy(Core *core);
+
+void initialize_memory(Core *core);
+void initialize_registers(Core *core);
+
+void unit_default_config(Unit_Config *units);
+int unit_from_name(const char *name);
+
+void detect_hazards(Core *core);
+void instr_fetch(Core *core);
+void instr_decode(Core *core);
+void execute(Core *core);
+void memory_access(Core *core);
+void write_back(Core *core);
+void copy_to_read(Core *core);
+void profile_cycle(Core *core);
+
+void desc_instr(uint32_t instr, char *desc);
+unsigned int get_opcode(uint32_t instr);
+unsigned int get_rs(uint32_t instr);
+unsigned int get_rt(uint32_t instr);
+unsigned int get_rd(uint32_t instr);
+unsigned int get_shamt(uint32_t instr);
+unsigned int get_funct(uint32_t instr);
+unsigned int get_immediate(uint32_t instr);
+
+#endif
@@ -0,0 +1,317 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Compiled and run on OS X
+ * Decode MIPS instructions and format them as text
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DECODE_X86
+#endif
+
+#include "decode.h"
+
+/**
+ * The line for an instruction already split into its fields
+ */
+static int format_fields(uint32_t bits, unsigned int opcode, unsigned int rs, unsigned int rt,
+						 unsigned int rd, unsigned int funct, short immediate,
+						 uint32_t addr, char *buf, size_t size) {
+	/* jump address is counter + offset shifted left by 2 */
+	unsigned int dest_addr = addr + (uint32_t)(immediate * 4);
+	
+	switch (opcode) {
+		case 0x0:
+		
+		switch (funct) {
+			case 0x20: /* add */
+			return snprintf(buf, size, "%x\tadd $%d,$%d,$%d\n", addr, rd, rs, rt);
+			
+			case 0x22: /* sub */
+			return snprintf(buf, size, "%x\tsub $%d,$%d,$%d\n", addr, rd, rs, rt);
+			
+			case 0x24: /* and */
+			return snprintf(buf, size, "%x\tand $%d,$%d,$%d\n", addr, rd, rs, rt);
+			
+			case 0x25: /* or */
+			return snprintf(buf, size, "%x\tor $%d,$%d,$%d\n", addr, rd, rs, rt);
+			
+			case 0x2a: /* slt */
+			return snprintf(buf, size, "%x\tslt $%d,$%d,$%d\n", addr, rd, rs, rt);
+			
+			default:
+			return snprintf(buf, size, "%x\tUnknown funct %x for opcode %x (%x)\n", addr,funct, opcode, bits);
+		}
+		
+		case 0x23: /* lw */ // TODO
+		return snprintf(buf, size, "%x\tlw $%d,%d($%d)\n", addr, rt, immediate, rs);
+		
+		case 0x2b: /* sw */
+		return snprintf(buf, size, "%x\tsw $%d,%d($%d)\n", addr, rt, immediate,rs);
+		
+		case 0x4: /* beq */
+		return snprintf(buf, size, "%x\tbeq $%d,$%d, address %x\n", addr, rs, rt, dest_addr);
+		
+		case 0x5: /* bne */
+		return snprintf(buf, size, "%x\tbne $%d,$%d, address %x\n", addr, rs, rt, dest_addr);
+		
+		default:
+		return snprintf(buf, size, "%x\tUnknown opcode: %x (%x)\n", addr, opcode, bits);
+	}
+}
+
+/**
+ * Write the disassembly of one instruction into buf, snprintf style.
+ * Returns the length of the line that was (or would have been) written.
+ */
+int format_inst(uint32_t bits, uint32_t addr, char *buf, size_t size) {
+	unsigned int opcode = (bits & 0xFC000000) >> 26; // 26 - 31
+	
+	/* for r-type */
+	unsigned int rs = (bits & 0x03E00000) >> 21; // 21 - 25
+	unsigned int rt = (bits & 0x001F0000) >> 16; // 16 - 20
+	unsigned int rd = (bits & 0x0000F800) >> 11; // 11 - 15
+	unsigned int funct = bits & 0x0000003F; // 0 - 5
+	
+	/* for i-type */
+	short immediate = bits & 0x0000FFFF; // 0 - 15 
+	
+	return format_fields(bits, opcode, rs, rt, rd, funct, immediate, addr, buf, size);
+}
+
+/**
+ * format_inst() for instruction n of a decode_bulk() run
+ */
+int format_decoded(const Decoded *decoded, size_t n, uint32_t addr, char *buf, size_t size) {
+	return format_fields(decoded->bits[n], decoded->opcode[n], decoded->rs[n], decoded->rt[n],
+						 decoded->rd[n], decoded->funct[n], decoded->immediate[n], addr, buf, size);
+}
+
+/**
+ * Room for 'length' decoded instructions, every array in one allocation
+ */
+Decoded *decoded_create(size_t length) {
+	size_t words = (length / 64 + 1) * 64; /* a multiple of 64 keeps every array 64 byte aligned */
+	Decoded *decoded = malloc(sizeof(Decoded));
+	unsigned char *p = NULL;
+	
+	if (decoded == NULL
+		|| posix_memalign((void **)&p, 64, words * (2 * sizeof(uint32_t) + sizeof(int16_t) + 6)) != 0) {
+		free(decoded);
+		return NULL;
+	}
+	
+	decoded->length = length;
+	decoded->bits = (uint32_t *)p;
+	decoded->target = (uint32_t *)(p + words * 4);
+	decoded->immediate = (int16_t *)(p + words * 8);
+	decoded->opcode = p + words * 10;
+	decoded->rs = decoded->opcode + words;
+	decoded->rt = decoded->rs + words;
+	decoded->rd = decoded->rt + words;
+	decoded->shamt = decoded->rd + words;
+	decoded->funct = decoded->shamt + words;
+	
+	return decoded;
+}
+
+void decoded_destroy(Decoded *decoded) {
+	if (decoded != NULL) {
+		free(decoded->bits);
+		free(decoded);
+	}
+}
+
+/* words are big endian if 'swap', else already in host order */
+static void decode_scalar(const unsigned char *text, size_t from, size_t n, Decoded *out, int swap) {
+	for (size_t i=from; i < n; i++) {
+		const unsigned char *p = &text[4 * i];
+		uint32_t bits;
+		
+		if (swap) {
+			bits = (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+		} else {
+			memcpy(&bits, p, sizeof(bits));
+		}
+		
+		out->bits[i] = bits;
+		out->opcode[i] = bits >> 26;
+		out->rs[i] = (bits >> 21) & 0x1F;
+		out->rt[i] = (bits >> 16) & 0x1F;
+		out->rd[i] = (bits >> 11) & 0x1F;
+		out->shamt[i] = (bits >> 6) & 0x1F;
+		out->funct[i] = bits & 0x3F;
+		out->immediate[i] = bits & 0xFFFF;
+		out->target[i] = bits & 0x03FFFFFF;
+	}
+}
+
+#ifdef DECODE_X86
+
+/**
+ * 8 words a step: two vectors of 4, swapped to host order, then each
+ * field packed down to 8 bytes (or 8 halfwords) and stored
+ */
+__attribute__((target("sse4.1")))
+static size_t decode_sse4(const unsigned char *text, size_t n, Decoded *out, int swap) {
+	const __m128i order = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	const __m128i five = _mm_set1_epi32(0x1F);
+	size_t i;
+	
+	for (i=0; i + 8 <= n; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *)&text[4 * i]);
+		__m128i b = _mm_loadu_si128((const __m128i *)&text[4 * i + 16]);
+		
+		if (swap) {
+			a = _mm_shuffle_epi8(a, order);
+			b = _mm_shuffle_epi8(b, order);
+		}
+		
+		_mm_storeu_si128((__m128i *)&out->bits[i], a);
+		_mm_storeu_si128((__m128i *)&out->bits[i + 4], b);
+		
+		__m128i mask = _mm_set1_epi32(0x03FFFFFF);
+		_mm_storeu_si128((__m128i *)&out->target[i], _mm_and_si128(a, mask));
+		_mm_storeu_si128((__m128i *)&out->target[i + 4], _mm_and_si128(b, mask));
+		
+		mask = _mm_set1_epi32(0xFFFF);
+		_mm_storeu_si128((__m128i *)&out->immediate[i],
+						 _mm_packus_epi32(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+
+#define SSE4_FIELD(field, shift, bits_mask) { \
+			__m128i words = _mm_packus_epi32(_mm_and_si128(_mm_srli_epi32(a, shift), bits_mask), \
+											 _mm_and_si128(_mm_srli_epi32(b, shift), bits_mask)); \
+			_mm_storel_epi64((__m128i *)&out->field[i], _mm_packus_epi16(words, words)); \
+		}
+		
+		SSE4_FIELD(opcode, 26, _mm_set1_epi32(0x3F));
+		SSE4_FIELD(rs, 21, five);
+		SSE4_FIELD(rt, 16, five);
+		SSE4_FIELD(rd, 11, five);
+		SSE4_FIELD(shamt, 6, five);
+		SSE4_FIELD(funct, 0, _mm_set1_epi32(0x3F));
+#undef SSE4_FIELD
+	}
+	
+	return i;
+}
+
+/**
+ * 16 words a step. Packing works within each 128 bit lane, so each pack
+ * is followed by a permute to put the instructions back in order.
+ */
+__attribute__((target("avx2")))
+static size_t decode_avx2(const unsigned char *text, size_t n, Decoded *out, int swap) {
+	const __m256i order = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+										  3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	const __m256i five = _mm256_set1_epi32(0x1F);
+	size_t i;
+	
+	for (i=0; i + 16 <= n; i += 16) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)&text[4 * i]);
+		__m256i b = _mm256_loadu_si256((const __m256i *)&text[4 * i + 32]);
+		
+		if (swap) {
+			a = _mm256_shuffle_epi8(a, order);
+			b = _mm256_shuffle_epi8(b, order);
+		}
+		
+		_mm256_storeu_si256((__m256i *)&out->bits[i], a);
+		_mm256_storeu_si256((__m256i *)&out->bits[i + 8], b);
+		
+		__m256i mask = _mm256_set1_epi32(0x03FFFFFF);
+		_mm256_storeu_si256((__m256i *)&out->target[i], _mm256_and_si256(a, mask));
+		_mm256_storeu_si256((__m256i *)&out->target[i + 8], _mm256_and_si256(b, mask));
+		
+		/* halfwords come out a0-3 b0-3 | a4-7 b4-7; 0xD8 swaps the middle quarters */
+		mask = _mm256_set1_epi32(0xFFFF);
+		__m256i halves = _mm256_packus_epi32(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+		_mm256_storeu_si256((__m256i *)&out->immediate[i], _mm256_permute4x64_epi64(halves, 0xD8));
+		
+		/* bytes come out x0-7 twice | x8-15 twice; 0x08 takes one of each */
+#define AVX2_FIELD(field, shift, bits_mask) { \
+			__m256i words = _mm256_permute4x64_epi64( \
+				_mm256_packus_epi32(_mm256_and_si256(_mm256_srli_epi32(a, shift), bits_mask), \
+									_mm256_and_si256(_mm256_srli_epi32(b, shift), bits_mask)), 0xD8); \
+			__m256i bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(words, words), 0x08); \
+			_mm_storeu_si128((__m128i *)&out->field[i], _mm256_castsi256_si128(bytes)); \
+		}
+		
+		AVX2_FIELD(opcode, 26, _mm256_set1_epi32(0x3F));
+		AVX2_FIELD(rs, 21, five);
+		AVX2_FIELD(rt, 16, five);
+		AVX2_FIELD(rd, 11, five);
+		AVX2_FIELD(shamt, 6, five);
+		AVX2_FIELD(funct, 0, _mm256_set1_epi32(0x3F));
+#undef AVX2_FIELD
+	}
+	
+	return i;
+}
+
+#endif
+
+/**
+ * The kernel decode_bulk() would really use when asked for 'kernel': the
+ * one asked for if the host can run it, else the best it can
+ */
+int decode_kernel(int kernel) {
+	int best = DECODE_SCALAR;
+
+#ifdef DECODE_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		best = DECODE_AVX2;
+	} else if (__builtin_cpu_supports("sse4.1")) {
+		best = DECODE_SSE4;
+	}
+#endif
+	
+	return kernel >= DECODE_SCALAR && kernel <= best ? kernel : best;
+}
+
+const char *decode_kernel_name(int kernel) {
+	static const char *names[] = { "scalar", "sse4", "avx2" };
+	
+	return names[decode_kernel(kernel)];
+}
+
+static void decode_run(const unsigned char *text, size_t n, Decoded *out, int kernel, int swap) {
+	size_t done = 0;
+	
+	switch (decode_kernel(kernel)) {
+#ifdef DECODE_X86
+		case DECODE_AVX2:
+			done = decode_avx2(text, n, out, swap);
+			break;
+		
+		case DECODE_SSE4:
+			done = decode_sse4(text, n, out, swap);
+			break;
+#endif
+		
+		default:
+			break;
+	}
+	
+	/* and whatever didn't fill a step */
+	decode_scalar(text, done, n, out, swap);
+}
+
+/**
+ * Split 'n' big endian instruction words from 'text' into 'out', which
+ * must have room for them
+ */
+void decode_bulk(const unsigned char *text, size_t n, Decoded *out, int kernel) {
+	decode_run(text, n, out, kernel, 1);
+}
+
+/* decode_bulk() for words already in host order, as an Image holds them */
+void decode_words(const uint32_t *words, size_t n, Decoded *out, int kernel) {
+	decode_run((const unsigned char *)words, n, out, kernel, 0);
+}
@@ -0,0 +1,52 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * MIPS instruction decoding and formatting
+ *
+ * decode_bulk() splits whole runs of instructions into their fields at
+ * once, in structure-of-arrays form: field[i] belongs to instruction i.
+ * The text is big endian, as MIPS stores it in memory, in binaries and in
+ * program images. Hosts with AVX2 swap and split 16 words a step, hosts
+ * with SSE4.1 8, and anything else one at a time; the results are the
+ * same.
+ */
+
+#ifndef Decode_h
+#define Decode_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* longest line format_inst() produces, including the newline */
+#define INST_TEXT_SIZE 64
+
+/* ways of running decode_bulk(); DECODE_BEST is the fastest the host has */
+#define DECODE_BEST -1
+#define DECODE_SCALAR 0
+#define DECODE_SSE4 1
+#define DECODE_AVX2 2
+
+typedef struct _Decoded {
+	size_t length;
+	uint32_t *bits;      /* the whole instruction, in host order */
+	uint8_t *opcode;
+	uint8_t *rs;
+	uint8_t *rt;
+	uint8_t *rd;
+	uint8_t *shamt;
+	uint8_t *funct;
+	int16_t *immediate;
+	uint32_t *target;    /* 26 bit jump field */
+} Decoded;
+
+int format_inst(uint32_t bits, uint32_t addr, char *buf, size_t size);
+int format_decoded(const Decoded *decoded, size_t n, uint32_t addr, char *buf, size_t size);
+
+Decoded *decoded_create(size_t length);
+void decoded_destroy(Decoded *decoded);
+
+int decode_kernel(int kernel);
+const char *decode_kernel_name(int kernel);
+void decode_bulk(const unsigned char *text, size_t n, Decoded *out, int kernel);
+void decode_words(const uint32_t *words, size_t n, Decoded *out, int kernel);
+
+#endif
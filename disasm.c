@@ -2,82 +2,100 @@
  * Niall Kavanagh <niall@kst.com>
  * Compiled and run on OS X
  * Disassemble MIPS instructions
+ *
+ * With no arguments, disassembles a few built in instructions. Given a
+ * file, disassembles its text: a program image's (image.h), or the whole
+ * file as big endian words loaded at the -a base.
  */
 
+#include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <string.h>
 
-void print_inst(uint32_t bits, uint32_t addr) {
-	//printf("Instruction at %x: %x\n", addr, bits);
+#include "decode.h"
+#include "image.h"
+
+/* lines formatted before each write */
+#define DISASM_CHUNK 4096
+
+/**
+ * Disassemble 'n' words, big endian from 'text' or in host order from
+ * 'words', the first at 'addr'
+ */
+static int disassemble(const unsigned char *text, const uint32_t *words, size_t n, uint32_t addr) {
+	Decoded *decoded = decoded_create(n);
+	char *out = malloc(DISASM_CHUNK * INST_TEXT_SIZE);
+	size_t length = 0;
 	
-	unsigned int opcode = (bits & 0xFC000000) >> 26; // 26 - 31
+	if (decoded == NULL || out == NULL) {
+		fprintf(stderr, "[!] Unable to allocate %zu instructions.\n", n);
+		decoded_destroy(decoded);
+		free(out);
+		return 1;
+	}
 	
-	/* for r-type */
-	unsigned int rs = (bits & 0x03E00000) >> 21; // 21 - 25
-	unsigned int rt = (bits & 0x001F0000) >> 16; // 16 - 20
-	unsigned int rd = (bits & 0x0000F800) >> 11; // 11 - 15
-	unsigned int shamt = (bits & 0x000007C0) >> 6; // 6 - 10
-	unsigned int funct = bits & 0x0000003F; // 0 - 5
+	if (text != NULL) {
+		decode_bulk(text, n, decoded, DECODE_BEST);
+	} else {
+		decode_words(words, n, decoded, DECODE_BEST);
+	}
 	
-	/* for i-type */
-	short immediate = bits & 0x0000FFFF; // 0 - 15 
+	for (size_t i=0; i < n; i++) {
+		length += format_decoded(decoded, i, addr, out + length, INST_TEXT_SIZE);
+		addr += sizeof(uint32_t);
+		
+		if ((i + 1) % DISASM_CHUNK == 0 || i + 1 == n) {
+			fwrite(out, 1, length, stdout);
+			length = 0;
+		}
+	}
 	
-	/* jump address is counter + offset shifted left by 2 */
-	unsigned int dest_addr = addr + (immediate << 2);
+	free(out);
+	decoded_destroy(decoded);
+	return 0;
+}
+
+static int disassemble_file(const char *path, uint32_t base) {
+	FILE *file = fopen(path, "rb");
+	char magic[IMAGE_MAGIC_SIZE];
 	
-	/* for j-type (currently unused) */
-	unsigned int address = bits & 0x03FFFFFF; // 0 - 25
+	if (file == NULL) {
+		perror(path);
+		return 1;
+	}
 	
-	switch (opcode) {
-		case 0x0:
+	/* a program image says where its text goes */
+	if (fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, IMAGE_MAGIC, IMAGE_MAGIC_SIZE) == 0) {
+		rewind(file);
+		Image *image = image_read(file);
+		fclose(file);
 		
-		switch (funct) {
-			case 0x20: /* add */
-			printf("%x\tadd $%d,$%d,$%d\n", addr, rd, rs, rt);
-			break;
-			
-			case 0x22: /* sub */
-			printf("%x\tsub $%d,$%d,$%d\n", addr, rd, rs, rt);
-			break;
-			
-			case 0x24: /* and */
-			printf("%x\tand $%d,$%d,$%d\n", addr, rd, rs, rt);
-			break;
-			
-			case 0x25: /* or */
-			printf("%x\tor $%d,$%d,$%d\n", addr, rd, rs, rt);
-			break;
-			
-			case 0x2a: /* slt */
-			printf("%x\tslt $%d,$%d,$%d\n", addr, rd, rs, rt);
-			break;
-			
-			default:
-			printf("%x\tUnknown funct %x for opcode %x (%x)\n", addr,funct, opcode, bits);
-			break;
+		if (image == NULL) {
+			return 1;
 		}
 		
-		break;
-		
-		case 0x23: /* lw */ // TODO
-		printf("%x\tlw $%d,%d($%d)\n", addr, rt, immediate, rs);
-		break;
-		
-		case 0x2b: /* sw */
-		printf("%x\tsw $%d,%d($%d)\n", addr, rt, immediate,rs);
-		break;
-		
-		case 0x4: /* beq */
-		printf("%x\tbeq $%d,$%d, address %x\n", addr, rs, rt, dest_addr);
-		break;
-		
-		case 0x5: /* bne */
-		printf("%x\tbne $%d,$%d, address %x\n", addr, rs, rt, dest_addr);
-		break;
-		
-		default:
-		printf("%x\tUnknown opcode: %x (%x)\n", addr, opcode, bits);
+		int result = disassemble(NULL, image->text, image->text_words, image->text_base);
+		image_destroy(image);
+		return result;
+	}
+	
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	rewind(file);
+	
+	unsigned char *text = malloc(size > 0 ? size : 1);
+	if (text == NULL || fread(text, 1, size, file) != (size_t)size) {
+		fprintf(stderr, "[!] Unable to read %s.\n", path);
+		fclose(file);
+		free(text);
+		return 1;
 	}
+	fclose(file);
+	
+	int result = disassemble(text, NULL, size / sizeof(uint32_t), base);
+	free(text);
+	return result;
 }
 
 /* main */
@@ -93,15 +111,26 @@ int main(int argc, char *argv[]) {
 		0x02A4A825, 
 		0x158FFFF6, 
 		0x8E59FFF0};
-		
+	uint32_t base = 0;
+	int i;
+	
+	for (i=1; i < argc && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+			base = strtoul(argv[++i], NULL, 0);
+		} else {
+			fprintf(stderr, "usage: %s [-a base] [file]\n", argv[0]);
+			return 2;
+		}
+	}
+	
+	if (i < argc) {
+		return disassemble_file(argv[i], base);
+	}
+	
 	size_t s = sizeof(instructions)/sizeof(uint32_t);
 	uint32_t addr = 0x7a060;
 	
 	printf("Disassembling %ld instructions. Base address is %x.\n", s, addr);
-
-	for (int i=0; i < s; i++) {
-		print_inst(instructions[i], addr);
-		addr += sizeof(uint32_t);
-	}
-    return 0;
+	
+	return disassemble(NULL, instructions, s, addr);
 }
@@ -0,0 +1,412 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * DRAM timing backend
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "dram.h"
+
+#define NO_ROW UINT64_MAX
+
+/* completions remembered for complete() on a request already served */
+#define DONE_SLOTS 64
+
+typedef struct _Dram_Request {
+	uint64_t id;
+	uint64_t arrival;
+	uint64_t row;
+	unsigned int bank; /* rank * banks + bank, within the channel */
+	int is_write;
+} Dram_Request;
+
+typedef struct _Dram_Bank {
+	uint64_t open_row;
+	uint64_t ready; /* earliest cycle for its next command */
+	uint64_t requests;
+	uint64_t row_hits;
+} Dram_Bank;
+
+typedef struct _Dram_Channel {
+	Dram_Bank *banks;
+	Dram_Request *queue;
+	unsigned int count;
+	uint64_t clock;    /* next cycle a command can go out */
+	uint64_t bus_free; /* ... and the data bus is free */
+	uint64_t requests;
+	uint64_t row_hits;
+	uint64_t bus_cycles;
+} Dram_Channel;
+
+typedef struct _Dram {
+	Mem_Backend backend;
+	Dram_Config config;
+	
+	unsigned int block_bits;
+	unsigned int column_bits;
+	unsigned int channel_bits;
+	unsigned int bank_bits;
+	unsigned int rank_bits;
+	
+	Dram_Channel *channels;
+	uint64_t next_id;
+	
+	uint64_t done_ids[DONE_SLOTS];
+	uint64_t done_cycles[DONE_SLOTS];
+	
+	/* stats */
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t row_hits;
+	uint64_t row_empty;     /* bank had no row open */
+	uint64_t row_conflicts; /* bank had another row open */
+	uint64_t read_latency;
+	uint64_t first;
+	uint64_t last;
+} Dram;
+
+static int is_power_of_two(unsigned int n) {
+	return n != 0 && (n & (n - 1)) == 0;
+}
+
+static unsigned int log2_of(unsigned int n) {
+	unsigned int bits = 0;
+	
+	while ((1u << bits) < n) {
+		bits++;
+	}
+	
+	return bits;
+}
+
+void dram_default_config(Dram_Config *config) {
+	config->channels = 1;
+	config->ranks = 1;
+	config->banks = 8;
+	config->row_size = 8192;
+	config->block_size = 64;
+	config->queue_size = 32;
+	config->tRCD = 14;
+	config->tRP = 14;
+	config->tCL = 14;
+	config->tBURST = 4;
+	config->page_policy = DRAM_PAGE_OPEN;
+	config->mapping = DRAM_MAP_PAGE;
+}
+
+int dram_policy_from_name(const char *name) {
+	if (strcmp(name, "open") == 0) {
+		return DRAM_PAGE_OPEN;
+	} else if (strcmp(name, "closed") == 0) {
+		return DRAM_PAGE_CLOSED;
+	}
+	
+	return -1;
+}
+
+int dram_mapping_from_name(const char *name) {
+	if (strcmp(name, "page") == 0) {
+		return DRAM_MAP_PAGE;
+	} else if (strcmp(name, "block") == 0) {
+		return DRAM_MAP_BLOCK;
+	}
+	
+	return -1;
+}
+
+/**
+ * Take the next 'bits' bits off the bottom of *address
+ */
+static inline unsigned int take_bits(uint64_t *address, unsigned int bits) {
+	unsigned int field = *address & ((1ull << bits) - 1);
+	
+	*address >>= bits;
+	return field;
+}
+
+static void record_done(Dram *dram, uint64_t id, uint64_t cycle) {
+	dram->done_ids[id % DONE_SLOTS] = id;
+	dram->done_cycles[id % DONE_SLOTS] = cycle;
+}
+
+/**
+ * Serve one request from a channel's queue, first-ready FCFS. Returns the
+ * id of the request served.
+ */
+static uint64_t serve(Dram *dram, Dram_Channel *channel) {
+	const Dram_Config *config = &dram->config;
+	uint64_t t = channel->clock;
+	int best = -1;
+	
+	while (best < 0) {
+		uint64_t next = UINT64_MAX;
+		int best_hit = 0;
+		
+		for (unsigned int n=0; n < channel->count; n++) {
+			const Dram_Request *request = &channel->queue[n];
+			const Dram_Bank *bank = &channel->banks[request->bank];
+			
+			if (request->arrival > t || bank->ready > t) {
+				uint64_t when = (request->arrival > bank->ready) ? request->arrival : bank->ready;
+				if (when < next) {
+					next = when;
+				}
+				continue;
+			}
+			
+			int hit = (bank->open_row == request->row);
+			
+			if (best < 0 || hit > best_hit
+				|| (hit == best_hit && request->id < channel->queue[best].id)) {
+				best = n;
+				best_hit = hit;
+			}
+		}
+		
+		if (best < 0) {
+			t = next; /* nothing can go yet */
+		}
+	}
+	
+	Dram_Request request = channel->queue[best];
+	Dram_Bank *bank = &channel->banks[request.bank];
+	uint64_t latency = config->tCL;
+	
+	channel->queue[best] = channel->queue[--channel->count];
+	
+	if (bank->open_row == request.row) {
+		dram->row_hits++;
+		bank->row_hits++;
+		channel->row_hits++;
+	} else if (bank->open_row == NO_ROW) {
+		latency += config->tRCD;
+		dram->row_empty++;
+	} else {
+		latency += config->tRP + config->tRCD;
+		dram->row_conflicts++;
+	}
+	
+	uint64_t data = t + latency;
+	if (data < channel->bus_free) {
+		data = channel->bus_free;
+	}
+	uint64_t done = data + config->tBURST;
+	
+	channel->bus_free = done;
+	channel->bus_cycles += config->tBURST;
+	channel->clock = t + 1;
+	channel->requests++;
+	bank->requests++;
+	
+	if (config->page_policy == DRAM_PAGE_OPEN) {
+		/* the next hit's data can follow straight on from this burst */
+		bank->open_row = request.row;
+		bank->ready = done - config->tCL;
+	} else {
+		bank->open_row = NO_ROW;
+		bank->ready = done + config->tRP;
+	}
+	
+	if (request.is_write) {
+		dram->writes++;
+	} else {
+		dram->reads++;
+		dram->read_latency += done - request.arrival;
+	}
+	
+	if (done > dram->last) {
+		dram->last = done;
+	}
+	
+	record_done(dram, request.id, done);
+	return request.id;
+}
+
+static uint64_t dram_submit(Mem_Backend *backend, uint64_t cycle, uint64_t address, int is_write) {
+	Dram *dram = (Dram *)backend;
+	uint64_t block = address >> dram->block_bits;
+	unsigned int channel_index, bank, rank;
+	
+	if (dram->config.mapping == DRAM_MAP_PAGE) {
+		take_bits(&block, dram->column_bits);
+		channel_index = take_bits(&block, dram->channel_bits);
+		bank = take_bits(&block, dram->bank_bits);
+		rank = take_bits(&block, dram->rank_bits);
+	} else {
+		channel_index = take_bits(&block, dram->channel_bits);
+		bank = take_bits(&block, dram->bank_bits);
+		rank = take_bits(&block, dram->rank_bits);
+		take_bits(&block, dram->column_bits);
+	}
+	
+	Dram_Channel *channel = &dram->channels[channel_index];
+	
+	if (dram->next_id == 0) {
+		dram->first = cycle;
+	}
+	
+	/* a full queue has to make room, however old the requests in it */
+	while (channel->count == dram->config.queue_size) {
+		serve(dram, channel);
+	}
+	
+	Dram_Request *request = &channel->queue[channel->count++];
+	request->id = dram->next_id++;
+	request->arrival = cycle;
+	request->row = block;
+	request->bank = rank * dram->config.banks + bank;
+	request->is_write = is_write;
+	
+	/* the channel can't go back in time for a request it has moved past */
+	if (request->arrival < channel->clock) {
+		request->arrival = channel->clock;
+	}
+	
+	return request->id;
+}
+
+static uint64_t dram_complete(Mem_Backend *backend, uint64_t id) {
+	Dram *dram = (Dram *)backend;
+	
+	for (unsigned int c=0; c < dram->config.channels; c++) {
+		Dram_Channel *channel = &dram->channels[c];
+		
+		for (unsigned int n=0; n < channel->count; n++) {
+			if (channel->queue[n].id == id) {
+				while (serve(dram, channel) != id) {
+					/* older or ready-first requests go ahead of it */
+				}
+				return dram->done_cycles[id % DONE_SLOTS];
+			}
+		}
+	}
+	
+	/* served already, making room or for another request */
+	return (dram->done_ids[id % DONE_SLOTS] == id) ? dram->done_cycles[id % DONE_SLOTS] : dram->last;
+}
+
+static void dram_drain(Mem_Backend *backend) {
+	Dram *dram = (Dram *)backend;
+	
+	for (unsigned int c=0; c < dram->config.channels; c++) {
+		while (dram->channels[c].count > 0) {
+			serve(dram, &dram->channels[c]);
+		}
+	}
+}
+
+static void dram_print_stats(Mem_Backend *backend) {
+	Dram *dram = (Dram *)backend;
+	const Dram_Config *config = &dram->config;
+	uint64_t requests = dram->reads + dram->writes;
+	uint64_t elapsed = dram->last - dram->first;
+	
+	printf("DRAM: %u channel(s) of %u rank(s) of %u banks, %u byte rows, %s page, %s interleaving\n",
+		config->channels, config->ranks, config->banks, config->row_size,
+		config->page_policy == DRAM_PAGE_OPEN ? "open" : "closed",
+		config->mapping == DRAM_MAP_PAGE ? "page" : "block");
+	printf("tRCD %u, tRP %u, CL %u, burst %u cycles\n",
+		config->tRCD, config->tRP, config->tCL, config->tBURST);
+	
+	printf("Channel\tRequests\tRow hits\tBus busy\n");
+	for (unsigned int c=0; c < config->channels; c++) {
+		const Dram_Channel *channel = &dram->channels[c];
+		
+		printf("%u\t%llu\t%.2f%%\t%.2f%%\n", c,
+			(unsigned long long)channel->requests,
+			channel->requests ? 100.0 * channel->row_hits / channel->requests : 0.0,
+			elapsed ? 100.0 * channel->bus_cycles / elapsed : 0.0);
+	}
+	
+	printf("Reads\tWrites\tRow hits\tEmpty\tConflicts\n");
+	printf("%llu\t%llu\t%llu\t%llu\t%llu\n",
+		(unsigned long long)dram->reads,
+		(unsigned long long)dram->writes,
+		(unsigned long long)dram->row_hits,
+		(unsigned long long)dram->row_empty,
+		(unsigned long long)dram->row_conflicts);
+	
+	printf("Row buffer hit rate %.2f%%, read latency %.2f cycles average\n",
+		requests ? 100.0 * dram->row_hits / requests : 0.0,
+		dram->reads ? (double)dram->read_latency / dram->reads : 0.0);
+	printf("Bandwidth %.3f bytes/cycle over %llu cycles\n",
+		elapsed ? (double)requests * config->block_size / elapsed : 0.0,
+		(unsigned long long)elapsed);
+}
+
+static void dram_destroy(Mem_Backend *backend) {
+	Dram *dram = (Dram *)backend;
+	
+	for (unsigned int c=0; c < dram->config.channels; c++) {
+		free(dram->channels[c].banks);
+		free(dram->channels[c].queue);
+	}
+	
+	free(dram->channels);
+	free(dram);
+}
+
+/**
+ * Returns NULL if a count or size isn't a power of two, or a row is
+ * smaller than a block
+ */
+Mem_Backend *dram_create(const Dram_Config *config) {
+	if (!is_power_of_two(config->channels) || !is_power_of_two(config->ranks)
+		|| !is_power_of_two(config->banks) || !is_power_of_two(config->row_size)
+		|| !is_power_of_two(config->block_size) || config->row_size < config->block_size
+		|| config->queue_size < 1) {
+		return NULL;
+	}
+	
+	Dram *dram = calloc(1, sizeof(Dram));
+	if (dram == NULL) {
+		return NULL;
+	}
+	
+	dram->backend.name = "dram";
+	dram->backend.submit = dram_submit;
+	dram->backend.complete = dram_complete;
+	dram->backend.drain = dram_drain;
+	dram->backend.print_stats = dram_print_stats;
+	dram->backend.destroy = dram_destroy;
+	
+	dram->config = *config;
+	dram->block_bits = log2_of(config->block_size);
+	dram->column_bits = log2_of(config->row_size / config->block_size);
+	dram->channel_bits = log2_of(config->channels);
+	dram->bank_bits = log2_of(config->banks);
+	dram->rank_bits = log2_of(config->ranks);
+	
+	dram->channels = calloc(config->channels, sizeof(Dram_Channel));
+	if (dram->channels == NULL) {
+		free(dram);
+		return NULL;
+	}
+	
+	for (unsigned int c=0; c < config->channels; c++) {
+		Dram_Channel *channel = &dram->channels[c];
+		unsigned int banks = config->ranks * config->banks;
+		
+		channel->banks = calloc(banks, sizeof(Dram_Bank));
+		channel->queue = calloc(config->queue_size, sizeof(Dram_Request));
+		
+		if (channel->banks == NULL || channel->queue == NULL) {
+			dram->config.channels = c + 1;
+			dram_destroy(&dram->backend);
+			return NULL;
+		}
+		
+		for (unsigned int b=0; b < banks; b++) {
+			channel->banks[b].open_row = NO_ROW;
+		}
+	}
+	
+	for (int n=0; n < DONE_SLOTS; n++) {
+		dram->done_ids[n] = UINT64_MAX;
+	}
+	
+	return &dram->backend;
+}
@@ -0,0 +1,58 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * DRAM timing backend
+ *
+ * Channels each have their own command and data bus, and ranks of banks
+ * that each keep one row open in their row buffer. A request to the open
+ * row takes CL cycles to its data, one to a closed bank tRCD + CL, and one
+ * to a bank with another row open tRP + tRCD + CL; its data then takes the
+ * channel's bus for a burst. Under the closed page policy a bank closes its
+ * row after every request instead, so nothing is a row hit but nothing has
+ * to wait for a precharge either.
+ *
+ * Each channel serves its queue first-ready, first-come first-served: of
+ * the requests whose bank can take a command, row hits go first, oldest
+ * first, then the oldest of the rest.
+ *
+ * How addresses spread over channels, ranks and banks is set by the
+ * mapping: page interleaving keeps a whole row's worth of consecutive
+ * blocks in one bank, block interleaving spreads consecutive blocks over
+ * channels then banks.
+ */
+
+#ifndef Dram_h
+#define Dram_h
+
+#include "backend.h"
+
+#define DRAM_PAGE_OPEN 0
+#define DRAM_PAGE_CLOSED 1
+
+#define DRAM_MAP_PAGE 0  /* row:rank:bank:channel:column */
+#define DRAM_MAP_BLOCK 1 /* row:column:rank:bank:channel */
+
+typedef struct _Dram_Config {
+	unsigned int channels;   /* all four counts and sizes powers of two */
+	unsigned int ranks;      /* per channel */
+	unsigned int banks;      /* per rank */
+	unsigned int row_size;   /* bytes in one bank's row */
+	unsigned int block_size; /* bytes per request, the cache block */
+	unsigned int queue_size; /* requests waiting per channel */
+	
+	/* in cycles */
+	unsigned int tRCD; /* activate to column command */
+	unsigned int tRP;  /* precharge */
+	unsigned int tCL;  /* column command to data */
+	unsigned int tBURST;
+	
+	int page_policy;
+	int mapping;
+} Dram_Config;
+
+void dram_default_config(Dram_Config *config);
+Mem_Backend *dram_create(const Dram_Config *config);
+
+int dram_policy_from_name(const char *name);
+int dram_mapping_from_name(const char *name);
+
+#endif
@@ -0,0 +1,143 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * MIPS program images
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "image.h"
+#include "core.h"
+
+static void put_u32(unsigned char *p, uint32_t v) {
+	for (int i=0; i < 4; i++) {
+		p[i] = v >> (8 * i);
+	}
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+	uint32_t v = 0;
+	
+	for (int i=3; i >= 0; i--) {
+		v = (v << 8) | p[i];
+	}
+	
+	return v;
+}
+
+/**
+ * An image with room for 'text_words' instructions and 'data_size' bytes
+ * of data, all zero, laid out at TEXT_BASE and DATA_BASE
+ */
+Image *image_create(size_t text_words, size_t data_size, size_t memory_size) {
+	Image *image = calloc(1, sizeof(Image));
+	
+	if (image == NULL) {
+		return NULL;
+	}
+	
+	image->text = calloc(text_words ? text_words : 1, sizeof(uint32_t));
+	image->data = calloc(data_size ? data_size : 1, 1);
+	
+	if (image->text == NULL || image->data == NULL) {
+		image_destroy(image);
+		return NULL;
+	}
+	
+	image->entry = TEXT_BASE;
+	image->text_base = TEXT_BASE;
+	image->text_words = text_words;
+	image->data_base = DATA_BASE;
+	image->data_size = data_size;
+	image->memory_size = memory_size > data_size ? memory_size : data_size;
+	
+	return image;
+}
+
+void image_destroy(Image *image) {
+	if (image != NULL) {
+		free(image->text);
+		free(image->data);
+		free(image);
+	}
+}
+
+/**
+ * Returns non-zero on a write error
+ */
+int image_write(const Image *image, FILE *file) {
+	unsigned char header[IMAGE_HEADER_SIZE];
+	unsigned char word[4];
+	
+	memcpy(header, IMAGE_MAGIC, IMAGE_MAGIC_SIZE);
+	put_u32(header + 8, image->entry);
+	put_u32(header + 12, image->text_base);
+	put_u32(header + 16, image->text_words);
+	put_u32(header + 20, image->data_base);
+	put_u32(header + 24, image->data_size);
+	put_u32(header + 28, image->memory_size);
+	
+	if (fwrite(header, sizeof(header), 1, file) != 1) {
+		return -1;
+	}
+	
+	for (size_t n=0; n < image->text_words; n++) {
+		for (int i=0; i < 4; i++) {
+			word[i] = image->text[n] >> (24 - 8 * i);
+		}
+		
+		if (fwrite(word, sizeof(word), 1, file) != 1) {
+			return -1;
+		}
+	}
+	
+	if (image->data_size > 0 && fwrite(image->data, image->data_size, 1, file) != 1) {
+		return -1;
+	}
+	
+	return ferror(file);
+}
+
+/**
+ * Returns NULL, having said why, if the file isn't a whole image
+ */
+Image *image_read(FILE *file) {
+	unsigned char header[IMAGE_HEADER_SIZE];
+	unsigned char word[4];
+	
+	if (fread(header, sizeof(header), 1, file) != 1
+		|| memcmp(header, IMAGE_MAGIC, IMAGE_MAGIC_SIZE) != 0) {
+		fprintf(stderr, "[!] Not a program image.\n");
+		return NULL;
+	}
+	
+	Image *image = image_create(get_u32(header + 16), get_u32(header + 24), get_u32(header + 28));
+	
+	if (image == NULL) {
+		fprintf(stderr, "[!] Unable to allocate the image.\n");
+		return NULL;
+	}
+	
+	image->entry = get_u32(header + 8);
+	image->text_base = get_u32(header + 12);
+	image->data_base = get_u32(header + 20);
+	
+	for (size_t n=0; n < image->text_words; n++) {
+		if (fread(word, sizeof(word), 1, file) != 1) {
+			break;
+		}
+		
+		image->text[n] = (uint32_t)word[0] << 24 | word[1] << 16 | word[2] << 8 | word[3];
+	}
+	
+	if (ferror(file) || feof(file)
+		|| (image->data_size > 0 && fread(image->data, image->data_size, 1, file) != 1)) {
+		fprintf(stderr, "[!] Program image is truncated.\n");
+		image_destroy(image);
+		return NULL;
+	}
+	
+	return image;
+}
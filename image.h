@@ -0,0 +1,49 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * MIPS program images: the text and initial data a pipeline runs
+ *
+ * An image file is a header followed by the text and then the data:
+ *
+ *   header  magic (8 bytes), entry, text base, text words, data base,
+ *           data bytes, memory bytes (u32 each, little endian)
+ *   text    instruction words, big endian as MIPS stores them
+ *   data    initial contents of memory from the data base
+ *
+ * Memory bytes is how much memory the program expects from the data base
+ * up, data and stack included; the stack pointer starts at its top.
+ */
+
+#ifndef Image_h
+#define Image_h
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define IMAGE_MAGIC "\x89MIMAGE\n"
+#define IMAGE_MAGIC_SIZE 8
+#define IMAGE_HEADER_SIZE (IMAGE_MAGIC_SIZE + 6 * 4)
+
+#define DATA_BASE 0x10000000 /* where the data of an image usually starts */
+
+/* room at the top of an image's memory for the stack */
+#define STACK_SIZE 65536
+
+typedef struct _Image {
+	uint32_t entry;     /* pc of the first instruction run */
+	uint32_t text_base; /* pc of text[0] */
+	uint32_t *text;
+	size_t text_words;
+	uint32_t data_base; /* address of data[0] */
+	uint8_t *data;
+	size_t data_size;
+	size_t memory_size; /* bytes from data_base, at least data_size */
+} Image;
+
+Image *image_create(size_t text_words, size_t data_size, size_t memory_size);
+void image_destroy(Image *image);
+
+int image_write(const Image *image, FILE *file);
+Image *image_read(FILE *file);
+
+#endif
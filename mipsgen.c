@@ -0,0 +1,634 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Synthetic MIPS workloads: program images for the pipeline and matching
+ * address traces for cachesim
+ *
+ * Each kernel is a loop written out as machine code, over data laid out
+ * from DATA_BASE:
+ *
+ *   memset   store zero over the working set a word at a time
+ *   memcpy   copy the first half of the working set to the second half
+ *   stride   sum the words 'stride' bytes apart
+ *   chase    follow pointers around a random cycle of 'stride' byte nodes
+ *   matmul   C += A x B over square matrices in 'tile' square blocks
+ *   hash     look keys up in an open addressed table, half of them there
+ *
+ * and the whole kernel repeats. The trace is what the pipeline fetches,
+ * loads and stores running the image, so the two always match.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "core.h"
+#include "image.h"
+
+/* no kernel is longer */
+#define MAX_TEXT 256
+
+/* the opcodes and functs the kernels use */
+#define OP_J 0x02
+#define OP_BEQ 0x04
+#define OP_BNE 0x05
+#define OP_ADDIU 0x09
+#define OP_ORI 0x0d
+#define OP_LUI 0x0f
+#define OP_LW 0x23
+#define OP_SW 0x2b
+
+#define FN_SLL 0x00
+#define FN_SRL 0x02
+#define FN_MFLO 0x12
+#define FN_MULT 0x18
+#define FN_ADDU 0x21
+#define FN_AND 0x24
+#define FN_XOR 0x26
+#define FN_SLTU 0x2b
+
+/* registers by their assembler names */
+#define ZERO 0
+#define V0 2
+#define V1 3
+#define A0 4
+#define A1 5
+#define A2 6
+#define T0 8
+#define T1 9
+#define T2 10
+#define T3 11
+#define T4 12
+#define T5 13
+#define T6 14
+#define T7 15
+#define S0 16
+#define S1 17
+#define S2 18
+#define S3 19
+#define S4 20
+#define S5 21
+#define S6 22
+#define S7 23
+#define T8 24
+#define FP 30 /* kept for the repeat count */
+
+typedef struct _Gen_Config {
+	size_t size;     /* working set in bytes */
+	size_t stride;   /* bytes between accesses, or the size of a node */
+	size_t tile;     /* matrix block size in elements */
+	size_t repeats;
+	uint32_t seed;
+} Gen_Config;
+
+/* a kernel's text as it is written; branches are by instruction index */
+typedef struct _Asm {
+	uint32_t text[MAX_TEXT];
+	size_t length;
+} Asm;
+
+typedef struct _Kernel {
+	const char *name;
+	size_t (*data_size)(const Gen_Config *config);
+	void (*build)(Asm *as, uint8_t *data, const Gen_Config *config);
+} Kernel;
+
+static uint32_t random_state;
+
+/* xorshift, so the same seed makes the same image everywhere */
+static uint32_t next_random() {
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+	return random_state;
+}
+
+static void put_word(uint8_t *data, size_t offset, uint32_t value) {
+	for (int i=0; i < 4; i++) {
+		data[offset + i] = value >> (24 - 8 * i);
+	}
+}
+
+static uint32_t get_word(const uint8_t *data, size_t offset) {
+	return (uint32_t)data[offset] << 24 | data[offset + 1] << 16 | data[offset + 2] << 8 | data[offset + 3];
+}
+
+static size_t here(const Asm *as) {
+	return as->length;
+}
+
+static void emit(Asm *as, uint32_t instr) {
+	if (as->length < MAX_TEXT) {
+		as->text[as->length] = instr;
+	}
+	as->length++;
+}
+
+static void r_type(Asm *as, unsigned int funct, unsigned int rd, unsigned int rs, unsigned int rt) {
+	emit(as, rs << 21 | rt << 16 | rd << 11 | funct);
+}
+
+static void shift(Asm *as, unsigned int funct, unsigned int rd, unsigned int rt, unsigned int shamt) {
+	emit(as, rt << 16 | rd << 11 | shamt << 6 | funct);
+}
+
+static void i_type(Asm *as, unsigned int opcode, unsigned int rt, unsigned int rs, uint16_t immediate) {
+	emit(as, opcode << 26 | rs << 21 | rt << 16 | immediate);
+}
+
+static void nop(Asm *as) {
+	emit(as, NOOP);
+}
+
+static void move(Asm *as, unsigned int rd, unsigned int rs) {
+	r_type(as, FN_ADDU, rd, rs, ZERO);
+}
+
+/* load a 32 bit constant in one instruction or two */
+static void li(Asm *as, unsigned int rt, uint32_t value) {
+	if (value <= 0xFFFF) {
+		i_type(as, OP_ORI, rt, ZERO, value);
+		return;
+	}
+	
+	i_type(as, OP_LUI, rt, ZERO, value >> 16);
+	if (value & 0xFFFF) {
+		i_type(as, OP_ORI, rt, rt, value & 0xFFFF);
+	}
+}
+
+/* beq or bne to instruction 'target'; a forward one is patched later */
+static void branch(Asm *as, unsigned int opcode, unsigned int rs, unsigned int rt, size_t target) {
+	i_type(as, opcode, rt, rs, (uint16_t)(target - (here(as) + 1)));
+}
+
+static void jump(Asm *as, size_t target) {
+	emit(as, OP_J << 26 | (((TEXT_BASE + target * 4) >> 2) & 0x03FFFFFF));
+}
+
+/* point the branch or jump at 'at' to instruction 'target' */
+static void patch(Asm *as, size_t at, size_t target) {
+	uint32_t instr = as->text[at];
+	
+	if (get_opcode(instr) == OP_J) {
+		as->text[at] = OP_J << 26 | (((TEXT_BASE + target * 4) >> 2) & 0x03FFFFFF);
+	} else {
+		as->text[at] = (instr & 0xFFFF0000) | (uint16_t)(target - (at + 1));
+	}
+}
+
+/* memset */
+static size_t memset_size(const Gen_Config *config) {
+	return config->size;
+}
+
+static void build_memset(Asm *as, uint8_t *data, const Gen_Config *config) {
+	(void)data;
+	
+	li(as, T0, DATA_BASE);
+	li(as, T1, DATA_BASE + config->size - 4);
+	
+	size_t loop = here(as);
+	i_type(as, OP_SW, ZERO, T0, 0);
+	branch(as, OP_BNE, T0, T1, loop);
+	i_type(as, OP_ADDIU, T0, T0, 4);
+}
+
+/* memcpy */
+static size_t memcpy_size(const Gen_Config *config) {
+	return config->size;
+}
+
+static void build_memcpy(Asm *as, uint8_t *data, const Gen_Config *config) {
+	size_t half = config->size / 2 & ~(size_t)3;
+	
+	for (size_t n=0; n < half; n += 4) {
+		put_word(data, n, next_random());
+	}
+	
+	li(as, T0, DATA_BASE);
+	li(as, T1, DATA_BASE + half);
+	li(as, T2, DATA_BASE + half - 4);
+	
+	size_t loop = here(as);
+	i_type(as, OP_LW, T3, T0, 0);
+	i_type(as, OP_SW, T3, T1, 0);
+	i_type(as, OP_ADDIU, T1, T1, 4);
+	branch(as, OP_BNE, T0, T2, loop);
+	i_type(as, OP_ADDIU, T0, T0, 4);
+}
+
+/* stride */
+static size_t stride_size(const Gen_Config *config) {
+	return config->size;
+}
+
+static void build_stride(Asm *as, uint8_t *data, const Gen_Config *config) {
+	for (size_t n=0; n < config->size; n += 4) {
+		put_word(data, n, next_random() & 0xFFFF);
+	}
+	
+	li(as, T0, DATA_BASE);
+	li(as, T1, DATA_BASE + config->size);
+	li(as, T4, config->stride);
+	
+	size_t loop = here(as);
+	i_type(as, OP_LW, T3, T0, 0);
+	r_type(as, FN_ADDU, T0, T0, T4);
+	r_type(as, FN_SLTU, T5, T0, T1);
+	branch(as, OP_BNE, T5, ZERO, loop);
+	r_type(as, FN_ADDU, S0, S0, T3);
+}
+
+/* chase */
+static size_t chase_size(const Gen_Config *config) {
+	return config->size / config->stride * config->stride;
+}
+
+static void build_chase(Asm *as, uint8_t *data, const Gen_Config *config) {
+	size_t nodes = config->size / config->stride;
+	size_t *next = malloc(sizeof(size_t) * nodes);
+	
+	/* Sattolo's shuffle: one cycle through every node */
+	for (size_t n=0; n < nodes; n++) {
+		next[n] = n;
+	}
+	
+	for (size_t n=nodes - 1; n > 0; n--) {
+		size_t k = next_random() % n;
+		size_t swap = next[n];
+		
+		next[n] = next[k];
+		next[k] = swap;
+	}
+	
+	for (size_t n=0; n < nodes; n++) {
+		put_word(data, n * config->stride, DATA_BASE + next[n] * config->stride);
+	}
+	free(next);
+	
+	li(as, T0, DATA_BASE);
+	li(as, T1, nodes);
+	
+	size_t loop = here(as);
+	i_type(as, OP_LW, T0, T0, 0);
+	i_type(as, OP_ADDIU, T1, T1, (uint16_t)-1);
+	branch(as, OP_BNE, T1, ZERO, loop);
+	nop(as);
+}
+
+/* matmul */
+static size_t matrix_order(const Gen_Config *config) {
+	size_t order = config->tile;
+	
+	while (3 * (order + config->tile) * (order + config->tile) * 4 <= config->size) {
+		order += config->tile;
+	}
+	
+	return order;
+}
+
+static size_t matmul_size(const Gen_Config *config) {
+	size_t order = matrix_order(config);
+	return 3 * order * order * 4;
+}
+
+static void build_matmul(Asm *as, uint8_t *data, const Gen_Config *config) {
+	size_t order = matrix_order(config);
+	size_t matrix = order * order * 4;
+	uint32_t row = order * 4;
+	uint32_t tile_cols = config->tile * 4;
+	uint32_t tile_rows = config->tile * row;
+	
+	/* A and B, C starts at zero */
+	for (size_t n=0; n < 2 * matrix; n += 4) {
+		put_word(data, n, next_random() & 0xFF);
+	}
+	
+	/* everything is a byte offset: rows step by 'row', columns by 4 */
+	li(as, A0, DATA_BASE);
+	li(as, A1, DATA_BASE + matrix);
+	li(as, A2, DATA_BASE + 2 * matrix);
+	li(as, S4, row);
+	li(as, S5, order * row);
+	li(as, S6, tile_cols);
+	li(as, S7, tile_rows);
+	move(as, S0, ZERO);
+	
+	size_t ii = here(as);
+	move(as, S1, ZERO);
+	
+	size_t jj = here(as);
+	move(as, S2, ZERO); /* kk as a column of A */
+	move(as, S3, ZERO); /* kk as a row of B */
+	
+	size_t kk = here(as);
+	move(as, T0, S0);
+	r_type(as, FN_ADDU, T8, S0, S7);
+	
+	size_t i = here(as);
+	move(as, T1, S1);
+	r_type(as, FN_ADDU, T7, S1, S6);
+	
+	size_t j = here(as);
+	r_type(as, FN_ADDU, T2, A2, T0);
+	r_type(as, FN_ADDU, T2, T2, T1);  /* &C[i][j] */
+	i_type(as, OP_LW, T4, T2, 0);
+	r_type(as, FN_ADDU, T5, A0, T0);
+	r_type(as, FN_ADDU, T5, T5, S2);  /* &A[i][kk] */
+	r_type(as, FN_ADDU, T6, A1, S3);
+	r_type(as, FN_ADDU, T6, T6, T1);  /* &B[kk][j] */
+	r_type(as, FN_ADDU, T3, T5, S6);
+	
+	size_t k = here(as);
+	i_type(as, OP_LW, V0, T5, 0);
+	i_type(as, OP_LW, V1, T6, 0);
+	i_type(as, OP_ADDIU, T5, T5, 4);
+	r_type(as, FN_MULT, ZERO, V0, V1);
+	r_type(as, FN_MFLO, V0, ZERO, ZERO);
+	r_type(as, FN_ADDU, T4, T4, V0);
+	branch(as, OP_BNE, T5, T3, k);
+	r_type(as, FN_ADDU, T6, T6, S4);
+	
+	i_type(as, OP_SW, T4, T2, 0);
+	i_type(as, OP_ADDIU, T1, T1, 4);
+	branch(as, OP_BNE, T1, T7, j);
+	nop(as);
+	
+	r_type(as, FN_ADDU, T0, T0, S4);
+	branch(as, OP_BNE, T0, T8, i);
+	nop(as);
+	
+	r_type(as, FN_ADDU, S2, S2, S6);
+	r_type(as, FN_ADDU, S3, S3, S7);
+	branch(as, OP_BNE, S2, S4, kk);
+	nop(as);
+	
+	r_type(as, FN_ADDU, S1, S1, S6);
+	branch(as, OP_BNE, S1, S4, jj);
+	nop(as);
+	
+	r_type(as, FN_ADDU, S0, S0, S7);
+	branch(as, OP_BNE, S0, S5, ii);
+	nop(as);
+}
+
+/* hash */
+static size_t hash_buckets(const Gen_Config *config) {
+	size_t buckets = 2;
+	
+	while (buckets * 2 * 6 <= config->size) {
+		buckets *= 2;
+	}
+	
+	return buckets;
+}
+
+static size_t hash_size(const Gen_Config *config) {
+	return hash_buckets(config) * 6; /* the table and half as many keys */
+}
+
+/* the same hash the kernel computes */
+static size_t hash_of(uint32_t key, size_t buckets) {
+	return (key ^ (key >> 7)) & (buckets - 1);
+}
+
+/* the bucket holding 'key', or the empty one it would go in */
+static size_t hash_find(const uint8_t *table, size_t buckets, uint32_t key) {
+	size_t h = hash_of(key, buckets);
+	
+	while (get_word(table, h * 4) != 0 && get_word(table, h * 4) != key) {
+		h = (h + 1) & (buckets - 1);
+	}
+	
+	return h;
+}
+
+static void build_hash(Asm *as, uint8_t *data, const Gen_Config *config) {
+	size_t buckets = hash_buckets(config);
+	size_t num_keys = buckets / 2;
+	uint8_t *keys = data + buckets * 4;
+	
+	/* fill the table half full, with every other key looked up */
+	for (size_t n=0; n < num_keys; n++) {
+		uint32_t key;
+		size_t h;
+		
+		do {
+			key = next_random();
+			h = hash_find(data, buckets, key);
+		} while (key == 0 || get_word(data, h * 4) == key);
+		
+		if (n % 2 == 0) {
+			put_word(data, h * 4, key);
+		}
+		put_word(keys, n * 4, key);
+	}
+	
+	li(as, A0, DATA_BASE);
+	li(as, A1, DATA_BASE + buckets * 4);
+	li(as, A2, DATA_BASE + buckets * 4 + num_keys * 4);
+	li(as, S0, (buckets - 1) << 2);
+	move(as, T0, A1);
+	
+	size_t key = here(as);
+	i_type(as, OP_LW, T1, T0, 0);
+	shift(as, FN_SRL, T2, T1, 7);
+	r_type(as, FN_XOR, T2, T2, T1);
+	shift(as, FN_SLL, T2, T2, 2);
+	r_type(as, FN_AND, T2, T2, S0);
+	
+	size_t probe = here(as);
+	r_type(as, FN_ADDU, T3, A0, T2);
+	i_type(as, OP_LW, T4, T3, 0);
+	size_t to_hit = here(as);
+	branch(as, OP_BEQ, T4, T1, 0);
+	nop(as);
+	size_t to_miss = here(as);
+	branch(as, OP_BEQ, T4, ZERO, 0);
+	i_type(as, OP_ADDIU, T2, T2, 4);
+	jump(as, probe);
+	r_type(as, FN_AND, T2, T2, S0);
+	
+	patch(as, to_hit, here(as));
+	size_t to_next = here(as);
+	jump(as, 0);
+	i_type(as, OP_ADDIU, S1, S1, 1);  /* hits */
+	
+	patch(as, to_miss, here(as));
+	i_type(as, OP_ADDIU, S2, S2, 1);  /* misses */
+	
+	patch(as, to_next, here(as));
+	i_type(as, OP_ADDIU, T0, T0, 4);
+	branch(as, OP_BNE, T0, A2, key);
+	nop(as);
+}
+
+static const Kernel kernels[] = {
+	{ "memset", memset_size, build_memset },
+	{ "memcpy", memcpy_size, build_memcpy },
+	{ "stride", stride_size, build_stride },
+	{ "chase", chase_size, build_chase },
+	{ "matmul", matmul_size, build_matmul },
+	{ "hash", hash_size, build_hash }
+};
+
+#define NUM_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+static const Kernel *kernel_from_name(const char *name) {
+	for (size_t n=0; n < NUM_KERNELS; n++) {
+		if (strcmp(kernels[n].name, name) == 0) {
+			return &kernels[n];
+		}
+	}
+	
+	return NULL;
+}
+
+/**
+ * The kernel inside a loop that runs it config->repeats times, then nops
+ * to drain the pipeline before the program runs off the end of its text
+ */
+static Image *generate(const Kernel *kernel, const Gen_Config *config) {
+	size_t data_size = kernel->data_size(config);
+	Image *image = image_create(MAX_TEXT, data_size, data_size + STACK_SIZE);
+	Asm as;
+	
+	if (image == NULL) {
+		return NULL;
+	}
+	
+	as.length = 0;
+	random_state = config->seed ? config->seed : 1;
+	
+	li(&as, FP, config->repeats);
+	size_t repeat = here(&as);
+	kernel->build(&as, image->data, config);
+	i_type(&as, OP_ADDIU, FP, FP, (uint16_t)-1);
+	branch(&as, OP_BNE, FP, ZERO, repeat);
+	nop(&as);
+	
+	for (int n=0; n < 4; n++) {
+		nop(&as);
+	}
+	
+	if (as.length > MAX_TEXT) {
+		fprintf(stderr, "[!] The %s kernel is longer than %d instructions.\n", kernel->name, MAX_TEXT);
+		image_destroy(image);
+		return NULL;
+	}
+	
+	memcpy(image->text, as.text, as.length * sizeof(uint32_t));
+	image->text_words = as.length;
+	
+	return image;
+}
+
+/**
+ * Run the image through the pipeline, recording what it fetches, loads
+ * and stores; returns the cycles taken, or 0 on an error
+ */
+static uint64_t write_trace(const Image *image, const char *path) {
+	FILE *file = fopen(path, "wb");
+	Core *core = core_create_image(image);
+	uint64_t cycles = 0;
+	
+	if (file == NULL || core == NULL || (core->trace = trace_writer_open(file)) == NULL) {
+		perror(path);
+	} else {
+		cycles = core_run(core);
+		
+		if (trace_writer_close(core->trace) != 0) {
+			perror(path);
+			cycles = 0;
+		}
+	}
+	
+	if (file != NULL && fclose(file) != 0) {
+		perror(path);
+		cycles = 0;
+	}
+	
+	core_destroy(core);
+	return cycles;
+}
+
+static void usage(const char *program) {
+	fprintf(stderr, "usage: %s -k kernel -o image [-t trace] [-n bytes] [-s stride] [-b tile] [-r repeats] [-S seed]\n", program);
+	fprintf(stderr, "kernels:");
+	
+	for (size_t n=0; n < NUM_KERNELS; n++) {
+		fprintf(stderr, " %s", kernels[n].name);
+	}
+	fprintf(stderr, "\n");
+}
+
+/* main */
+int main(int argc, char *argv[]) {
+	const Kernel *kernel = NULL;
+	const char *image_path = NULL;
+	const char *trace_path = NULL;
+	Gen_Config config = { 65536, 64, 8, 1, 1 };
+	
+	for (int i=1; i < argc; i++) {
+		if (strcmp(argv[i], "-k") == 0 && i + 1 < argc && (kernel = kernel_from_name(argv[++i])) != NULL) {
+			continue;
+		} else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+			image_path = argv[++i];
+		} else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+			trace_path = argv[++i];
+		} else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			config.size = strtoul(argv[++i], NULL, 0) & ~(size_t)3;
+		} else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+			config.stride = strtoul(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+			config.tile = strtoul(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+			config.repeats = strtoul(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+			config.seed = strtoul(argv[++i], NULL, 0);
+		} else {
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	
+	if (kernel == NULL || image_path == NULL) {
+		usage(argv[0]);
+		return 2;
+	}
+	
+	if (config.stride < 4 || config.stride % 4 != 0 || config.size < 2 * config.stride
+		|| config.tile < 1 || config.repeats < 1 || config.size > 0x40000000) {
+		fprintf(stderr, "[!] Strides are a multiple of 4, working sets two strides to 1G.\n");
+		return 2;
+	}
+	
+	Image *image = generate(kernel, &config);
+	if (image == NULL) {
+		return 1;
+	}
+	
+	FILE *file = fopen(image_path, "wb");
+	if (file == NULL || image_write(image, file) != 0 || fclose(file) != 0) {
+		perror(image_path);
+		return 1;
+	}
+	
+	printf("Kernel\tInstructions\tData\tCycles\n");
+	printf("%s\t%zu\t%zu\t", kernel->name, image->text_words, image->data_size);
+	
+	if (trace_path != NULL) {
+		uint64_t cycles = write_trace(image, trace_path);
+		
+		if (cycles == 0) {
+			return 1;
+		}
+		printf("%llu\n", (unsigned long long)cycles);
+	} else {
+		printf("-\n");
+	}
+	
+	image_destroy(image);
+	return 0;
+}
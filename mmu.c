@@ -0,0 +1,332 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Virtual memory: page tables and TLBs in front of a cache
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include "mmu.h"
+
+#define PT_LEVELS 4
+#define PT_ENTRIES 512
+#define PT_ENTRY_SIZE 8
+
+/* physical memory below this is never handed out, so no frame is 0 */
+#define FIRST_FRAME 0x1000
+
+struct _Pt_Node {
+	uint64_t frame; /* where the node itself lives */
+	union {
+		Pt_Node *child;
+		uint64_t page; /* at the leaf level: the page's frame, 0 if unmapped */
+	} entries[PT_ENTRIES];
+};
+
+void mmu_default_config(Mmu_Config *config) {
+	config->l1i = (Tlb_Config){ 64, 4, 0 };
+	config->l1d = (Tlb_Config){ 64, 4, 0 };
+	config->l2 = (Tlb_Config){ 1024, 8, 7 };
+	config->page_bits = PAGE_4K;
+	config->walk_latency = 20;
+}
+
+/**
+ * 4k or 2m as page_bits; -1 for anything else
+ */
+int mmu_page_bits_from_name(const char *name) {
+	if (strcasecmp(name, "4k") == 0) {
+		return PAGE_4K;
+	} else if (strcasecmp(name, "2m") == 0) {
+		return PAGE_2M;
+	}
+	
+	return -1;
+}
+
+static int is_power_of_two(unsigned int n) {
+	return n != 0 && (n & (n - 1)) == 0;
+}
+
+static int tlb_init(Tlb *tlb, const char *name, const Tlb_Config *config) {
+	if (config->ways == 0 || config->entries % config->ways != 0
+		|| !is_power_of_two(config->entries / config->ways)) {
+		return -1;
+	}
+	
+	tlb->name = name;
+	tlb->config = *config;
+	tlb->num_sets = config->entries / config->ways;
+	tlb->entries = calloc(config->entries, sizeof(Tlb_Entry));
+	
+	return (tlb->entries != NULL) ? 0 : -1;
+}
+
+static Tlb_Entry *tlb_lookup(Tlb *tlb, unsigned int asid, uint64_t vpn, unsigned int page_bits) {
+	Tlb_Entry *set = &tlb->entries[(vpn & (tlb->num_sets - 1)) * tlb->config.ways];
+	
+	for (unsigned int way=0; way < tlb->config.ways; way++) {
+		Tlb_Entry *entry = &set[way];
+		
+		if (entry->valid && entry->vpn == vpn && entry->asid == asid && entry->page_bits == page_bits) {
+			entry->lru = ++tlb->clock;
+			tlb->hits++;
+			return entry;
+		}
+	}
+	
+	tlb->misses++;
+	return NULL;
+}
+
+/**
+ * Replace the least recently used entry of the set
+ */
+static Tlb_Entry *tlb_fill(Tlb *tlb, unsigned int asid, uint64_t vpn, unsigned int page_bits, uint64_t frame) {
+	Tlb_Entry *set = &tlb->entries[(vpn & (tlb->num_sets - 1)) * tlb->config.ways];
+	Tlb_Entry *victim = &set[0];
+	
+	for (unsigned int way=0; way < tlb->config.ways; way++) {
+		if (!set[way].valid) {
+			victim = &set[way];
+			break;
+		}
+		
+		if (set[way].lru < victim->lru) {
+			victim = &set[way];
+		}
+	}
+	
+	victim->vpn = vpn;
+	victim->frame = frame;
+	victim->asid = asid;
+	victim->page_bits = page_bits;
+	victim->valid = 1;
+	victim->lru = ++tlb->clock;
+	
+	return victim;
+}
+
+/**
+ * Hand out 'size' bytes of physical memory, aligned to 'size'
+ */
+static uint64_t alloc_frame(Mmu *mmu, uint64_t size) {
+	uint64_t frame = (mmu->next_frame + size - 1) & ~(size - 1);
+	
+	mmu->next_frame = frame + size;
+	return frame;
+}
+
+static Pt_Node *new_node(Mmu *mmu) {
+	Pt_Node *node = calloc(1, sizeof(Pt_Node));
+	
+	if (node == NULL) {
+		fprintf(stderr, "[!] Out of memory for page tables.\n");
+		exit(1);
+	}
+	
+	node->frame = alloc_frame(mmu, PT_ENTRIES * PT_ENTRY_SIZE);
+	return node;
+}
+
+static void free_node(Pt_Node *node, int level, int leaf) {
+	if (node == NULL) {
+		return;
+	}
+	
+	if (level > leaf) {
+		for (int n=0; n < PT_ENTRIES; n++) {
+			free_node(node->entries[n].child, level - 1, leaf);
+		}
+	}
+	
+	free(node);
+}
+
+/**
+ * Read one page table entry through the cache; returns when it arrives
+ */
+static uint64_t walk_read(Mmu *mmu, uint64_t address, uint64_t cycle) {
+	mmu->walk_reads++;
+	
+	if (mmu->timing != NULL) {
+		Cache_Op op = { .address = address, .cycle = cycle };
+		return mshr_access(mmu->timing, cycle, &op);
+	}
+	
+	int is_cache_hit;
+	cache_read(mmu->cache, address, &is_cache_hit);
+	
+	return cycle + mmu->config.walk_latency;
+}
+
+/**
+ * Walk the page table from the root to the page, mapping the page on its
+ * first touch. Returns the cycle the walk finishes.
+ */
+static uint64_t walk(Mmu *mmu, Mmu_Space *space, uint64_t address, uint64_t cycle, uint64_t *frame) {
+	int leaf = (space->page_bits == PAGE_2M) ? 1 : 0;
+	
+	if (space->root == NULL) {
+		space->root = new_node(mmu);
+	}
+	
+	Pt_Node *node = space->root;
+	mmu->walks++;
+	
+	for (int level = PT_LEVELS - 1; level >= leaf; level--) {
+		unsigned int index = (address >> (PAGE_4K + 9 * level)) & (PT_ENTRIES - 1);
+		
+		cycle = walk_read(mmu, node->frame + index * PT_ENTRY_SIZE, cycle);
+		
+		if (level == leaf) {
+			if (node->entries[index].page == 0) {
+				node->entries[index].page = alloc_frame(mmu, 1ull << space->page_bits);
+				space->pages++;
+				mmu->faults++;
+			}
+			*frame = node->entries[index].page;
+		} else {
+			if (node->entries[index].child == NULL) {
+				node->entries[index].child = new_node(mmu);
+			}
+			node = node->entries[index].child;
+		}
+	}
+	
+	return cycle;
+}
+
+/**
+ * Returns NULL if a TLB's sets aren't a power of two
+ */
+Mmu *mmu_create(const Mmu_Config *config, Cache *cache) {
+	Mmu *mmu = calloc(1, sizeof(Mmu));
+	
+	if (mmu == NULL) {
+		return NULL;
+	}
+	
+	mmu->config = *config;
+	mmu->cache = cache;
+	mmu->next_frame = FIRST_FRAME;
+	
+	if (tlb_init(&mmu->l1i, "L1 I", &config->l1i) < 0
+		|| tlb_init(&mmu->l1d, "L1 D", &config->l1d) < 0
+		|| tlb_init(&mmu->l2, "L2", &config->l2) < 0
+		|| (config->page_bits != PAGE_4K && config->page_bits != PAGE_2M)) {
+		mmu_destroy(mmu);
+		return NULL;
+	}
+	
+	return mmu;
+}
+
+void mmu_destroy(Mmu *mmu) {
+	if (mmu == NULL) {
+		return;
+	}
+	
+	for (int n=0; n < MMU_ASIDS; n++) {
+		free_node(mmu->spaces[n].root, PT_LEVELS - 1, (mmu->spaces[n].page_bits == PAGE_2M) ? 1 : 0);
+	}
+	
+	free(mmu->l1i.entries);
+	free(mmu->l1d.entries);
+	free(mmu->l2.entries);
+	free(mmu);
+}
+
+/**
+ * Choose 4K or 2M pages for an address space. Only before it maps anything.
+ */
+int mmu_set_page_size(Mmu *mmu, unsigned int asid, unsigned int page_bits) {
+	Mmu_Space *space = &mmu->spaces[asid % MMU_ASIDS];
+	
+	if (space->root != NULL || (page_bits != PAGE_4K && page_bits != PAGE_2M)) {
+		return -1;
+	}
+	
+	space->page_bits = page_bits;
+	return 0;
+}
+
+/**
+ * Translate a virtual address of an address space starting at 'cycle'.
+ * Stores the physical address and returns the cycle it is known.
+ */
+uint64_t mmu_translate(Mmu *mmu, unsigned int asid, uint64_t address, int is_fetch, uint64_t cycle, uint64_t *physical) {
+	Mmu_Space *space = &mmu->spaces[asid % MMU_ASIDS];
+	
+	if (space->page_bits == 0) {
+		space->page_bits = mmu->config.page_bits;
+	}
+	
+	unsigned int page_bits = space->page_bits;
+	uint64_t vpn = address >> page_bits;
+	Tlb *l1 = is_fetch ? &mmu->l1i : &mmu->l1d;
+	
+	cycle += l1->config.latency;
+	Tlb_Entry *entry = tlb_lookup(l1, asid, vpn, page_bits);
+	
+	if (entry == NULL) {
+		cycle += mmu->l2.config.latency;
+		entry = tlb_lookup(&mmu->l2, asid, vpn, page_bits);
+		
+		if (entry == NULL) {
+			uint64_t start = cycle;
+			uint64_t frame = 0;
+			
+			cycle = walk(mmu, space, address, cycle, &frame);
+			mmu->walk_cycles += cycle - start;
+			entry = tlb_fill(&mmu->l2, asid, vpn, page_bits, frame);
+		}
+		
+		entry = tlb_fill(l1, asid, vpn, page_bits, entry->frame);
+	}
+	
+	*physical = entry->frame | (address & ((1ull << page_bits) - 1));
+	return cycle;
+}
+
+static void print_tlb(const Tlb *tlb, unsigned int page_bits) {
+	uint64_t lookups = tlb->hits + tlb->misses;
+	
+	printf("%s\t%u\t%u\t%llu\t%llu\t%.2f%%\t%lluK\n", tlb->name,
+		tlb->config.entries, tlb->config.ways,
+		(unsigned long long)tlb->hits,
+		(unsigned long long)tlb->misses,
+		lookups ? 100.0 * tlb->hits / lookups : 0.0,
+		(unsigned long long)(((uint64_t)tlb->config.entries << page_bits) >> 10));
+}
+
+void print_mmu_stats(const Mmu *mmu) {
+	unsigned int page_bits = mmu->config.page_bits;
+	uint64_t pages = 0;
+	int spaces = 0;
+	
+	for (int n=0; n < MMU_ASIDS; n++) {
+		if (mmu->spaces[n].root != NULL) {
+			pages += mmu->spaces[n].pages;
+			spaces++;
+		}
+	}
+	
+	printf("TLB\tEntries\tWays\tHits\tMisses\tHit rate\tReach\n");
+	print_tlb(&mmu->l1i, page_bits);
+	print_tlb(&mmu->l1d, page_bits);
+	print_tlb(&mmu->l2, page_bits);
+	
+	printf("%llu page walks, %llu page table reads, %.2f cycles a walk\n",
+		(unsigned long long)mmu->walks,
+		(unsigned long long)mmu->walk_reads,
+		mmu->walks ? (double)mmu->walk_cycles / mmu->walks : 0.0);
+	printf("%llu %s pages in %d address space(s), %lluK of physical memory\n",
+		(unsigned long long)pages,
+		page_bits == PAGE_2M ? "2M" : "4K",
+		spaces,
+		(unsigned long long)((mmu->next_frame - FIRST_FRAME) >> 10));
+}
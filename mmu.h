@@ -0,0 +1,100 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Virtual memory: page tables and TLBs in front of a cache
+ *
+ * Each address space (ASID) has its own four level radix page table over a
+ * 48 bit virtual address space, with 4K pages, or 2M pages mapped one level
+ * up. Pages and table nodes are given physical frames the first time they
+ * are touched, so any virtual address can be used.
+ *
+ * Translation looks in the L1 TLB for the access (instructions or data),
+ * then the unified L2 TLB, then walks the page table. The walk reads one
+ * entry per level through the cache, so walks compete with the program for
+ * cache space; with an Mshr_File attached each read takes the time the
+ * timed cache gives it, otherwise walk_latency cycles.
+ */
+
+#ifndef Mmu_h
+#define Mmu_h
+
+#include <stdint.h>
+
+#include "cache.h"
+#include "mshr.h"
+
+#define MMU_ASIDS 256
+
+#define PAGE_4K 12
+#define PAGE_2M 21
+
+typedef struct _Tlb_Config {
+	unsigned int entries;
+	unsigned int ways;    /* entries / ways sets, a power of two */
+	uint32_t latency;     /* cycles added by a lookup */
+} Tlb_Config;
+
+typedef struct _Mmu_Config {
+	Tlb_Config l1i;
+	Tlb_Config l1d;
+	Tlb_Config l2;
+	unsigned int page_bits; /* PAGE_4K or PAGE_2M, for new address spaces */
+	uint32_t walk_latency;  /* cycles per page table read, untimed */
+} Mmu_Config;
+
+typedef struct _Tlb_Entry {
+	uint64_t vpn;
+	uint64_t frame; /* physical address of the page */
+	uint32_t lru;
+	uint16_t asid;
+	unsigned char page_bits;
+	unsigned char valid;
+} Tlb_Entry;
+
+typedef struct _Tlb {
+	const char *name;
+	Tlb_Config config;
+	unsigned int num_sets;
+	Tlb_Entry *entries;
+	uint32_t clock;
+	uint64_t hits;
+	uint64_t misses;
+} Tlb;
+
+/* a page table node: 512 entries, children or page frames at the leaves */
+typedef struct _Pt_Node Pt_Node;
+
+typedef struct _Mmu_Space {
+	Pt_Node *root;
+	unsigned int page_bits;
+	uint64_t pages;
+} Mmu_Space;
+
+typedef struct _Mmu {
+	Mmu_Config config;
+	Cache *cache;
+	Mshr_File *timing; /* if set, walk reads are timed through it */
+	
+	Tlb l1i;
+	Tlb l1d;
+	Tlb l2;
+	Mmu_Space spaces[MMU_ASIDS];
+	
+	uint64_t next_frame; /* physical memory handed out so far */
+	
+	uint64_t walks;
+	uint64_t walk_reads;
+	uint64_t walk_cycles;
+	uint64_t faults; /* pages mapped on first touch */
+} Mmu;
+
+void mmu_default_config(Mmu_Config *config);
+int mmu_page_bits_from_name(const char *name);
+
+Mmu *mmu_create(const Mmu_Config *config, Cache *cache);
+void mmu_destroy(Mmu *mmu);
+
+int mmu_set_page_size(Mmu *mmu, unsigned int asid, unsigned int page_bits);
+uint64_t mmu_translate(Mmu *mmu, unsigned int asid, uint64_t address, int is_fetch, uint64_t cycle, uint64_t *physical);
+void print_mmu_stats(const Mmu *mmu);
+
+#endif
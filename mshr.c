@@ -0,0 +1,251 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Non-blocking cache timing: miss status holding registers
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "mshr.h"
+
+void mshr_default_config(Mshr_Config *config) {
+	config->num_mshrs = 8;
+	config->targets = 4;
+	config->hit_latency = 1;
+	config->miss_latency = 100;
+}
+
+Mshr_File *mshr_create(Cache *cache, const Mshr_Config *config) {
+	if (config->num_mshrs < 1 || config->num_mshrs > MSHR_MAX || config->targets < 1) {
+		return NULL;
+	}
+	
+	Mshr_File *file = calloc(1, sizeof(Mshr_File));
+	if (file == NULL) {
+		return NULL;
+	}
+	
+	file->cache = cache;
+	file->config = *config;
+	
+	return file;
+}
+
+/**
+ * Forget outstanding misses, time and counts, to start again at cycle 0
+ */
+void mshr_reset(Mshr_File *file) {
+	memset(file->mshrs, 0, sizeof(file->mshrs));
+	memset(&file->stats, 0, sizeof(Mshr_Stats));
+	file->in_use = 0;
+	file->now = 0;
+	file->covered = 0;
+}
+
+void mshr_destroy(Mshr_File *file) {
+	free(file);
+}
+
+/**
+ * Free every MSHR whose block has arrived by 'cycle'
+ */
+static void retire(Mshr_File *file, uint64_t cycle) {
+	for (unsigned int n=0; n < file->config.num_mshrs && file->in_use > 0; n++) {
+		if (file->mshrs[n].valid && file->mshrs[n].ready <= cycle) {
+			file->mshrs[n].valid = 0;
+			file->in_use--;
+		}
+	}
+}
+
+static Mshr *find(Mshr_File *file, uint64_t block) {
+	for (unsigned int n=0; n < file->config.num_mshrs; n++) {
+		if (file->mshrs[n].valid && file->mshrs[n].block == block) {
+			return &file->mshrs[n];
+		}
+	}
+	
+	return NULL;
+}
+
+/**
+ * The first free MSHR, or if none is free the one that frees up first
+ */
+static Mshr *next_free(Mshr_File *file) {
+	Mshr *soonest = NULL;
+	
+	for (unsigned int n=0; n < file->config.num_mshrs; n++) {
+		Mshr *mshr = &file->mshrs[n];
+		
+		if (!mshr->valid) {
+			return mshr;
+		}
+		
+		if (soonest == NULL || mshr->ready < soonest->ready) {
+			soonest = mshr;
+		}
+	}
+	
+	return soonest;
+}
+
+static void wait_until(Mshr_File *file, uint64_t cycle) {
+	file->stats.stall_cycles += cycle - file->now;
+	file->now = cycle;
+	retire(file, cycle);
+}
+
+/**
+ * Make an access at 'cycle' and return the cycle it completes: when the
+ * data arrives for a read, or when a write has been accepted (writes
+ * never wait for their block). Accesses must come in time order; one
+ * made before the last is taken to happen at the same time.
+ */
+uint64_t mshr_access(Mshr_File *file, uint64_t cycle, const Cache_Op *op) {
+	Mshr_Stats *stats = &file->stats;
+	uint64_t block = address_block_base(file->cache, op->address);
+	
+	if (stats->reads + stats->writes == 0) {
+		stats->first = cycle;
+		file->now = cycle;
+	} else if (cycle > file->now) {
+		file->now = cycle;
+	}
+	
+	uint64_t start = file->now;
+	retire(file, start);
+	
+	Mshr *mshr = find(file, block);
+	
+	if (mshr != NULL && mshr->targets >= file->config.targets) {
+		/* nowhere to note this access until the block arrives */
+		stats->targets_full++;
+		wait_until(file, mshr->ready);
+		mshr = NULL;
+	}
+	
+	unsigned int index = address_index(file->cache, op->address);
+	uint64_t writebacks = file->cache->sets[index].writebacks;
+	int is_cache_hit;
+	
+	if (op->is_write) {
+		is_cache_hit = cache_write(file->cache, op->address, op->byte);
+		stats->writes++;
+	} else {
+		cache_read(file->cache, op->address, &is_cache_hit);
+		stats->reads++;
+	}
+	
+	uint64_t ready = file->now + file->config.hit_latency;
+	
+	if (mshr != NULL) {
+		/* the block is on its way; the cache already has its tag */
+		mshr->targets++;
+		stats->secondary_misses++;
+		
+		if (mshr->ready > ready) {
+			ready = mshr->ready;
+		}
+	} else if (is_cache_hit) {
+		stats->hits++;
+	} else {
+		if (file->in_use == file->config.num_mshrs) {
+			stats->mshr_full++;
+			wait_until(file, next_free(file)->ready);
+		}
+		
+		mshr = next_free(file);
+		mshr->block = block;
+		mshr->issued = file->now;
+		mshr->ready = file->now + file->config.miss_latency;
+		mshr->targets = 1;
+		
+		if (file->backend != NULL) {
+			mshr->ready = mem_complete(file->backend, mem_submit(file->backend, file->now, block, 0));
+			
+			if (mshr->ready < file->now + file->config.hit_latency) {
+				mshr->ready = file->now + file->config.hit_latency;
+			}
+		}
+		mshr->valid = 1;
+		
+		file->in_use++;
+		if (file->in_use > stats->peak) {
+			stats->peak = file->in_use;
+		}
+		
+		stats->primary_misses++;
+		stats->occupancy += mshr->ready - mshr->issued;
+		
+		/* misses start in time order, so the busy time is a running union */
+		uint64_t from = (file->covered > mshr->issued) ? file->covered : mshr->issued;
+		if (mshr->ready > from) {
+			stats->busy_cycles += mshr->ready - from;
+			file->covered = mshr->ready;
+		}
+		
+		ready = mshr->ready;
+	}
+	
+	/* the block this access displaced, if dirty, leaves behind the fill */
+	if (file->backend != NULL && file->cache->sets[index].writebacks != writebacks) {
+		mem_submit(file->backend, file->now, file->cache->sets[index].victim, 1);
+	}
+	
+	if (op->is_write) {
+		ready = file->now + file->config.hit_latency;
+	} else {
+		uint64_t latency = ready - start;
+		
+		stats->read_latency += latency;
+		if (latency > stats->max_read_latency) {
+			stats->max_read_latency = latency;
+		}
+	}
+	
+	if (ready > stats->last) {
+		stats->last = ready;
+	}
+	
+	return ready;
+}
+
+void print_mshr_stats(const Mshr_File *file) {
+	const Mshr_Stats *stats = &file->stats;
+	uint64_t elapsed = stats->last - stats->first;
+	
+	if (file->backend != NULL) {
+		printf("%u MSHRs of %u targets, %u cycle hits, misses from %s\n",
+			file->config.num_mshrs, file->config.targets,
+			file->config.hit_latency, file->backend->name);
+	} else {
+		printf("%u MSHRs of %u targets, %u cycle hits, %u cycle misses\n",
+			file->config.num_mshrs, file->config.targets,
+			file->config.hit_latency, file->config.miss_latency);
+	}
+	
+	printf("Reads\tWrites\tHits\tPrimary\tMerged\n");
+	printf("%llu\t%llu\t%llu\t%llu\t%llu\n",
+		(unsigned long long)stats->reads,
+		(unsigned long long)stats->writes,
+		(unsigned long long)stats->hits,
+		(unsigned long long)stats->primary_misses,
+		(unsigned long long)stats->secondary_misses);
+	
+	printf("Read latency %.2f cycles average, %llu worst\n",
+		stats->reads ? (double)stats->read_latency / stats->reads : 0.0,
+		(unsigned long long)stats->max_read_latency);
+	
+	printf("Waited for an MSHR %llu times, for a target %llu times, %llu cycles in all\n",
+		(unsigned long long)stats->mshr_full,
+		(unsigned long long)stats->targets_full,
+		(unsigned long long)stats->stall_cycles);
+	
+	printf("MSHRs in use %.2f on average over %llu cycles, %u at most; %.2f while any were (MLP)\n",
+		elapsed ? (double)stats->occupancy / elapsed : 0.0,
+		(unsigned long long)elapsed,
+		stats->peak,
+		stats->busy_cycles ? (double)stats->occupancy / stats->busy_cycles : 0.0);
+}
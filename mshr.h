@@ -0,0 +1,85 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Non-blocking cache timing: miss status holding registers
+ *
+ * An Mshr_File puts time on a Cache. Every access is made at a cycle and
+ * comes back with the cycle its data is ready. A miss takes one of a fixed
+ * number of MSHRs until its block arrives; further misses to that block
+ * (secondary misses) are merged into the same MSHR, up to a number of
+ * targets each, and hits are served while misses are outstanding. An
+ * access only waits to start when it needs an MSHR or a target and none
+ * is free.
+ *
+ * The Cache underneath still holds the tags and data and is updated as
+ * each access is made, so contents match an untimed replay exactly.
+ *
+ * A miss takes miss_latency cycles unless a memory backend (backend.h) is
+ * attached, in which case the block is read from it and write-backs are
+ * sent to it. Nothing waits for a write-back: a write buffer takes them.
+ */
+
+#ifndef Mshr_h
+#define Mshr_h
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "cache.h"
+#include "backend.h"
+
+#define MSHR_MAX 64
+
+typedef struct _Mshr_Config {
+	unsigned int num_mshrs; /* outstanding primary misses, up to MSHR_MAX */
+	unsigned int targets;   /* accesses merged into one MSHR, counting the first */
+	uint32_t hit_latency;   /* cycles for a hit */
+	uint32_t miss_latency;  /* cycles from issuing a miss to its block arriving, with no backend */
+} Mshr_Config;
+
+typedef struct _Mshr {
+	uint64_t block;
+	uint64_t issued;
+	uint64_t ready;
+	unsigned int targets;
+	int valid;
+} Mshr;
+
+typedef struct _Mshr_Stats {
+	uint64_t reads;
+	uint64_t writes;
+	uint64_t hits;
+	uint64_t primary_misses;
+	uint64_t secondary_misses; /* merged into an outstanding MSHR */
+	uint64_t mshr_full;        /* accesses that waited for a free MSHR */
+	uint64_t targets_full;     /* ... or for a free target in one */
+	uint64_t stall_cycles;     /* cycles spent waiting on either */
+	uint64_t read_latency;     /* total cycles from request to data, reads only */
+	uint64_t max_read_latency;
+	uint64_t occupancy;        /* MSHR-cycles in use */
+	uint64_t busy_cycles;      /* cycles with at least one miss outstanding */
+	unsigned int peak;         /* most MSHRs in use at once */
+	uint64_t first;            /* cycle of the first access */
+	uint64_t last;             /* latest cycle anything completes */
+} Mshr_Stats;
+
+typedef struct _Mshr_File {
+	Cache *cache;
+	Mem_Backend *backend;  /* if set, fills and write-backs go here */
+	Mshr_Config config;
+	Mshr mshrs[MSHR_MAX];
+	unsigned int in_use;
+	uint64_t now;          /* accesses are made in time order */
+	uint64_t covered;      /* busy_cycles are counted up to here */
+	Mshr_Stats stats;
+} Mshr_File;
+
+void mshr_default_config(Mshr_Config *config);
+
+Mshr_File *mshr_create(Cache *cache, const Mshr_Config *config);
+void mshr_reset(Mshr_File *file);
+void mshr_destroy(Mshr_File *file);
+
+uint64_t mshr_access(Mshr_File *file, uint64_t cycle, const Cache_Op *op);
+void print_mshr_stats(const Mshr_File *file);
+
+#endif
@@ -0,0 +1,448 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Run several pipelines against private L1s and a shared, coherent L2
+ *
+ * Each core runs a program image with its own registers and memory and
+ * times its loads and stores through its own L1 (an Mshr_File) on a port
+ * of the shared L2 (coherence.h). Cores are spread over host threads,
+ * which run them a quantum of cycles at a time and then meet at a barrier,
+ * where the L2 syncs: coherence messages reach the L1s there, and in
+ * deterministic mode (-d) the quantum's L2 requests are applied, so the
+ * results are the same for any number of threads.
+ *
+ * Every core starts with $k0 set to its number and $k1 to the number of
+ * cores, for programs that split their work between them. With -T the
+ * cores are threads of one program: they share one memory, with a stack
+ * each, core n's STACK_SIZE * n below core 0's. The heap and mmap()
+ * regions are still each core's own, so they hand out the same addresses.
+ * Simulated memory is plain bytes, so -T runs every core on one thread.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "core.h"
+
+#define K0 26
+#define K1 27
+
+/* OS X has no pthread barriers */
+typedef struct _Mc_Barrier {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	int threads;
+	int waiting;
+	unsigned int generation;
+} Mc_Barrier;
+
+typedef struct _Mc_Core {
+	const char *path;
+	Image *image;
+	Core *core;
+	Cache *l1;
+	uint64_t finished; /* cycle it was done at */
+} Mc_Core;
+
+typedef struct _Multicore {
+	Mc_Core *cores;
+	unsigned int num_cores;
+	int threads;
+	uint64_t quantum;
+	uint64_t end; /* of the current quantum */
+	int done;
+	Shared_L2 *l2;
+	Mc_Barrier barrier;
+} Multicore;
+
+typedef struct _Mc_Thread {
+	Multicore *mc;
+	int id;
+	pthread_t thread;
+} Mc_Thread;
+
+static double now_sec() {
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void barrier_init(Mc_Barrier *barrier, int threads) {
+	pthread_mutex_init(&barrier->lock, NULL);
+	pthread_cond_init(&barrier->cond, NULL);
+	barrier->threads = threads;
+	barrier->waiting = 0;
+	barrier->generation = 0;
+}
+
+static void barrier_destroy(Mc_Barrier *barrier) {
+	pthread_cond_destroy(&barrier->cond);
+	pthread_mutex_destroy(&barrier->lock);
+}
+
+/**
+ * Wait for every thread. The last one in runs 'last' on 'arg' before
+ * letting the others go.
+ */
+static void barrier_wait(Mc_Barrier *barrier, void (*last)(void *), void *arg) {
+	pthread_mutex_lock(&barrier->lock);
+	
+	unsigned int generation = barrier->generation;
+	
+	if (++barrier->waiting == barrier->threads) {
+		if (last != NULL) {
+			last(arg);
+		}
+		barrier->waiting = 0;
+		barrier->generation++;
+		pthread_cond_broadcast(&barrier->cond);
+	} else {
+		while (generation == barrier->generation) {
+			pthread_cond_wait(&barrier->cond, &barrier->lock);
+		}
+	}
+	
+	pthread_mutex_unlock(&barrier->lock);
+}
+
+/**
+ * Run a core to the end of the quantum. A stall skipped over the end
+ * leaves it ahead, and it waits out the quanta it is ahead of.
+ */
+static void run_quantum(Mc_Core *mc_core, uint64_t end) {
+	Core *core = mc_core->core;
+	
+	while (!core_done(core) && core->cycles < end) {
+		core_step(core);
+	}
+	
+	if (core_done(core) && mc_core->finished == 0) {
+		mc_core->finished = core->cycles;
+	}
+}
+
+/* with every thread at the barrier */
+static void end_quantum(void *arg) {
+	Multicore *mc = arg;
+	
+	l2_sync(mc->l2);
+	
+	mc->done = 1;
+	for (unsigned int n=0; n < mc->num_cores; n++) {
+		if (!core_done(mc->cores[n].core)) {
+			mc->done = 0;
+		}
+	}
+	
+	mc->end += mc->quantum;
+}
+
+/* cores n, n + threads, ... belong to thread n */
+static void *mc_worker(void *arg) {
+	Mc_Thread *thread = arg;
+	Multicore *mc = thread->mc;
+	
+	while (!mc->done) {
+		for (unsigned int n=thread->id; n < mc->num_cores; n += mc->threads) {
+			run_quantum(&mc->cores[n], mc->end);
+		}
+		
+		barrier_wait(&mc->barrier, end_quantum, mc);
+	}
+	
+	return NULL;
+}
+
+static void mc_run(Multicore *mc) {
+	Mc_Thread *threads = malloc(sizeof(Mc_Thread) * mc->threads);
+	
+	barrier_init(&mc->barrier, mc->threads);
+	mc->end = mc->quantum;
+	mc->done = 0;
+	
+	for (int t=0; t < mc->threads; t++) {
+		threads[t].mc = mc;
+		threads[t].id = t;
+		pthread_create(&threads[t].thread, NULL, mc_worker, &threads[t]);
+	}
+	
+	for (int t=0; t < mc->threads; t++) {
+		pthread_join(threads[t].thread, NULL);
+	}
+	
+	barrier_destroy(&mc->barrier);
+	free(threads);
+}
+
+static Image *load_image(const char *path) {
+	FILE *file = fopen(path, "rb");
+	
+	if (file == NULL) {
+		perror(path);
+		return NULL;
+	}
+	
+	Image *image = image_read(file);
+	fclose(file);
+	return image;
+}
+
+/**
+ * With -T: core 0 owns the memory, the images' with room for a stack per
+ * core at the top, and the rest run on it
+ */
+static int check_shared(Multicore *mc) {
+	Image *image = mc->cores[0].image;
+	
+	for (unsigned int n=1; n < mc->num_cores; n++) {
+		const Image *other = mc->cores[n].image;
+		
+		if (other->data_base != image->data_base || other->memory_size != image->memory_size) {
+			fprintf(stderr, "[!] With -T every image needs the same data base and memory size.\n");
+			return 2;
+		}
+	}
+	
+	image->memory_size += (size_t)(mc->num_cores - 1) * STACK_SIZE;
+	return 0;
+}
+
+/**
+ * Stacks go down from the top of the shared memory, core n's STACK_SIZE * n
+ * below core 0's, and mmap() regions below all of them
+ */
+static void place_stacks(Multicore *mc) {
+	uint32_t stacks = (mc->num_cores - 1) * STACK_SIZE;
+	
+	for (unsigned int n=0; n < mc->num_cores; n++) {
+		Core *core = mc->cores[n].core;
+		Syscall_State *sys = &core->syscalls;
+		
+		core->registers[29] = (core->data_base + core->memory_size - 16 - n * STACK_SIZE) & ~7u;
+		sys->mmap_top = sys->mmap_top - sys->brk > stacks ? sys->mmap_top - stacks : sys->brk;
+	}
+}
+
+/**
+ * Load the images and put a core, an L1 and a port on the L2 together for
+ * each; returns 0, or the exit status after saying what went wrong
+ */
+static int create_cores(Multicore *mc, char *paths[], unsigned int copies, int shared,
+						const Cache_Config *l1_config, const Mshr_Config *mshr_config) {
+	for (unsigned int n=0; n < mc->num_cores; n++) {
+		mc->cores[n].path = paths[n / copies];
+		mc->cores[n].image = load_image(mc->cores[n].path);
+		if (mc->cores[n].image == NULL) {
+			return 1;
+		}
+	}
+	
+	if (shared && check_shared(mc) != 0) {
+		return 2;
+	}
+	
+	for (unsigned int n=0; n < mc->num_cores; n++) {
+		Mc_Core *mc_core = &mc->cores[n];
+		
+		mc_core->core = shared && n > 0 ? core_create_thread(mc_core->image, mc->cores[0].core)
+			: core_create_image(mc_core->image);
+		mc_core->l1 = cache_create(l1_config);
+		if (mc_core->core == NULL || mc_core->l1 == NULL) {
+			fprintf(stderr, "[!] Unable to allocate core %u.\n", n);
+			return 1;
+		}
+		
+		Core *core = mc_core->core;
+		core->dcache = mshr_create(mc_core->l1, mshr_config);
+		if (core->dcache == NULL) {
+			fprintf(stderr, "[!] Between 1 and %d MSHRs.\n", MSHR_MAX);
+			return 2;
+		}
+		
+		/* as threads of one program, or each in an address space of its own */
+		if (l2_attach(mc->l2, n, core->dcache, shared ? 0 : (uint64_t)n << 32) != 0) {
+			fprintf(stderr, "[!] The L1 and L2 need the same block size.\n");
+			return 2;
+		}
+		core->l2 = &mc->l2->ports[n];
+		
+		core->registers[K0] = n;
+		core->registers[K1] = mc->num_cores;
+	}
+	
+	if (shared) {
+		place_stacks(mc);
+	}
+	
+	return 0;
+}
+
+static void destroy_cores(Multicore *mc) {
+	/* the cores on core 0's memory go first */
+	for (unsigned int n=mc->num_cores; n-- > 0;) {
+		Mc_Core *mc_core = &mc->cores[n];
+		
+		if (mc_core->core != NULL) {
+			mshr_destroy(mc_core->core->dcache);
+		}
+		cache_destroy(mc_core->l1);
+		core_destroy(mc_core->core);
+		image_destroy(mc_core->image);
+	}
+}
+
+static uint64_t retired(const Core *core) {
+	uint64_t count = 0;
+	
+	for (size_t n=0; n < core->program_length; n++) {
+		count += core->profile[n].retired;
+	}
+	
+	return count;
+}
+
+static void print_cores(const Multicore *mc) {
+	printf("Core\tImage\tCycles\tRetired\tCPI\tL1 reads\tL1 writes\tL1 hits\tLoad latency\n");
+	
+	for (unsigned int n=0; n < mc->num_cores; n++) {
+		const Core *core = mc->cores[n].core;
+		const Mshr_Stats *stats = &core->dcache->stats;
+		uint64_t count = retired(core);
+		
+		printf("%u\t%s\t%llu\t%llu\t%.3f\t%llu\t%llu\t%llu\t%.2f\n", n, mc->cores[n].path,
+			(unsigned long long)mc->cores[n].finished, (unsigned long long)count,
+			count ? (double)mc->cores[n].finished / count : 0.0,
+			(unsigned long long)stats->reads, (unsigned long long)stats->writes,
+			(unsigned long long)stats->hits,
+			stats->reads ? (double)stats->read_latency / stats->reads : 0.0);
+	}
+}
+
+static void report(const Multicore *mc, double elapsed) {
+	uint64_t cycles = 0;
+	uint64_t total = 0;
+	
+	for (unsigned int n=0; n < mc->num_cores; n++) {
+		if (mc->cores[n].finished > cycles) {
+			cycles = mc->cores[n].finished;
+		}
+		total += mc->cores[n].core->cycles;
+	}
+	
+	print_cores(mc);
+	printf("\n");
+	print_l2_stats(mc->l2);
+	printf("\n");
+	
+	printf("Cores\tThreads\tQuantum\tQuanta\tCycles\tSeconds\tCore cycles/s\n");
+	printf("%u\t%d\t%llu\t%llu\t%llu\t%.3f\t%.0f\n", mc->num_cores, mc->threads,
+		(unsigned long long)mc->quantum, (unsigned long long)mc->l2->syncs,
+		(unsigned long long)cycles, elapsed, elapsed > 0 ? total / elapsed : 0.0);
+}
+
+/* main */
+int main(int argc, char *argv[]) {
+	Multicore mc;
+	Cache_Config l1_config;
+	Mshr_Config mshr_config;
+	L2_Config l2_config;
+	int deterministic = 0;
+	int shared = 0;
+	unsigned int copies = 1;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	int i;
+	
+	memset(&mc, 0, sizeof(mc));
+	mc.threads = 0;
+	mc.quantum = 1000;
+	
+	cache_default_config(&l1_config);
+	l1_config.num_sets = 64;
+	l1_config.ways = 2;
+	l1_config.memory_size = 0;
+	mshr_default_config(&mshr_config);
+	l2_default_config(&l2_config);
+	
+	for (i=1; i < argc && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+			mc.threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-Q") == 0 && i + 1 < argc) {
+			mc.quantum = strtoull(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "-d") == 0) {
+			deterministic = 1;
+		} else if (strcmp(argv[i], "-T") == 0) {
+			shared = 1;
+		} else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+			copies = strtoul(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+			l1_config.num_sets = strtoul(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+			l1_config.ways = strtoul(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "-S") == 0 && i + 1 < argc) {
+			l2_config.num_sets = strtoul(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "-A") == 0 && i + 1 < argc) {
+			l2_config.ways = strtoul(argv[++i], NULL, 0);
+		} else if (strcmp(argv[i], "-M") == 0 && i + 1 < argc) {
+			mshr_config.num_mshrs = strtoul(argv[++i], NULL, 0);
+		} else {
+			break;
+		}
+	}
+	
+	mc.num_cores = (argc - i) * copies;
+	
+	if (i == argc || argv[i][0] == '-' || copies < 1 || mc.quantum < 1) {
+		fprintf(stderr, "usage: %s [-j threads] [-Q quantum] [-d] [-T] [-c copies] [-s sets] [-a ways] [-S l2 sets] [-A l2 ways] [-M mshrs] image...\n", argv[0]);
+		return 2;
+	}
+	
+	if (mc.num_cores > L2_MAX_PORTS) {
+		fprintf(stderr, "[!] At most %d cores.\n", L2_MAX_PORTS);
+		return 2;
+	}
+	
+	/* threads sharing plain memory would race on it */
+	if (shared) {
+		if (mc.threads > 1) {
+			fprintf(stderr, "[!] -T runs on one thread, as its cores share memory.\n");
+		}
+		mc.threads = 1;
+	}
+	
+	/* a thread per core unless told otherwise, as far as the host goes */
+	if (mc.threads < 1) {
+		mc.threads = cpus > 0 && cpus < mc.num_cores ? cpus : mc.num_cores;
+	}
+	if ((unsigned int)mc.threads > mc.num_cores) {
+		mc.threads = mc.num_cores;
+	}
+	
+	mc.l2 = l2_create(&l2_config, mc.num_cores, deterministic);
+	mc.cores = calloc(mc.num_cores, sizeof(Mc_Core));
+	
+	int result = 1;
+	if (mc.l2 == NULL || mc.cores == NULL) {
+		fprintf(stderr, "[!] Unable to allocate the L2.\n");
+	} else {
+		result = create_cores(&mc, &argv[i], copies, shared, &l1_config, &mshr_config);
+	}
+	
+	if (result == 0) {
+		double start = now_sec();
+		mc_run(&mc);
+		report(&mc, now_sec() - start);
+	}
+	
+	if (mc.cores != NULL) {
+		destroy_cores(&mc);
+	}
+	l2_destroy(mc.l2);
+	free(mc.cores);
+	
+	return result;
+}
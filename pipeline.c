@@ -10,537 +10,411 @@
 #include <string.h>
 
 #include "pipeline.h"
-
-struct _IF_ID_Reg {
-	uint32_t instr;
-};
-
-struct _ID_EX_Reg {
-	uint32_t instr;
-    short RegDst;
-    short ALUSrc;
-    short ALUOp;
-    short MemRead;
-    short MemWrite;
-    short MemToReg;
-    short RegWrite;
-    short ReadReg1Value;
-    short ReadReg2Value;
-    short SEOffset;
-    short WriteReg1Num;
-    short WriteReg2Num;
-};
-
-struct _EX_MEM_Reg {
-    uint32_t instr;
-    short MemRead;
-    short MemWrite;
-    short MemToReg;
-    short RegWrite;
-    short ALUResult;
-    short SWValue;
-    short WriteRegNum;
-};
-
-struct _MEM_WB_Reg {
-    uint32_t instr;
-    short MemRead;
-    short MemWrite;
-    short MemToReg;
-    short RegWrite;
-    short ALUResult;
-    short SWValue;
-    short LWDataValue;
-    short WriteRegNum;
-};
+#include "profile.h"
+#include "dram.h"
 
 /* main */
 int main(int argc, char *argv[]) {
-	ctr = 0;
-	IF_ID = NULL;
-	ID_EX = NULL;
-	EX_MEM = NULL;
-    MEM_WB = NULL;
-	
 	size_t num_instructions = sizeof(instructions)/sizeof(uint32_t);
+	const char *trace_path = NULL;
+	FILE *trace_file = NULL;
+	const char *folded_path = NULL;
+	int profile = 0;
+	int timed = 0;
+	Mshr_Config mshr_config;
+	Dram_Config dram_config;
+	int dram = 0;
+	Mmu_Config mmu_config;
+	int virtual = 0;
+	const char *image_path = NULL;
+	Image *image = NULL;
+	int quiet = 0;
+	Unit_Config units[UNITS];
+	int unit;
+	char *end;
+	
+	unit_default_config(units);
+	mshr_default_config(&mshr_config);
+	dram_default_config(&dram_config);
+	mmu_default_config(&mmu_config);
+	
+	for (int i=1; i < argc; i++) {
+		if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+			trace_path = argv[++i];
+		} else if (strcmp(argv[i], "-x") == 0 && i + 1 < argc) {
+			image_path = argv[++i];
+		} else if (strcmp(argv[i], "-q") == 0) {
+			quiet = 1;
+		} else if (strcmp(argv[i], "-p") == 0) {
+			profile = 1;
+		} else if (strcmp(argv[i], "-F") == 0 && i + 1 < argc) {
+			folded_path = argv[++i];
+		} else if (strcmp(argv[i], "-M") == 0 && i + 1 < argc) {
+			mshr_config.num_mshrs = strtoul(argv[++i], NULL, 0);
+			timed = 1;
+		} else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+			mshr_config.miss_latency = strtoul(argv[++i], NULL, 0);
+			timed = 1;
+		} else if (strcmp(argv[i], "-D") == 0 && i + 1 < argc
+				   && (dram_config.page_policy = dram_policy_from_name(argv[++i])) >= 0) {
+			dram = timed = 1;
+		} else if (strcmp(argv[i], "-V") == 0 && i + 1 < argc
+				   && (int)(mmu_config.page_bits = mmu_page_bits_from_name(argv[++i])) >= 0) {
+			virtual = timed = 1;
+		} else if (strcmp(argv[i], "-U") == 0 && i + 1 < argc) {
+			/* unit:latency, then :p or :n for pipelined or not */
+			char *name = strtok(argv[++i], ":");
+			char *latency = strtok(NULL, ":");
+			char *pipelined = strtok(NULL, ":");
+			
+			if (name == NULL || (unit = unit_from_name(name)) < 0 || latency == NULL
+				|| (units[unit].latency = strtoul(latency, &end, 0)) == 0 || *end != '\0'
+				|| (pipelined != NULL && strcmp(pipelined, "p") != 0 && strcmp(pipelined, "n") != 0)
+				|| strtok(NULL, ":") != NULL) {
+				fprintf(stderr, "[!] -U wants mult or div, a latency of at least 1 and p or n.\n");
+				return 2;
+			}
+			
+			if (pipelined != NULL) {
+				units[unit].pipelined = strcmp(pipelined, "p") == 0;
+			}
+		} else {
+			fprintf(stderr, "usage: %s [-x image] [-q] [-t trace] [-p] [-F folded] [-M mshrs] [-l latency] [-D open|closed] [-V 4k|2m] [-U mult|div:latency[:p|n]]\n", argv[0]);
+			return 2;
+		}
+	}
+	
+	/* a program image from mipsgen instead of the fragment */
+	if (image_path != NULL) {
+		FILE *file = fopen(image_path, "rb");
+		
+		if (file == NULL) {
+			perror(image_path);
+			return 1;
+		}
+		
+		image = image_read(file);
+		fclose(file);
+		
+		if (image == NULL) {
+			return 1;
+		}
+		num_instructions = image->text_words;
+	}
 	
-	initialize_memory();
-	initialize_registers();
+	Core *core = image != NULL ? core_create_image(image)
+		: core_create(instructions, num_instructions, MEMORY_SIZE);
+	if (core == NULL) {
+		fprintf(stderr, "[!] Unable to allocate the pipeline.\n");
+		return 1;
+	}
+	
+	for (int n=0; n < UNITS; n++) {
+		core->units[n].config = units[n];
+	}
+	
+	/* time loads and stores through a tag-only data cache */
+	Cache *dcache = NULL;
+	
+	if (timed) {
+		Cache_Config config;
+		cache_default_config(&config);
+		config.memory_size = 0;
+		
+		dcache = cache_create(&config);
+		core->dcache = (dcache != NULL) ? mshr_create(dcache, &mshr_config) : NULL;
+		if (core->dcache == NULL) {
+			fprintf(stderr, "[!] Between 1 and %d MSHRs.\n", MSHR_MAX);
+			return 2;
+		}
+		
+		if (dram) {
+			dram_config.block_size = config.block_size;
+			core->dcache->backend = dram_create(&dram_config);
+			
+			if (core->dcache->backend == NULL) {
+				fprintf(stderr, "[!] Unable to create the DRAM model.\n");
+				return 2;
+			}
+		}
+		
+		/* walks go through the same data cache */
+		if (virtual) {
+			core->mmu = mmu_create(&mmu_config, dcache);
+			if (core->mmu == NULL) {
+				fprintf(stderr, "[!] Pages are 4k or 2m.\n");
+				return 2;
+			}
+			core->mmu->timing = core->dcache;
+		}
+	}
+	
+	/* record fetches and memory accesses for cachesim to replay */
+	if (trace_path != NULL) {
+		trace_file = fopen(trace_path, "wb");
+		if (trace_file == NULL || (core->trace = trace_writer_open(trace_file)) == NULL) {
+			perror(trace_path);
+			return 1;
+		}
+	}
 	
-    printf("Disassembling %ld instructions and running them ", num_instructions);
-    printf("through our pipeline simulation.\n");
-    printf("-1 is used as a \"don't care\" value (e.g. 0xFFFFFFFF, -1, etc.)\n\n");
+	if (!quiet) {
+		printf("Disassembling %ld instructions and running them ", num_instructions);
+		printf("through our pipeline simulation.\n");
+		printf("-1 is used as a \"don't care\" value (e.g. 0xFFFFFFFF, -1, etc.)\n\n");
+	}
     
-	while (ctr < num_instructions) {
-		instr_fetch();
-		instr_decode();
-		execute();
-		memory_access();
-		write_back();
+	while (!core_done(core)) {
+		detect_hazards(core);
+		
+		/* the cycles a stall leaves unchanged aren't worth printing either */
+		uint64_t skipped = core_skip_stall(core);
+		if (skipped > 0 && !quiet) {
+			printf("==============================================================\n");
+			printf("Skipped %llu stalled cycles\n", (unsigned long long)skipped);
+			printf("==============================================================\n\n");
+		}
+		
+		instr_fetch(core);
+		instr_decode(core);
+		execute(core);
+		memory_access(core);
+		write_back(core);
+		profile_cycle(core);
         
-		print_registers();
+		if (!quiet) {
+			print_registers(core);
+		}
 		
-		copy_to_read();
+		copy_to_read(core);
+		core->cycles++;
 	}
 	
-	return 0;
-}
-
-/**
- * IF - Instruction Fetch
- * Fetch the next instruction out of the Instruction Cache.
- * Put it in the WRITE version of the IF/ID pipeline register.
- */
-void instr_fetch() {
-	uint32_t instr = instructions[ctr];
-	ctr++;
-    
-	IF_ID[PR_WRITE].instr = instr;
-}
-
-/**
- * ID - Instruction Decode
- * nop, add, sub, sb and lb
- * read an instruction from the READ version of IF/ID pipeline register,
- * do the decoding and register fetching and write the values to the
- * WRITE version of the ID/EX pipeline register.
- */
-void instr_decode() {
-	uint32_t instr = IF_ID[PR_READ].instr;
+	if (quiet) {
+		print_summary(core);
+		printf("\n");
+	}
 	
-    ID_EX[PR_WRITE].instr = instr;
-    
-	/* decode and fetch */
-	if (instr != NOOP) {
-		switch (get_opcode(instr)) {
-			case 0x0:
-                /* add or sub */
-                ID_EX[PR_WRITE].RegDst = 1;
-                ID_EX[PR_WRITE].ALUSrc = 0;
-                ID_EX[PR_WRITE].ALUOp = 2; // 0b10
-                ID_EX[PR_WRITE].MemRead = 0;
-                ID_EX[PR_WRITE].MemWrite = 0;
-                ID_EX[PR_WRITE].MemToReg = 0;
-                ID_EX[PR_WRITE].RegWrite = 1;
-                
-                ID_EX[PR_WRITE].ReadReg1Value = registers[get_rs(instr)];
-                ID_EX[PR_WRITE].ReadReg2Value = registers[get_rt(instr)];
-                ID_EX[PR_WRITE].SEOffset = X;
-                ID_EX[PR_WRITE].WriteReg1Num = get_rt(instr);
-                ID_EX[PR_WRITE].WriteReg2Num = get_rd(instr);
-                break;
-                
-			case 0x20: /* lb */
-                ID_EX[PR_WRITE].RegDst = 0;
-                ID_EX[PR_WRITE].ALUSrc = 1;
-                ID_EX[PR_WRITE].ALUOp = 0;
-                ID_EX[PR_WRITE].MemRead = 1;
-                ID_EX[PR_WRITE].MemWrite = 0;
-                ID_EX[PR_WRITE].MemToReg = 1;
-                ID_EX[PR_WRITE].RegWrite = 1;
-                
-                ID_EX[PR_WRITE].ReadReg1Value = registers[get_rs(instr)];
-                ID_EX[PR_WRITE].ReadReg2Value = registers[get_rt(instr)];
-                ID_EX[PR_WRITE].SEOffset = get_immediate(instr);
-                ID_EX[PR_WRITE].WriteReg1Num = get_rt(instr);
-                ID_EX[PR_WRITE].WriteReg2Num = get_rs(instr);
-                break;
-                
-			case 0x28: /* sb */
-                ID_EX[PR_WRITE].RegDst = X;
-                ID_EX[PR_WRITE].ALUSrc = 1;
-                ID_EX[PR_WRITE].ALUOp = 0;
-                ID_EX[PR_WRITE].MemRead = 0;
-                ID_EX[PR_WRITE].MemWrite = 1;
-                ID_EX[PR_WRITE].MemToReg = X;
-                ID_EX[PR_WRITE].RegWrite = 0;
-                
-                ID_EX[PR_WRITE].ReadReg1Value = registers[get_rs(instr)];
-                ID_EX[PR_WRITE].ReadReg2Value = registers[get_rt(instr)];
-                ID_EX[PR_WRITE].SEOffset = get_immediate(instr);
-                ID_EX[PR_WRITE].WriteReg1Num = get_rt(instr);
-                ID_EX[PR_WRITE].WriteReg2Num = get_rs(instr);
-                break;
+	if (core->trace != NULL) {
+		int status = trace_writer_close(core->trace);
+		
+		if (fclose(trace_file) != 0 || status != 0) {
+			perror(trace_path);
+			return 1;
 		}
 	}
-}
-
-/**
- * EX - Execute
- * Perform the requested instruction on the specific operands read out of
- * the READ version of the IDEX pipeline register and then write the
- * appropriate values to the WRITE version of the EX/MEM pipeline register.
- */
-void execute() {
-	uint32_t instr = ID_EX[PR_READ].instr;
 	
-    EX_MEM[PR_WRITE].instr = instr;
-    EX_MEM[PR_WRITE].MemRead = ID_EX[PR_READ].MemRead;
-    EX_MEM[PR_WRITE].MemWrite = ID_EX[PR_READ].MemWrite;
-    EX_MEM[PR_WRITE].MemToReg = ID_EX[PR_READ].MemToReg;
-    EX_MEM[PR_WRITE].RegWrite = ID_EX[PR_READ].RegWrite;
-    
-    if (ID_EX[PR_READ].RegDst == 0) {
-        EX_MEM[PR_WRITE].WriteRegNum = ID_EX[PR_READ].WriteReg1Num;
-    } else if (ID_EX[PR_READ].RegDst == 1) {
-        EX_MEM[PR_WRITE].WriteRegNum = ID_EX[PR_READ].WriteReg2Num;
-    } else {
-        EX_MEM[PR_WRITE].WriteRegNum = X;
-    }
-    
-    if (instr != NOOP) {
-		switch (get_opcode(instr)) {
-			case 0x0:
-                switch (get_funct(instr)) {
-                    case 0x20: /* add */
-                        EX_MEM[PR_WRITE].ALUResult = ID_EX[PR_READ].ReadReg1Value + ID_EX[PR_READ].ReadReg2Value;
-                        EX_MEM[PR_WRITE].SWValue = ID_EX[PR_READ].ReadReg2Value;
-                        break;
-                        
-                        
-                    case 0x22: /* sub */
-                        EX_MEM[PR_WRITE].ALUResult = ID_EX[PR_READ].ReadReg1Value - ID_EX[PR_READ].ReadReg2Value;
-                        EX_MEM[PR_WRITE].SWValue = ID_EX[PR_READ].ReadReg2Value;
-                        break;
-                }
-                
-                break;
-                
-			case 0x20: /* lb */
-                EX_MEM[PR_WRITE].ALUResult = ID_EX[PR_READ].ReadReg1Value + ID_EX[PR_READ].SEOffset;
-                EX_MEM[PR_WRITE].SWValue = ID_EX[PR_READ].ReadReg2Value;
-                break;
-                
-			case 0x28: /* sb */
-                EX_MEM[PR_WRITE].ALUResult = ID_EX[PR_READ].ReadReg1Value + ID_EX[PR_READ].SEOffset;
-                EX_MEM[PR_WRITE].SWValue = ID_EX[PR_READ].ReadReg2Value;
-                break;
+	/* only programs that make syscalls get the table */
+	uint64_t syscalls = 0;
+	for (int n=0; n < SYSCALL_KINDS; n++) {
+		syscalls += core->syscalls.calls[n];
+	}
+	
+	if (syscalls > 0) {
+		print_syscall_stats(core);
+		printf("\n");
+	}
+	
+	if (core->units[UNIT_MULT].ops + core->units[UNIT_DIV].ops > 0) {
+		print_unit_stats(core, stdout);
+		printf("\n");
+	}
+	
+	if (core->mmu != NULL) {
+		print_mmu_stats(core->mmu);
+		printf("\n");
+		mmu_destroy(core->mmu);
+	}
+	
+	if (core->dcache != NULL) {
+		print_mshr_stats(core->dcache);
+		printf("\n");
+		
+		if (core->dcache->backend != NULL) {
+			mem_drain(core->dcache->backend);
+			print_mem_stats(core->dcache->backend);
+			printf("\n");
+			mem_destroy(core->dcache->backend);
 		}
+		mshr_destroy(core->dcache);
+		cache_destroy(dcache);
 	}
-}
-
-/**
- * MEM - Memory Access
- * If the instruction is a lb, then use the address you calculated in the
- * EX stage as an index into your Main Memory array and get the value that
- * is there.  Otherwise, just pass information from the READ version of the
- * EX_MEM pipeline register to the WRITE version of MEM_WB.
- */
-void memory_access() {
-    uint32_t instr = EX_MEM[PR_READ].instr;
 	
-    MEM_WB[PR_WRITE].instr = instr;
-    MEM_WB[PR_WRITE].MemRead = EX_MEM[PR_READ].MemRead;
-    MEM_WB[PR_WRITE].MemWrite = EX_MEM[PR_READ].MemWrite;
-    MEM_WB[PR_WRITE].MemToReg = EX_MEM[PR_READ].MemToReg;
-    MEM_WB[PR_WRITE].RegWrite = EX_MEM[PR_READ].RegWrite;
-    MEM_WB[PR_WRITE].ALUResult = EX_MEM[PR_READ].ALUResult;
-    MEM_WB[PR_WRITE].SWValue = EX_MEM[PR_READ].SWValue;
-    MEM_WB[PR_WRITE].WriteRegNum = EX_MEM[PR_READ].WriteRegNum;
-    
-    if (MEM_WB[PR_WRITE].MemRead == 1) {
-        MEM_WB[PR_WRITE].LWDataValue = main_memory[MEM_WB[PR_WRITE].ALUResult];
-    } else if (MEM_WB[PR_WRITE].MemWrite == 1) {
-        main_memory[MEM_WB[PR_WRITE].ALUResult] = MEM_WB[PR_WRITE].SWValue & 0xff;
-    } else {
-        MEM_WB[PR_WRITE].LWDataValue = X;
-    }
-}
-
-/**
- * WB - Register Write Back
- * Write to the registers based on information you read out of the
- * READ version of MEM_WB
- */
-void write_back() {
-	if (MEM_WB[PR_READ].RegWrite == 1) {
-        if (MEM_WB[PR_READ].MemToReg == 1) {
-            /* lb */
-            registers[MEM_WB[PR_READ].WriteRegNum] = MEM_WB[PR_READ].LWDataValue;
-        } else if (MEM_WB[PR_READ].MemToReg == 0){
-            /* add, sub */
-            registers[MEM_WB[PR_READ].WriteRegNum] = MEM_WB[PR_READ].ALUResult;
-        }
-    }
+	if (profile) {
+		print_profile(core, stdout);
+		printf("\n");
+		print_block_profile(core, stdout);
+	}
+	
+	/* for flamegraph.pl and friends */
+	if (folded_path != NULL) {
+		FILE *folded = fopen(folded_path, "w");
+		
+		if (folded == NULL || write_folded_profile(core, folded) != 0 || fclose(folded) != 0) {
+			perror(folded_path);
+			return 1;
+		}
+	}
+	
+	core_destroy(core);
+	image_destroy(image);
+	return 0;
 }
 
 /**
- *
+ * Just the totals, for programs too long to print every cycle of
  */
-void copy_to_read() {
-    IF_ID[PR_READ] = IF_ID[PR_WRITE];
-    ID_EX[PR_READ] = ID_EX[PR_WRITE];
-    EX_MEM[PR_READ] = EX_MEM[PR_WRITE];
-    MEM_WB[PR_READ] = MEM_WB[PR_WRITE];
+void print_summary(Core *core) {
+	uint64_t retired = 0;
+	
+	for (size_t n=0; n < core->program_length; n++) {
+		retired += core->profile[n].retired;
+	}
+	
+	printf("Cycles\tRetired\tCPI\n");
+	printf("%llu\t%llu\t%.3f\n", (unsigned long long)core->cycles, (unsigned long long)retired,
+		   retired ? (double)core->cycles / retired : 0.0);
 }
 
 /**
  * Print out the contents of our registers
  */
-void print_registers() {
+void print_registers(Core *core) {
 	printf("==============================================================\n");
-	printf("Clock Cycle #%d\n", ctr);
+	printf("Clock Cycle #%llu\n", (unsigned long long)core->cycles + 1);
 	printf("==============================================================\n");
     
     int n = 0;
     
     while (n < NUM_REGISTERS) {
         printf("%02d: 0x%08x\t%02d: 0x%08x\t%02d: 0x%08x\t%02d: 0x%08x\n",
-               n, registers[n++],
-               n, registers[n++],
-               n, registers[n++],
-               n, registers[n++]
+               n, core->registers[n++],
+               n, core->registers[n++],
+               n, core->registers[n++],
+               n, core->registers[n++]
                );
     }
 	
-	char desc[18];
+	char desc[INSTR_DESC_SIZE];
 	
     /* IF/ID */
-	desc_instr(IF_ID[PR_WRITE].instr, desc);
+	desc_instr(core->IF_ID[PR_WRITE].instr, desc);
 	printf("\n%14s\t0x%08x\t%s\n\n",
            "IF/ID Write:",
-           IF_ID[PR_WRITE].instr,
+           core->IF_ID[PR_WRITE].instr,
            desc);
     
-	desc_instr(IF_ID[PR_READ].instr, desc);
+	desc_instr(core->IF_ID[PR_READ].instr, desc);
 	printf("%14s\t0x%08x\t%s\n\n",
            "IF/ID Read:",
-           IF_ID[PR_READ].instr, desc);
+           core->IF_ID[PR_READ].instr, desc);
 	
     /* ID/EX */
-	desc_instr(ID_EX[PR_WRITE].instr, desc);
+	desc_instr(core->ID_EX[PR_WRITE].instr, desc);
 	printf("%14s\t0x%08x\t%s\n",
-           "ID/EX Write:", ID_EX[PR_WRITE].instr,
+           "ID/EX Write:", core->ID_EX[PR_WRITE].instr,
            desc);
     
-    if (ID_EX[PR_WRITE].instr != NOOP) {
+    if (core->ID_EX[PR_WRITE].instr != NOOP) {
         printf("%9s: %d\t%9s: %d\t%9s: %d\t%9s: %d\n",
-               "RegDst", ID_EX[PR_WRITE].RegDst,
-               "ALUSrc", ID_EX[PR_WRITE].ALUSrc,
-               "ALUOp", ID_EX[PR_WRITE].ALUOp,
-               "MemRead", ID_EX[PR_WRITE].MemRead);
+               "RegDst", core->ID_EX[PR_WRITE].RegDst,
+               "ALUSrc", core->ID_EX[PR_WRITE].ALUSrc,
+               "ALUOp", core->ID_EX[PR_WRITE].ALUOp,
+               "MemRead", core->ID_EX[PR_WRITE].MemRead);
         printf("%9s: %d\t%9s: %d\t%9s: %d\n",
-               "MemWrite", ID_EX[PR_WRITE].MemWrite,
-               "MemToReg", ID_EX[PR_WRITE].MemToReg,
-               "RegWrite", ID_EX[PR_WRITE].RegWrite);
+               "MemWrite", core->ID_EX[PR_WRITE].MemWrite,
+               "MemToReg", core->ID_EX[PR_WRITE].MemToReg,
+               "RegWrite", core->ID_EX[PR_WRITE].RegWrite);
         printf("%13s: 0x%08x\t%13s: 0x%08x\n",
-               "ReadReg1Value", ID_EX[PR_WRITE].ReadReg1Value,
-               "ReadReg2Value", ID_EX[PR_WRITE].ReadReg2Value);
+               "ReadReg1Value", core->ID_EX[PR_WRITE].ReadReg1Value,
+               "ReadReg2Value", core->ID_EX[PR_WRITE].ReadReg2Value);
         printf("%13s: 0x%08x\t%13s: %d,%d\n",
-               "SEOffset", ID_EX[PR_WRITE].SEOffset,
-               "WriteRegNum", ID_EX[PR_WRITE].WriteReg1Num, ID_EX[PR_WRITE].WriteReg2Num);
+               "SEOffset", core->ID_EX[PR_WRITE].SEOffset,
+               "WriteRegNum", core->ID_EX[PR_WRITE].WriteReg1Num, core->ID_EX[PR_WRITE].WriteReg2Num);
     }
     
-	desc_instr(ID_EX[PR_READ].instr, desc);
+	desc_instr(core->ID_EX[PR_READ].instr, desc);
 	printf("\n%14s\t0x%08x\t%s\n",
            "ID/EX Read:",
-           ID_EX[PR_READ].instr, desc);
+           core->ID_EX[PR_READ].instr, desc);
     
-    if (ID_EX[PR_READ].instr != NOOP) {
+    if (core->ID_EX[PR_READ].instr != NOOP) {
         printf("%9s: %d\t%9s: %d\t%9s: %d\t%9s: %d\n",
-               "RegDst", ID_EX[PR_READ].RegDst,
-               "ALUSrc", ID_EX[PR_READ].ALUSrc,
-               "ALUOp", ID_EX[PR_READ].ALUOp,
-               "MemRead", ID_EX[PR_READ].MemRead);
+               "RegDst", core->ID_EX[PR_READ].RegDst,
+               "ALUSrc", core->ID_EX[PR_READ].ALUSrc,
+               "ALUOp", core->ID_EX[PR_READ].ALUOp,
+               "MemRead", core->ID_EX[PR_READ].MemRead);
         printf("%9s: %d\t%9s: %d\t%9s: %d\n",
-               "MemWrite", ID_EX[PR_READ].MemWrite,
-               "MemToReg", ID_EX[PR_READ].MemToReg,
-               "RegWrite", ID_EX[PR_READ].RegWrite);
+               "MemWrite", core->ID_EX[PR_READ].MemWrite,
+               "MemToReg", core->ID_EX[PR_READ].MemToReg,
+               "RegWrite", core->ID_EX[PR_READ].RegWrite);
         printf("%13s: 0x%08x\t%13s: 0x%08x\n",
-               "ReadReg1Value", ID_EX[PR_READ].ReadReg1Value,
-               "ReadReg2Value", ID_EX[PR_READ].ReadReg2Value);
+               "ReadReg1Value", core->ID_EX[PR_READ].ReadReg1Value,
+               "ReadReg2Value", core->ID_EX[PR_READ].ReadReg2Value);
         printf("%13s: 0x%08x\t%13s: %d,%d\n",
-               "SEOffset", ID_EX[PR_READ].SEOffset,
-               "WriteRegNum", ID_EX[PR_READ].WriteReg1Num, ID_EX[PR_READ].WriteReg2Num);
+               "SEOffset", core->ID_EX[PR_READ].SEOffset,
+               "WriteRegNum", core->ID_EX[PR_READ].WriteReg1Num, core->ID_EX[PR_READ].WriteReg2Num);
     }
     
     /* EX/MEM */
-	desc_instr(EX_MEM[PR_WRITE].instr, desc);
+	desc_instr(core->EX_MEM[PR_WRITE].instr, desc);
 	printf("\n%14s\t0x%08x\t%s\n",
-           "EX/MEM Write:", EX_MEM[PR_WRITE].instr, desc);
+           "EX/MEM Write:", core->EX_MEM[PR_WRITE].instr, desc);
     
-    if (EX_MEM[PR_WRITE].instr != NOOP) {
+    if (core->EX_MEM[PR_WRITE].instr != NOOP) {
         printf("%9s: %d\t%9s: %d\t%9s: %d\t%9s: %d\n",
-               "MemRead", EX_MEM[PR_WRITE].MemRead,
-               "MemWrite", EX_MEM[PR_WRITE].MemWrite,
-               "MemToReg", EX_MEM[PR_WRITE].MemToReg,
-               "RegWrite", EX_MEM[PR_WRITE].RegWrite);
+               "MemRead", core->EX_MEM[PR_WRITE].MemRead,
+               "MemWrite", core->EX_MEM[PR_WRITE].MemWrite,
+               "MemToReg", core->EX_MEM[PR_WRITE].MemToReg,
+               "RegWrite", core->EX_MEM[PR_WRITE].RegWrite);
         printf("%11s: 0x%08x\t%11s: 0x%08x\t%11s: %d\n",
-               "ALUResult", EX_MEM[PR_WRITE].ALUResult,
-               "SWValue", EX_MEM[PR_WRITE].SWValue,
-               "WriteRegNum", EX_MEM[PR_WRITE].WriteRegNum);
+               "ALUResult", core->EX_MEM[PR_WRITE].ALUResult,
+               "SWValue", core->EX_MEM[PR_WRITE].SWValue,
+               "WriteRegNum", core->EX_MEM[PR_WRITE].WriteRegNum);
     }
     
-	desc_instr(EX_MEM[PR_READ].instr, desc);
+	desc_instr(core->EX_MEM[PR_READ].instr, desc);
 	printf("\n%14s\t0x%08x\t%s\n",
-           "EX/MEM  Read:", EX_MEM[PR_READ].instr, desc);
+           "EX/MEM  Read:", core->EX_MEM[PR_READ].instr, desc);
     
-    if (EX_MEM[PR_READ].instr != NOOP) {
+    if (core->EX_MEM[PR_READ].instr != NOOP) {
         printf("%9s: %d\t%9s: %d\t%9s: %d\t%9s: %d\n",
-               "MemRead", EX_MEM[PR_READ].MemRead,
-               "MemWrite", EX_MEM[PR_READ].MemWrite,
-               "MemToReg", EX_MEM[PR_READ].MemToReg,
-               "RegWrite", EX_MEM[PR_READ].RegWrite);
+               "MemRead", core->EX_MEM[PR_READ].MemRead,
+               "MemWrite", core->EX_MEM[PR_READ].MemWrite,
+               "MemToReg", core->EX_MEM[PR_READ].MemToReg,
+               "RegWrite", core->EX_MEM[PR_READ].RegWrite);
         printf("%11s: 0x%08x\t%11s: 0x%08x\t%11s: %d\n",
-               "ALUResult", EX_MEM[PR_READ].ALUResult,
-               "SWValue", EX_MEM[PR_READ].SWValue,
-               "WriteRegNum", EX_MEM[PR_READ].WriteRegNum);
+               "ALUResult", core->EX_MEM[PR_READ].ALUResult,
+               "SWValue", core->EX_MEM[PR_READ].SWValue,
+               "WriteRegNum", core->EX_MEM[PR_READ].WriteRegNum);
     }
     
     /* MEM/WB */
-	desc_instr(MEM_WB[PR_WRITE].instr, desc);
-    printf("\nMEM/WB Write:\t0x%08x\t%s\n", MEM_WB[PR_WRITE].instr, desc);
+	desc_instr(core->MEM_WB[PR_WRITE].instr, desc);
+    printf("\nMEM/WB Write:\t0x%08x\t%s\n", core->MEM_WB[PR_WRITE].instr, desc);
     
-    if (MEM_WB[PR_WRITE].instr != NOOP) {
+    if (core->MEM_WB[PR_WRITE].instr != NOOP) {
         printf("%8s: %d\t%8s: %d\n",
-               "MemToReg", MEM_WB[PR_WRITE].MemToReg,
-               "RegWrite", MEM_WB[PR_WRITE].RegWrite);
+               "MemToReg", core->MEM_WB[PR_WRITE].MemToReg,
+               "RegWrite", core->MEM_WB[PR_WRITE].RegWrite);
         printf("%11s: 0x%08x\t%11s: 0x%08x\t%11s: %d\n",
-               "LWDataValue", MEM_WB[PR_WRITE].LWDataValue,
-               "ALUResult", MEM_WB[PR_WRITE].ALUResult,
-               "WriteRegNum", MEM_WB[PR_WRITE].WriteRegNum);
+               "LWDataValue", core->MEM_WB[PR_WRITE].LWDataValue,
+               "ALUResult", core->MEM_WB[PR_WRITE].ALUResult,
+               "WriteRegNum", core->MEM_WB[PR_WRITE].WriteRegNum);
     }
 
-    desc_instr(MEM_WB[PR_READ].instr, desc);
-    printf("\nMEM/WB Read:\t0x%08x\t%s\n", MEM_WB[PR_READ].instr, desc);
+    desc_instr(core->MEM_WB[PR_READ].instr, desc);
+    printf("\nMEM/WB Read:\t0x%08x\t%s\n", core->MEM_WB[PR_READ].instr, desc);
     
-    if (MEM_WB[PR_READ].instr != NOOP) {
+    if (core->MEM_WB[PR_READ].instr != NOOP) {
         printf("%8s: %d\t%8s: %d\n",
-               "MemToReg", MEM_WB[PR_READ].MemToReg,
-               "RegWrite", MEM_WB[PR_READ].RegWrite);
+               "MemToReg", core->MEM_WB[PR_READ].MemToReg,
+               "RegWrite", core->MEM_WB[PR_READ].RegWrite);
         printf("%11s: 0x%08x\t%11s: 0x%08x\t%11s: %d\n",
-               "LWDataValue", MEM_WB[PR_READ].LWDataValue,
-               "ALUResult", MEM_WB[PR_READ].ALUResult,
-               "WriteRegNum", MEM_WB[PR_READ].WriteRegNum);
+               "LWDataValue", core->MEM_WB[PR_READ].LWDataValue,
+               "ALUResult", core->MEM_WB[PR_READ].ALUResult,
+               "WriteRegNum", core->MEM_WB[PR_READ].WriteRegNum);
     }
 	
 	printf("==============================================================\n\n");
 }
-/**
- * Initialize main memory using 0x00–0xFF
- */
-void initialize_memory() {
-	unsigned char current_value = 0;
-	
-	for (int n=0; n < MEMORY_SIZE; n++) {
-		main_memory[n] = current_value;
-		current_value++;
-	}
-}
-
-/**
- * Initialize registers
- * initial values of x100 plus the register number except for register 0
- */
-void initialize_registers() {
-	registers[0] = 0;
-	
-	for (int n=1; n < NUM_REGISTERS; n++) {
-		registers[n] = n + 0x100;
-	}
-	
-	/* pipeline registers */
-	IF_ID = malloc(sizeof(IF_ID_Reg) * 2);
-	IF_ID[PR_WRITE].instr = NOOP;
-	IF_ID[PR_READ].instr = NOOP;
-	
-	ID_EX = malloc(sizeof(ID_EX_Reg) * 2);
-	ID_EX[PR_WRITE].instr = NOOP;
-	ID_EX[PR_READ].instr = NOOP;
-	
-	EX_MEM = malloc(sizeof(EX_MEM_Reg) * 2);
-	EX_MEM[PR_WRITE].instr = NOOP;
-	EX_MEM[PR_READ].instr = NOOP;
-
-    MEM_WB = malloc(sizeof(MEM_WB_Reg) * 2);
-    MEM_WB[PR_WRITE].instr = NOOP;
-    MEM_WB[PR_READ].instr = NOOP;
-}
-
-unsigned int get_opcode(uint32_t instr) {
-	unsigned int opcode = (instr & 0xFC000000) >> 26; // 26 - 31
-	return opcode;
-}
-
-unsigned int get_rs(uint32_t instr) {
-	unsigned int rs = (instr & 0x03E00000) >> 21; // 21 - 25
-	return rs;
-}
-
-unsigned int get_rt(uint32_t instr) {
-	unsigned int rt = (instr & 0x001F0000) >> 16; // 16 - 20
-	return rt;
-}
-
-unsigned int get_rd(uint32_t instr) {
-	unsigned int rd = (instr & 0x0000F800) >> 11; // 11 - 15
-	return rd;
-}
-
-unsigned int get_shamt(uint32_t instr) {
-	unsigned int shamt = (instr & 0x000007C0) >> 6; // 6 - 10
-	return shamt;
-}
-
-unsigned int get_funct(uint32_t instr) {
-	unsigned int funct = instr & 0x0000003F; // 0 - 5
-	return funct;
-}
-
-unsigned int get_immediate(uint32_t instr) {
-	short immediate = instr & 0x0000FFFF; // 0 - 15
-	return immediate;
-}
-
-void desc_instr(uint32_t instr, char *desc) {
-	char buffer[18] = "";
-	
-	if (instr == NOOP) {
-		strcat(buffer, "nop");
-	} else {
-		switch (get_opcode(instr)) {
-			case 0x0:
-                
-                switch (get_funct(instr)) {
-                    case 0x20: /* add */
-                        sprintf(buffer, "add $%d,$%d,$%d",
-                                get_rd(instr),
-                                get_rs(instr),
-                                get_rt(instr));
-                        break;
-                        
-                    case 0x22: /* sub */
-                        sprintf(buffer, "sub $%d,$%d,$%d",
-                                get_rd(instr),
-                                get_rs(instr),
-                                get_rt(instr));
-                        break;
-                        
-                    default:
-                        strcpy(buffer, "Unknown funct!");
-                        break;
-                }
-                
-                break;
-                
-			case 0x20: /* lb */ 
-                sprintf(buffer, "lb $%d,%d($%d)", 
-                        get_rt(instr), 
-                        get_immediate(instr), 
-                        get_rs(instr));
-                break;
-                
-			case 0x28: /* sb */
-                sprintf(buffer, "sb $%d,%d($%d)",
-                        get_rt(instr), 
-                        get_immediate(instr), 
-                        get_rs(instr));
-                break;
-                
-			default:
-                strcpy(buffer, "Unknown opcode!");
-		}
-	}
-	
-	strcpy(desc, buffer);
-}
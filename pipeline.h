@@ -6,31 +6,7 @@
 #ifndef Pipeline_main_h
 #define Pipeline_main_h
 
-
-#define MEMORY_SIZE 1024 // 1K
-#define NUM_REGISTERS 32
-
-#define NOOP 0x00000000
-
-#define X -1
-
-#define PR_WRITE 0
-#define PR_READ 1
-
-typedef struct _IF_ID_Reg IF_ID_Reg;
-IF_ID_Reg *IF_ID;
-
-typedef struct _ID_EX_Reg ID_EX_Reg;
-ID_EX_Reg *ID_EX;
-
-typedef struct _EX_MEM_Reg EX_MEM_Reg;
-EX_MEM_Reg *EX_MEM;
-
-typedef struct _MEM_WB_Reg MEM_WB_Reg;
-MEM_WB_Reg *MEM_WB;
-
-short main_memory[MEMORY_SIZE];
-short registers[NUM_REGISTERS];
+#include "core.h"
 
 uint32_t instructions[] = {
 	0xa1020000, // sb $2,0($8)
@@ -47,27 +23,7 @@ uint32_t instructions[] = {
 	0x00000000
 };
 
-short ctr;
-
-void initialize_memory();
-void initialize_registers();
-
-void instr_fetch();
-void instr_decode();
-void execute();
-void memory_access();
-void write_back();
-void copy_to_read();
-void print_registers();
-
-void desc_instr(uint32_t instr, char *desc);
-unsigned int get_opcode(uint32_t instr);
-unsigned int get_rs(uint32_t instr);
-unsigned int get_rt(uint32_t instr);
-unsigned int get_rd(uint32_t instr);
-unsigned int get_shamt(uint32_t instr);
-unsigned int get_funct(uint32_t instr);
-unsigned int get_immediate(uint32_t instr);
-
+void print_registers(Core *core);
+void print_summary(Core *core);
 
 #endif
@@ -0,0 +1,299 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Per-instruction and per-basic-block cycle reports, and folded stacks
+ * for flame graph tools (flamegraph.pl, speedscope, inferno)
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "profile.h"
+
+static const char *stall_names[STALL_KINDS] = { "retired", "fill", "raw", "mem", "fetch", "syscall", "unit" };
+
+typedef struct _Ranked {
+	size_t first; /* index of the instruction, or of a block's leader */
+	size_t count; /* instructions in the block */
+	Pc_Counts counts;
+	uint64_t total;
+} Ranked;
+
+static uint64_t total_cycles(const Pc_Counts *counts) {
+	uint64_t total = counts->retired;
+	
+	for (int n=1; n < STALL_KINDS; n++) {
+		total += counts->stalls[n];
+	}
+	
+	return total;
+}
+
+static void add_counts(Pc_Counts *into, const Pc_Counts *counts) {
+	into->retired += counts->retired;
+	
+	for (int n=1; n < STALL_KINDS; n++) {
+		into->stalls[n] += counts->stalls[n];
+	}
+}
+
+static int by_total(const void *a, const void *b) {
+	const Ranked *x = a;
+	const Ranked *y = b;
+	
+	if (x->total != y->total) {
+		return x->total < y->total ? 1 : -1;
+	}
+	
+	return x->first < y->first ? -1 : x->first > y->first;
+}
+
+static uint32_t pc_of(const Core *core, size_t n) {
+	return core->text_base + n * sizeof(uint32_t);
+}
+
+/**
+ * Does this instruction end a basic block? If it has a static target
+ * inside the program, that index is stored in *target, otherwise SIZE_MAX.
+ */
+static int ends_block(const Core *core, size_t n, size_t *target) {
+	uint32_t instr = core->program[n];
+	uint32_t pc = pc_of(core, n);
+	uint32_t dest;
+	
+	switch (get_opcode(instr)) {
+		case 0x0:
+			*target = SIZE_MAX;
+			return get_funct(instr) == 0x08 || get_funct(instr) == 0x09; /* jr, jalr */
+			
+		case 0x1: /* bltz, bgez */
+		case 0x4: /* beq */
+		case 0x5: /* bne */
+		case 0x6: /* blez */
+		case 0x7: /* bgtz */
+			dest = pc + 4 + (uint32_t)((int32_t)(int16_t)(instr & 0xFFFF) * 4);
+			break;
+			
+		case 0x2: /* j */
+		case 0x3: /* jal */
+			dest = ((pc + 4) & 0xF0000000) | ((instr & 0x03FFFFFF) << 2);
+			break;
+			
+		default:
+			return 0;
+	}
+	
+	size_t index = (dest - core->text_base) / sizeof(uint32_t);
+	*target = dest >= core->text_base && index < core->program_length ? index : SIZE_MAX;
+	
+	return 1;
+}
+
+/**
+ * Mark the first instruction of each basic block: the entry point, branch
+ * and jump targets, and whatever follows a branch or jump's delay slot,
+ * which belongs to the branch's block.
+ */
+static unsigned char *find_leaders(const Core *core) {
+	unsigned char *leader = calloc(core->program_length + 2, 1);
+	
+	if (leader == NULL) {
+		return NULL;
+	}
+	
+	leader[0] = 1;
+	
+	for (size_t n=0; n < core->program_length; n++) {
+		size_t target;
+		
+		if (ends_block(core, n, &target)) {
+			leader[n + 2] = 1;
+			
+			if (target != SIZE_MAX) {
+				leader[target] = 1;
+			}
+		}
+	}
+	
+	return leader;
+}
+
+static void print_header(FILE *out, const char *what) {
+	fprintf(out, "%-12s %10s %7s", what, "cycles", "%");
+	
+	for (int n=0; n < STALL_KINDS; n++) {
+		fprintf(out, " %9s", stall_names[n]);
+	}
+}
+
+static void print_counts(FILE *out, const Ranked *r, uint64_t cycles) {
+	fprintf(out, " %10llu %6.2f%%", (unsigned long long)r->total,
+			cycles ? 100.0 * r->total / cycles : 0.0);
+	fprintf(out, " %9llu", (unsigned long long)r->counts.retired);
+	
+	for (int n=1; n < STALL_KINDS; n++) {
+		fprintf(out, " %9llu", (unsigned long long)r->counts.stalls[n]);
+	}
+}
+
+/**
+ * Flat profile: one line per instruction that was charged any cycles,
+ * most expensive first. Bubbles with no instruction to blame come last.
+ */
+void print_profile(const Core *core, FILE *out) {
+	Ranked *ranked = malloc(sizeof(Ranked) * (core->program_length + 1));
+	size_t num_ranked = 0;
+	char desc[32];
+	
+	if (ranked == NULL) {
+		fprintf(stderr, "[!] Unable to allocate the profile.\n");
+		return;
+	}
+	
+	for (size_t n=0; n < core->program_length; n++) {
+		Ranked r = { n, 1, core->profile[n], total_cycles(&core->profile[n]) };
+		
+		if (r.total > 0) {
+			ranked[num_ranked++] = r;
+		}
+	}
+	
+	qsort(ranked, num_ranked, sizeof(Ranked), by_total);
+	
+	fprintf(out, "Flat profile, %llu cycles\n", (unsigned long long)core->cycles);
+	print_header(out, "pc");
+	fprintf(out, "  instruction\n");
+	
+	for (size_t n=0; n < num_ranked; n++) {
+		desc_instr(core->program[ranked[n].first], desc);
+		fprintf(out, "0x%08x  ", pc_of(core, ranked[n].first));
+		print_counts(out, &ranked[n], core->cycles);
+		fprintf(out, "  %s\n", desc);
+	}
+	
+	Ranked other = { 0, 0, core->unattributed, total_cycles(&core->unattributed) };
+	if (other.total > 0) {
+		fprintf(out, "%-12s", "-");
+		print_counts(out, &other, core->cycles);
+		fprintf(out, "  (pipeline fill)\n");
+	}
+	
+	free(ranked);
+}
+
+/**
+ * Block profile: the flat profile summed over each basic block
+ */
+void print_block_profile(const Core *core, FILE *out) {
+	unsigned char *leader = find_leaders(core);
+	Ranked *ranked = malloc(sizeof(Ranked) * (core->program_length + 1));
+	size_t num_ranked = 0;
+	
+	if (leader == NULL || ranked == NULL) {
+		fprintf(stderr, "[!] Unable to allocate the profile.\n");
+		free(leader);
+		free(ranked);
+		return;
+	}
+	
+	for (size_t n=0; n < core->program_length; n++) {
+		if (leader[n]) {
+			ranked[num_ranked++] = (Ranked){ n, 0, { 0 }, 0 };
+		}
+		
+		Ranked *block = &ranked[num_ranked - 1];
+		add_counts(&block->counts, &core->profile[n]);
+		block->count++;
+	}
+	
+	for (size_t n=0; n < num_ranked; n++) {
+		ranked[n].total = total_cycles(&ranked[n].counts);
+	}
+	
+	qsort(ranked, num_ranked, sizeof(Ranked), by_total);
+	
+	fprintf(out, "Block profile, %llu cycles\n", (unsigned long long)core->cycles);
+	print_header(out, "block");
+	fprintf(out, "  instructions\n");
+	
+	for (size_t n=0; n < num_ranked && ranked[n].total > 0; n++) {
+		fprintf(out, "0x%08x  ", pc_of(core, ranked[n].first));
+		print_counts(out, &ranked[n], core->cycles);
+		fprintf(out, "  %zu\n", ranked[n].count);
+	}
+	
+	free(leader);
+	free(ranked);
+}
+
+/**
+ * How busy the multiply and divide units were, and how long EX waited on
+ * them
+ */
+void print_unit_stats(const Core *core, FILE *out) {
+	static const char *unit_names[UNITS] = { "mult", "div" };
+	
+	fprintf(out, "Unit\tLatency\tPipelined\tOps\tBusy\tUtilisation\tStalls\n");
+	
+	for (int n=0; n < UNITS; n++) {
+		const Func_Unit *unit = &core->units[n];
+		
+		fprintf(out, "%s\t%u\t%s\t%llu\t%llu\t%.2f%%\t%llu\n", unit_names[n],
+				unit->config.latency, unit->config.pipelined ? "yes" : "no",
+				(unsigned long long)unit->ops, (unsigned long long)unit->busy_cycles,
+				core->cycles ? 100.0 * unit->busy_cycles / core->cycles : 0.0,
+				(unsigned long long)unit->stall_cycles);
+	}
+}
+
+/**
+ * Folded stacks, one "frame;frame;... count" line per distinct stack:
+ * pipeline;block;instruction for retired cycles, with the stall reason as
+ * a last frame for bubbles. Returns non-zero on a write error.
+ */
+int write_folded_profile(const Core *core, FILE *out) {
+	unsigned char *leader = find_leaders(core);
+	size_t block = 0;
+	char desc[32];
+	
+	if (leader == NULL) {
+		fprintf(stderr, "[!] Unable to allocate the profile.\n");
+		return -1;
+	}
+	
+	for (size_t n=0; n < core->program_length; n++) {
+		const Pc_Counts *counts = &core->profile[n];
+		
+		if (leader[n]) {
+			block = n;
+		}
+		
+		desc_instr(core->program[n], desc);
+		
+		if (counts->retired > 0) {
+			fprintf(out, "pipeline;block_0x%08x;0x%08x %s %llu\n",
+					pc_of(core, block), pc_of(core, n), desc,
+					(unsigned long long)counts->retired);
+		}
+		
+		for (int k=1; k < STALL_KINDS; k++) {
+			if (counts->stalls[k] > 0) {
+				fprintf(out, "pipeline;block_0x%08x;0x%08x %s;%s_stall %llu\n",
+						pc_of(core, block), pc_of(core, n), desc, stall_names[k],
+						(unsigned long long)counts->stalls[k]);
+			}
+		}
+	}
+	
+	for (int k=1; k < STALL_KINDS; k++) {
+		if (core->unattributed.stalls[k] > 0) {
+			fprintf(out, "pipeline;%s %llu\n", stall_names[k],
+					(unsigned long long)core->unattributed.stalls[k]);
+		}
+	}
+	
+	free(leader);
+	
+	return ferror(out);
+}
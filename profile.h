@@ -0,0 +1,19 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Reports on where a core's cycles went, from the counts profile_cycle()
+ * keeps per instruction
+ */
+
+#ifndef Profile_h
+#define Profile_h
+
+#include <stdio.h>
+
+#include "core.h"
+
+void print_profile(const Core *core, FILE *out);
+void print_block_profile(const Core *core, FILE *out);
+void print_unit_stats(const Core *core, FILE *out);
+int write_folded_profile(const Core *core, FILE *out);
+
+#endif
@@ -0,0 +1,344 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Trace replay for the cache simulator
+ *
+ * A trace is either text, in one of the formats text_trace.c reads (the
+ * interactive r/w commands, Dinero din or Valgrind lackey), or a compressed
+ * binary trace (see trace.h) such as the one pipeline -t writes.
+ * Instruction fetches are replayed as reads unless data_only is set.
+ *
+ * Sets are independent: an address only ever touches the ways of the set
+ * picked by address_index(), and a set only moves the memory blocks that
+ * map to it. So with more than one thread the trace is split by set index.
+ * Each worker owns a contiguous range of sets and is fed through its own
+ * single-producer/single-consumer queue, so every set sees its accesses in
+ * trace order and the result matches a serial replay.
+ *
+ * A timed replay makes each access through an Mshr_File at the cycle the
+ * trace gives it (binary traces), or one access a cycle (text traces).
+ * With blocking set the trace is an in-order core: reads that take longer
+ * than a hit, and accesses that wait for an MSHR, push everything after
+ * them back. Otherwise the times in the trace are kept as they are.
+ *
+ * With an MMU the trace's addresses are virtual: each is translated, page
+ * walks and all, just before its access is made, so walks and the program
+ * share the cache in trace order.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sched.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "replay.h"
+
+/* accesses read from the trace at a time */
+#define REPLAY_BATCH 4096
+
+/* must be a power of two */
+#define QUEUE_SIZE 4096
+
+/* lock-free single-producer/single-consumer ring */
+typedef struct _Op_Queue {
+	_Atomic size_t head __attribute__((aligned(64))); /* next slot the worker reads */
+	_Atomic size_t tail __attribute__((aligned(64))); /* next slot the reader writes */
+	_Atomic int done;
+	Cache_Op ops[QUEUE_SIZE] __attribute__((aligned(64)));
+} Op_Queue;
+
+typedef struct _Worker {
+	pthread_t thread;
+	Op_Queue *queue;
+	Cache *cache;
+} Worker;
+
+/**
+ * Set up to read ops from a trace. Binary traces are recognised by their
+ * first byte; text traces are read as 'format' (TEXT_FORMAT_AUTO to guess).
+ */
+int replay_source_open(Replay_Source *source, FILE *file, int format, int data_only) {
+	int c = getc(file);
+	
+	memset(source, 0, sizeof(Replay_Source));
+	source->file = file;
+	source->data_only = data_only;
+	
+	if (c != EOF) {
+		ungetc(c, file);
+	}
+	
+	if (c != EOF && (unsigned char)c == (unsigned char)TRACE_MAGIC[0]) {
+		source->binary = trace_reader_open(file);
+		return (source->binary != NULL) ? 0 : -1;
+	}
+	
+	source->text = text_reader_open(file, format, data_only);
+	return (source->text != NULL) ? 0 : -1;
+}
+
+void replay_source_close(Replay_Source *source) {
+	trace_reader_close(source->binary);
+	text_reader_close(source->text);
+	source->binary = NULL;
+	source->text = NULL;
+}
+
+/**
+ * Fill ops with up to 'max' accesses. Returns 0 at the end of the trace;
+ * lines or records that don't parse are counted and skipped.
+ */
+static size_t next_ops(Replay_Source *source, Cache_Op *ops, size_t max) {
+	size_t n = 0;
+	
+	if (source->text != NULL) {
+		n = text_read(source->text, ops, max);
+		source->bad_records = text_reader_bad_lines(source->text);
+		
+		for (size_t i=0; i < n; i++) {
+			ops[i].cycle = source->count + i;
+		}
+		source->count += n;
+		return n;
+	}
+	
+	while (n < max && !source->finished) {
+		Trace_Record record;
+		int status = trace_read(source->binary, &record);
+		
+		if (status < 0) {
+			fprintf(stderr, "[!] Trace is damaged after record %llu.\n",
+				(unsigned long long)trace_reader_position(source->binary));
+			source->bad_records++;
+		}
+		
+		if (status != 1) {
+			source->finished = 1;
+			break;
+		}
+		
+		if (record.type == TRACE_IFETCH && source->data_only) {
+			continue;
+		}
+		
+		ops[n].address = record.address;
+		ops[n].cycle = record.cycle;
+		ops[n].is_write = (record.type == TRACE_WRITE);
+		ops[n].is_fetch = (record.type == TRACE_IFETCH);
+		ops[n].byte = record.value;
+		n++;
+	}
+	
+	source->count += n;
+	return n;
+}
+
+static void queue_push(Op_Queue *queue, const Cache_Op *op) {
+	size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+	
+	while (tail - atomic_load_explicit(&queue->head, memory_order_acquire) == QUEUE_SIZE) {
+		sched_yield();
+	}
+	
+	queue->ops[tail & (QUEUE_SIZE - 1)] = *op;
+	atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+}
+
+static void *replay_worker(void *arg) {
+	Worker *worker = arg;
+	Op_Queue *queue = worker->queue;
+	size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+	
+	while (1) {
+		size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+		
+		if (head == tail) {
+			/* check done before re-reading tail so the last ops aren't lost */
+			if (atomic_load_explicit(&queue->done, memory_order_acquire)
+				&& head == atomic_load_explicit(&queue->tail, memory_order_acquire)) {
+				break;
+			}
+			sched_yield();
+			continue;
+		}
+		
+		/* everything queued, in at most two runs either side of the wrap */
+		while (head != tail) {
+			size_t start = head & (QUEUE_SIZE - 1);
+			size_t run = tail - head;
+			
+			if (run > QUEUE_SIZE - start) {
+				run = QUEUE_SIZE - start;
+			}
+			
+			cache_access_batch(worker->cache, &queue->ops[start], run, NULL);
+			head += run;
+		}
+		
+		atomic_store_explicit(&queue->head, head, memory_order_release);
+	}
+	
+	return NULL;
+}
+
+static void replay_serial(Cache *cache, Replay_Source *source, Replay_Stats *stats) {
+	Cache_Op *batch = malloc(sizeof(Cache_Op) * REPLAY_BATCH);
+	size_t n;
+	
+	while ((n = next_ops(source, batch, REPLAY_BATCH)) > 0) {
+		if (source->mmu != NULL) {
+			for (size_t i=0; i < n; i++) {
+				mmu_translate(source->mmu, 0, batch[i].address, batch[i].is_fetch, 0, &batch[i].address);
+				cache_access_batch(cache, &batch[i], 1, NULL);
+			}
+		} else {
+			cache_access_batch(cache, batch, n, NULL);
+		}
+		stats->accesses += n;
+	}
+	
+	free(batch);
+}
+
+static void replay_parallel(Cache *cache, Replay_Source *source, int threads, Replay_Stats *stats) {
+	unsigned int num_sets = cache->config.num_sets;
+	Cache_Op *batch = malloc(sizeof(Cache_Op) * REPLAY_BATCH);
+	size_t n;
+	
+	/* worker w owns sets [w * num_sets / threads, (w + 1) * num_sets / threads) */
+	int *owner = malloc(sizeof(int) * num_sets);
+	for (unsigned int set=0; set < num_sets; set++) {
+		owner[set] = ((uint64_t)set * threads) / num_sets;
+	}
+	
+	Worker *workers = malloc(sizeof(Worker) * threads);
+	for (int w=0; w < threads; w++) {
+		if (posix_memalign((void **)&workers[w].queue, 64, sizeof(Op_Queue)) != 0) {
+			fprintf(stderr, "[!] Out of memory for replay queues.\n");
+			exit(1);
+		}
+		atomic_init(&workers[w].queue->head, 0);
+		atomic_init(&workers[w].queue->tail, 0);
+		atomic_init(&workers[w].queue->done, 0);
+		workers[w].cache = cache;
+		pthread_create(&workers[w].thread, NULL, replay_worker, &workers[w]);
+	}
+	
+	while ((n = next_ops(source, batch, REPLAY_BATCH)) > 0) {
+		for (size_t i=0; i < n; i++) {
+			queue_push(workers[owner[address_index(cache, batch[i].address)]].queue, &batch[i]);
+		}
+		stats->accesses += n;
+	}
+	
+	for (int w=0; w < threads; w++) {
+		atomic_store_explicit(&workers[w].queue->done, 1, memory_order_release);
+	}
+	
+	for (int w=0; w < threads; w++) {
+		pthread_join(workers[w].thread, NULL);
+		free(workers[w].queue);
+	}
+	
+	free(workers);
+	free(owner);
+	free(batch);
+}
+
+/**
+ * Replay a trace against the cache, using up to 'threads' workers.
+ * Returns the number of lines or records that could not be read.
+ */
+int replay_trace(Cache *cache, Replay_Source *source, int threads, Replay_Stats *stats) {
+	memset(stats, 0, sizeof(Replay_Stats));
+	
+	if (threads < 1 || source->mmu != NULL) {
+		threads = 1;
+	} else if ((unsigned int)threads > cache->config.num_sets) {
+		threads = cache->config.num_sets;
+	}
+	stats->threads = threads;
+	
+	if (threads == 1) {
+		replay_serial(cache, source, stats);
+	} else {
+		replay_parallel(cache, source, threads, stats);
+	}
+	
+	stats->skipped = source->bad_records;
+	return source->bad_records;
+}
+
+/**
+ * Replay a trace through an MSHR file on one thread. Returns the number
+ * of lines or records that could not be read.
+ */
+int replay_timed(Mshr_File *file, Replay_Source *source, int blocking, Replay_Stats *stats) {
+	Cache_Op *batch = malloc(sizeof(Cache_Op) * REPLAY_BATCH);
+	uint32_t hit_latency = file->config.hit_latency;
+	size_t n;
+	
+	memset(stats, 0, sizeof(Replay_Stats));
+	stats->threads = 1;
+	
+	while ((n = next_ops(source, batch, REPLAY_BATCH)) > 0) {
+		for (size_t i=0; i < n; i++) {
+			uint64_t issue = batch[i].cycle + stats->delay;
+			uint64_t start = issue;
+			
+			if (source->mmu != NULL) {
+				issue = mmu_translate(source->mmu, 0, batch[i].address, batch[i].is_fetch, issue, &batch[i].address);
+			}
+			
+			uint64_t ready = mshr_access(file, issue, &batch[i]);
+			
+			if (blocking && ready > start + hit_latency) {
+				stats->delay += ready - (start + hit_latency);
+			}
+		}
+		stats->accesses += n;
+	}
+	
+	stats->cycles = file->stats.last - file->stats.first;
+	stats->skipped = source->bad_records;
+	
+	free(batch);
+	return source->bad_records;
+}
+
+/**
+ * Per set counters followed by the merged totals
+ */
+void print_replay_stats(const Cache *cache, const Replay_Stats *stats) {
+	Cache_Set total;
+	
+	printf("Set\tReads\tWrites\tHits\tMisses\tWritebacks\n");
+	
+	for (unsigned int n=0; n < cache->config.num_sets; n++) {
+		const Cache_Set *set = &cache->sets[n];
+		
+		printf("%x\t%llu\t%llu\t%llu\t%llu\t%llu\n", n,
+			(unsigned long long)set->reads,
+			(unsigned long long)set->writes,
+			(unsigned long long)set->hits,
+			(unsigned long long)set->misses,
+			(unsigned long long)set->writebacks);
+	}
+	
+	cache_totals(cache, &total);
+	
+	printf("Total\t%llu\t%llu\t%llu\t%llu\t%llu\n",
+		(unsigned long long)total.reads,
+		(unsigned long long)total.writes,
+		(unsigned long long)total.hits,
+		(unsigned long long)total.misses,
+		(unsigned long long)total.writebacks);
+	
+	printf("\n%llu accesses, %llu skipped, %d thread(s), hit rate %.2f%%\n",
+		(unsigned long long)stats->accesses,
+		(unsigned long long)stats->skipped,
+		stats->threads,
+		total.reads + total.writes ? 100.0 * total.hits / (total.reads + total.writes) : 0.0);
+}
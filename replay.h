@@ -0,0 +1,45 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Trace replay for the cache simulator
+ */
+
+#ifndef Replay_h
+#define Replay_h
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "cache.h"
+#include "trace.h"
+#include "text_trace.h"
+#include "mshr.h"
+#include "mmu.h"
+
+/* where replayed accesses come from */
+typedef struct _Replay_Source {
+	FILE *file;
+	Trace_Reader *binary; /* one of these two is set */
+	Text_Reader *text;
+	int data_only;        /* skip instruction fetches */
+	Mmu *mmu;             /* if set, addresses are virtual, in ASID 0; one thread only */
+	int finished;
+	uint64_t count;       /* ops read so far; the time of text trace ops */
+	uint64_t bad_records;
+} Replay_Source;
+
+typedef struct _Replay_Stats {
+	uint64_t accesses;
+	uint64_t skipped;
+	int threads;
+	uint64_t cycles;  /* timed replay only: first access to last completion */
+	uint64_t delay;   /* ... and of those, cycles the trace was held back */
+} Replay_Stats;
+
+int replay_source_open(Replay_Source *source, FILE *file, int format, int data_only);
+void replay_source_close(Replay_Source *source);
+
+int replay_trace(Cache *cache, Replay_Source *source, int threads, Replay_Stats *stats);
+int replay_timed(Mshr_File *file, Replay_Source *source, int blocking, Replay_Stats *stats);
+void print_replay_stats(const Cache *cache, const Replay_Stats *stats);
+
+#endif
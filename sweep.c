@@ -0,0 +1,202 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Run many independent pipeline simulations across a pool of threads
+ *
+ * Each job gets its own Core, so workers share nothing but the job list
+ * and an atomic index into it. Jobs here sweep the initial register
+ * values of the pipeline fragment; results are checksummed in job order so
+ * a parallel run can be checked against a serial one (-v).
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "pipeline.h"
+
+typedef struct _Sweep_Job {
+	const uint32_t *program;
+	size_t program_length;
+	size_t memory_size;
+	int32_t register_base;
+	
+	/* results */
+	uint64_t cycles;
+	uint32_t checksum;
+	int failed;
+} Sweep_Job;
+
+typedef struct _Sweep_Pool {
+	Sweep_Job *jobs;
+	size_t num_jobs;
+	_Atomic size_t next;
+} Sweep_Pool;
+
+/**
+ * FNV-1a over the architectural state: registers then memory
+ */
+static uint32_t core_checksum(const Core *core) {
+	uint32_t hash = 2166136261u;
+	
+	for (int n=0; n < NUM_REGISTERS; n++) {
+		hash = (hash ^ (uint32_t)core->registers[n]) * 16777619u;
+	}
+	
+	for (size_t n=0; n < core->memory_size; n++) {
+		hash = (hash ^ core->main_memory[n]) * 16777619u;
+	}
+	
+	return hash;
+}
+
+static void run_job(Sweep_Job *job) {
+	Core *core = core_create(job->program, job->program_length, job->memory_size);
+	
+	if (core == NULL) {
+		job->failed = 1;
+		return;
+	}
+	
+	core->register_base = job->register_base;
+	core_reset(core);
+	
+	job->cycles = core_run(core);
+	job->checksum = core_checksum(core);
+	job->failed = 0;
+	
+	core_destroy(core);
+}
+
+static void *sweep_worker(void *arg) {
+	Sweep_Pool *pool = arg;
+	size_t n;
+	
+	while ((n = atomic_fetch_add_explicit(&pool->next, 1, memory_order_relaxed)) < pool->num_jobs) {
+		run_job(&pool->jobs[n]);
+	}
+	
+	return NULL;
+}
+
+/**
+ * Run every job on 'threads' worker threads
+ */
+void sweep_run(Sweep_Job *jobs, size_t num_jobs, int threads) {
+	Sweep_Pool pool;
+	pthread_t *workers = malloc(sizeof(pthread_t) * threads);
+	
+	pool.jobs = jobs;
+	pool.num_jobs = num_jobs;
+	atomic_init(&pool.next, 0);
+	
+	for (int t=0; t < threads; t++) {
+		pthread_create(&workers[t], NULL, sweep_worker, &pool);
+	}
+	
+	for (int t=0; t < threads; t++) {
+		pthread_join(workers[t], NULL);
+	}
+	
+	free(workers);
+}
+
+static double now_sec() {
+	struct timespec ts;
+	
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void make_jobs(Sweep_Job *jobs, size_t num_jobs) {
+	for (size_t n=0; n < num_jobs; n++) {
+		memset(&jobs[n], 0, sizeof(Sweep_Job));
+		jobs[n].program = instructions;
+		jobs[n].program_length = sizeof(instructions)/sizeof(uint32_t);
+		jobs[n].memory_size = MEMORY_SIZE;
+		jobs[n].register_base = 0x100 + n;
+	}
+}
+
+static uint32_t combine_results(const Sweep_Job *jobs, size_t num_jobs, uint64_t *cycles, size_t *failed) {
+	uint32_t hash = 2166136261u;
+	
+	*cycles = 0;
+	*failed = 0;
+	
+	for (size_t n=0; n < num_jobs; n++) {
+		hash = (hash ^ jobs[n].checksum) * 16777619u;
+		*cycles += jobs[n].cycles;
+		*failed += jobs[n].failed;
+	}
+	
+	return hash;
+}
+
+/* main */
+int main(int argc, char *argv[]) {
+	int threads = 1;
+	size_t num_jobs = 10000;
+	int verify = 0;
+	
+	for (int i=1; i < argc; i++) {
+		if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+			threads = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+			num_jobs = strtoul(argv[++i], NULL, 10);
+		} else if (strcmp(argv[i], "-v") == 0) {
+			verify = 1;
+		} else {
+			fprintf(stderr, "usage: %s [-j threads] [-n simulations] [-v]\n", argv[0]);
+			return 2;
+		}
+	}
+	
+	if (threads < 1) {
+		threads = 1;
+	}
+	
+	Sweep_Job *jobs = malloc(sizeof(Sweep_Job) * num_jobs);
+	make_jobs(jobs, num_jobs);
+	
+	double start = now_sec();
+	sweep_run(jobs, num_jobs, threads);
+	double elapsed = now_sec() - start;
+	
+	uint64_t cycles;
+	size_t failed;
+	uint32_t checksum = combine_results(jobs, num_jobs, &cycles, &failed);
+	
+	printf("Simulations\tThreads\tCycles\tFailed\tSeconds\tSims/s\tChecksum\n");
+	printf("%zu\t%d\t%llu\t%zu\t%.3f\t%.0f\t%08x\n",
+		num_jobs, threads, (unsigned long long)cycles, failed,
+		elapsed, elapsed > 0 ? num_jobs / elapsed : 0.0, checksum);
+	
+	if (verify) {
+		Sweep_Job *serial = malloc(sizeof(Sweep_Job) * num_jobs);
+		size_t mismatches = 0;
+		
+		make_jobs(serial, num_jobs);
+		for (size_t n=0; n < num_jobs; n++) {
+			run_job(&serial[n]);
+			
+			if (serial[n].checksum != jobs[n].checksum || serial[n].cycles != jobs[n].cycles) {
+				mismatches++;
+			}
+		}
+		
+		printf("Verify: %zu of %zu simulations differ from a serial run\n", mismatches, num_jobs);
+		free(serial);
+		
+		if (mismatches > 0) {
+			free(jobs);
+			return 1;
+		}
+	}
+	
+	free(jobs);
+	return failed > 0;
+}
@@ -0,0 +1,343 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * System call emulation
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "core.h"
+#include "syscall.h"
+
+#define V0 2
+#define A0 4
+#define A1 5
+#define A2 6
+#define A3 7
+
+/* errnos as MIPS Linux numbers them; the host's agree below 35 */
+#define MIPS_EBADF 9
+#define MIPS_ENOMEM 12
+#define MIPS_EFAULT 14
+#define MIPS_ENODEV 19
+#define MIPS_EINVAL 22
+#define MIPS_ENOSYS 89
+
+#define MIPS_MAP_ANONYMOUS 0x800
+#define MMAP_PAGE 4096
+
+static const char *kind_names[SYSCALL_KINDS] = {
+	"exit", "read", "write", "brk", "mmap", "clock_gettime", "unknown"
+};
+
+/**
+ * 'size' bytes of simulated memory at 'address', or NULL if they aren't all
+ * there. Memory is one block, so the host can read and write it in place.
+ */
+static uint8_t *guest_memory(Core *core, uint32_t address, uint32_t size) {
+	uint32_t offset = address - core->data_base;
+	
+	if (offset > core->memory_size || size > core->memory_size - offset) {
+		return NULL;
+	}
+	
+	return core->main_memory + offset;
+}
+
+static void put_guest_word(uint8_t *p, uint32_t value) {
+	for (int i=0; i < 4; i++) {
+		p[i] = value >> (24 - 8 * i);
+	}
+}
+
+static int host_fd(const Core *core, int32_t fd) {
+	return fd >= 0 && fd < SYSCALL_FDS ? core->syscalls.host_fd[fd] : -1;
+}
+
+/* results are the value returned, or minus an errno */
+static int64_t host_write(Core *core, int32_t fd, const void *data, size_t size) {
+	int host = host_fd(core, fd);
+	
+	if (host < 0) {
+		return -MIPS_EBADF;
+	}
+	
+	/* keep the program's output in order with the simulator's */
+	fflush(stdout);
+	
+	ssize_t written = write(host, data, size);
+	if (written < 0) {
+		return -errno;
+	}
+	
+	core->syscalls.bytes[SYSCALL_WRITE] += written;
+	return written;
+}
+
+static int64_t sys_write(Core *core, int32_t fd, uint32_t buf, uint32_t count) {
+	const uint8_t *p = guest_memory(core, buf, count);
+	
+	return p == NULL ? -MIPS_EFAULT : host_write(core, fd, p, count);
+}
+
+static int64_t sys_read(Core *core, int32_t fd, uint32_t buf, uint32_t count) {
+	uint8_t *p = guest_memory(core, buf, count);
+	int host = host_fd(core, fd);
+	
+	if (host < 0) {
+		return -MIPS_EBADF;
+	}
+	
+	if (p == NULL) {
+		return -MIPS_EFAULT;
+	}
+	
+	ssize_t got = read(host, p, count);
+	if (got < 0) {
+		return -errno;
+	}
+	
+	core->syscalls.bytes[SYSCALL_READ] += got;
+	return got;
+}
+
+static int64_t sys_exit(Core *core, int32_t code) {
+	core->syscalls.exited = 1;
+	core->syscalls.exit_code = code;
+	return 0;
+}
+
+/* Linux brk(): asking for the impossible just returns the break */
+static int64_t sys_brk(Core *core, uint32_t address) {
+	Syscall_State *sys = &core->syscalls;
+	
+	if (address >= sys->heap_base && address <= sys->mmap_top) {
+		sys->brk = address;
+	}
+	
+	return sys->brk;
+}
+
+/* SPIM sbrk(): returns the old break */
+static int64_t sys_sbrk(Core *core, int32_t increment) {
+	Syscall_State *sys = &core->syscalls;
+	uint32_t old = sys->brk;
+	int64_t brk = (int64_t)old + increment;
+	
+	if (brk < sys->heap_base || brk > sys->mmap_top) {
+		return -MIPS_ENOMEM;
+	}
+	
+	sys->brk = brk;
+	return old;
+}
+
+/**
+ * Anonymous maps only: the descriptors a program has are the simulator's
+ * own, which can't be mapped. The address asked for is only a hint and is
+ * ignored.
+ */
+static int64_t sys_mmap(Core *core, uint32_t length, uint32_t flags) {
+	Syscall_State *sys = &core->syscalls;
+	
+	if (!(flags & MIPS_MAP_ANONYMOUS)) {
+		return -MIPS_ENODEV;
+	}
+	
+	length = (length + MMAP_PAGE - 1) & ~(uint32_t)(MMAP_PAGE - 1);
+	if (length == 0) {
+		return -MIPS_EINVAL;
+	}
+	
+	if (sys->mmap_top - sys->brk < length) {
+		return -MIPS_ENOMEM;
+	}
+	
+	uint8_t *p = guest_memory(core, sys->mmap_top - length, length);
+	memset(p, 0, length);
+	
+	sys->mmap_top -= length;
+	return sys->mmap_top;
+}
+
+/* simulated time, a nanosecond a cycle */
+static int64_t sys_clock_gettime(Core *core, uint32_t tp) {
+	uint8_t *p = guest_memory(core, tp, 8);
+	
+	if (p == NULL) {
+		return -MIPS_EFAULT;
+	}
+	
+	put_guest_word(p, core->cycles / 1000000000);
+	put_guest_word(p + 4, core->cycles % 1000000000);
+	return 0;
+}
+
+static int64_t sys_print_string(Core *core, uint32_t address) {
+	const uint8_t *p = guest_memory(core, address, 0);
+	
+	if (p == NULL) {
+		return -MIPS_EFAULT;
+	}
+	
+	/* up to the end of memory if it isn't terminated */
+	const uint8_t *end = memchr(p, 0, core->main_memory + core->memory_size - p);
+	
+	return host_write(core, 1, p, (end != NULL ? end : core->main_memory + core->memory_size) - p);
+}
+
+static int64_t sys_print_int(Core *core, int32_t value) {
+	char text[16];
+	
+	return host_write(core, 1, text, snprintf(text, sizeof(text), "%d", value));
+}
+
+/**
+ * Put the heap and mmap() regions back where they start and every
+ * descriptor back on the simulator's
+ */
+void syscall_reset(Core *core) {
+	Syscall_State *sys = &core->syscalls;
+	uint32_t data_end = core->data_base + (core->image != NULL ? core->image->data_size : 0);
+	
+	memset(sys, 0, sizeof(Syscall_State));
+	
+	sys->heap_base = (data_end + 7) & ~7u;
+	sys->brk = sys->heap_base;
+	sys->mmap_top = sys->brk;
+	
+	if (core->memory_size > STACK_SIZE) {
+		uint32_t below_stack = (core->data_base + core->memory_size - STACK_SIZE) & ~(uint32_t)(MMAP_PAGE - 1);
+		
+		if (below_stack > sys->brk) {
+			sys->mmap_top = below_stack;
+		}
+	}
+	
+	for (int n=0; n < SYSCALL_FDS; n++) {
+		sys->host_fd[n] = n;
+	}
+}
+
+/**
+ * Run the syscall in ID. The pipeline ahead of it has drained, so memory
+ * and the registers are as the program left them.
+ */
+void syscall_execute(Core *core) {
+	Syscall_State *sys = &core->syscalls;
+	int32_t *reg = core->registers;
+	int32_t number = reg[V0];
+	int64_t result = 0;
+	int kind;
+	struct timespec start, end;
+	
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	
+	switch (number) {
+		case 4001: /* exit */
+		case 4246: /* exit_group */
+		case 17: /* exit2 */
+			kind = SYSCALL_EXIT;
+			result = sys_exit(core, reg[A0]);
+			break;
+		
+		case 10: /* exit */
+			kind = SYSCALL_EXIT;
+			result = sys_exit(core, 0);
+			break;
+		
+		case 4003: /* read */
+		case 14:
+			kind = SYSCALL_READ;
+			result = sys_read(core, reg[A0], reg[A1], reg[A2]);
+			break;
+		
+		case 4004: /* write */
+		case 15:
+			kind = SYSCALL_WRITE;
+			result = sys_write(core, reg[A0], reg[A1], reg[A2]);
+			break;
+		
+		case 1: /* print_int */
+			kind = SYSCALL_WRITE;
+			result = sys_print_int(core, reg[A0]);
+			break;
+		
+		case 4: /* print_string */
+			kind = SYSCALL_WRITE;
+			result = sys_print_string(core, reg[A0]);
+			break;
+		
+		case 11: /* print_char */
+			kind = SYSCALL_WRITE;
+			result = host_write(core, 1, &(char){ reg[A0] }, 1);
+			break;
+		
+		case 4045: /* brk */
+			kind = SYSCALL_BRK;
+			result = sys_brk(core, reg[A0]);
+			break;
+		
+		case 9: /* sbrk */
+			kind = SYSCALL_BRK;
+			result = sys_sbrk(core, reg[A0]);
+			break;
+		
+		case 4090: /* mmap */
+			kind = SYSCALL_MMAP;
+			result = sys_mmap(core, reg[A1], reg[A3]);
+			break;
+		
+		case 4263: /* clock_gettime */
+			kind = SYSCALL_CLOCK;
+			result = sys_clock_gettime(core, reg[A1]);
+			break;
+		
+		default:
+			kind = SYSCALL_UNKNOWN;
+			result = -MIPS_ENOSYS;
+			break;
+	}
+	
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	sys->calls[kind]++;
+	sys->host_ns[kind] += (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+	
+	if (number >= 4000) {
+		reg[V0] = result < 0 ? -result : result;
+		reg[A3] = result < 0;
+	} else if (number == 9 || number == 14 || number == 15) {
+		reg[V0] = result < 0 ? -1 : result;
+	}
+}
+
+void print_syscall_stats(const Core *core) {
+	const Syscall_State *sys = &core->syscalls;
+	uint64_t calls = 0;
+	uint64_t host_ns = 0;
+	
+	printf("Syscall\tCalls\tBytes\tHost us\n");
+	
+	for (int n=0; n < SYSCALL_KINDS; n++) {
+		if (sys->calls[n] > 0) {
+			printf("%s\t%llu\t%llu\t%.1f\n", kind_names[n],
+				(unsigned long long)sys->calls[n],
+				(unsigned long long)sys->bytes[n],
+				sys->host_ns[n] / 1000.0);
+		}
+		calls += sys->calls[n];
+		host_ns += sys->host_ns[n];
+	}
+	
+	printf("%llu syscalls, %.1f us of host time", (unsigned long long)calls, host_ns / 1000.0);
+	
+	if (sys->exited) {
+		printf(", exited with %d", sys->exit_code);
+	}
+	printf("\n");
+}
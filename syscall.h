@@ -0,0 +1,60 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * System call emulation for programs run on the pipeline
+ *
+ * A syscall takes its number in $v0 and arguments in $a0-$a3. Numbers from
+ * 4000 are Linux o32 calls: the result comes back in $v0 with $a3 clear,
+ * or an errno in $v0 with $a3 set. Smaller numbers are SPIM's services,
+ * which return -1 on an error.
+ *
+ *   Linux   exit 4001, read 4003, write 4004, brk 4045, mmap 4090,
+ *           exit_group 4246, clock_gettime 4263
+ *   SPIM    print_int 1, print_string 4, sbrk 9, exit 10, print_char 11,
+ *           read 14, write 15, exit2 17
+ *
+ * Descriptors 0-2 are the simulator's own, and reads and writes go
+ * straight between them and simulated memory. The heap grows up from the
+ * end of the image's data, mmap() regions down from below the stack; only
+ * anonymous maps are supported.
+ * clock_gettime() counts simulated cycles as nanoseconds, so programs see
+ * the same time on every run.
+ */
+
+#ifndef Syscall_h
+#define Syscall_h
+
+#include <stdint.h>
+
+/* descriptors a program can use */
+#define SYSCALL_FDS 3
+
+/* what the calls are counted as */
+#define SYSCALL_EXIT 0
+#define SYSCALL_READ 1
+#define SYSCALL_WRITE 2
+#define SYSCALL_BRK 3
+#define SYSCALL_MMAP 4
+#define SYSCALL_CLOCK 5
+#define SYSCALL_UNKNOWN 6
+#define SYSCALL_KINDS 7
+
+struct _Core;
+
+typedef struct _Syscall_State {
+	uint32_t heap_base;
+	uint32_t brk;      /* end of the heap ... */
+	uint32_t mmap_top; /* ... which mmap()ed regions grow down towards */
+	int exited;
+	int32_t exit_code;
+	int host_fd[SYSCALL_FDS]; /* -1 for closed */
+	
+	uint64_t calls[SYSCALL_KINDS];
+	uint64_t bytes[SYSCALL_KINDS];   /* moved by reads and writes */
+	uint64_t host_ns[SYSCALL_KINDS]; /* spent emulating them */
+} Syscall_State;
+
+void syscall_reset(struct _Core *core);
+void syscall_execute(struct _Core *core);
+void print_syscall_stats(const struct _Core *core);
+
+#endif
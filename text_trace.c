@@ -0,0 +1,417 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Text trace readers: cachesim commands, Dinero din and Valgrind lackey
+ *
+ * Traces from tracers run to gigabytes, so this doesn't go through fgets
+ * and strtol. The file is read a megabyte at a time, lines are found with
+ * memchr (vectorised in any decent libc) and fields are parsed by hand
+ * with a hex digit table, straight into Cache_Ops.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "text_trace.h"
+
+#define TEXT_BUFFER_SIZE (1 << 20)
+
+struct _Text_Reader {
+	FILE *file;
+	int format;
+	int data_only;
+	int eof;
+	
+	char *buffer;
+	size_t start; /* first unparsed byte */
+	size_t end;   /* one past the last byte read */
+	
+	/* second half of a lackey modify that didn't fit in the last batch */
+	int pending;
+	Cache_Op pending_op;
+	
+	uint64_t bad_lines;
+	int skipping; /* in the rest of a line too long for the buffer */
+};
+
+/* value of each hex digit, -1 for anything else */
+static signed char hex_value[256];
+static int hex_table_built = 0;
+
+static void build_hex_table() {
+	memset(hex_value, -1, sizeof(hex_value));
+	hex_table_built = 1;
+	
+	for (int c='0'; c <= '9'; c++) {
+		hex_value[c] = c - '0';
+	}
+	
+	for (int c='a'; c <= 'f'; c++) {
+		hex_value[c] = c - 'a' + 10;
+		hex_value[c - 'a' + 'A'] = c - 'a' + 10;
+	}
+}
+
+static inline const char *skip_blanks(const char *p, const char *end) {
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+		p++;
+	}
+	
+	return p;
+}
+
+/**
+ * Parse a hex number, with or without 0x. Returns NULL if there are no digits.
+ */
+static inline const char *parse_hex(const char *p, const char *end, uint64_t *value) {
+	uint64_t v = 0;
+	const char *digits;
+	
+	if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+		p += 2;
+	}
+	
+	for (digits = p; p < end && hex_value[(unsigned char)*p] >= 0; p++) {
+		v = (v << 4) | hex_value[(unsigned char)*p];
+	}
+	
+	if (p == digits) {
+		return NULL;
+	}
+	
+	*value = v;
+	return p;
+}
+
+/*
+ * Each line parser fills ops[] and returns how many it produced (0 for a
+ * line to ignore) or -1 for a line it doesn't understand.
+ */
+
+static int parse_command_line(const char *p, const char *end, Cache_Op *ops) {
+	uint64_t value;
+	
+	p = skip_blanks(p, end);
+	if (p == end || *p == '#') {
+		return 0;
+	}
+	
+	if (*p != 'r' && *p != 'w') {
+		return -1;
+	}
+	
+	ops[0].is_write = (*p == 'w');
+	ops[0].is_fetch = 0;
+	ops[0].byte = 0;
+	
+	if ((p = parse_hex(skip_blanks(p + 1, end), end, &ops[0].address)) == NULL) {
+		return -1;
+	}
+	
+	if (ops[0].is_write) {
+		if (parse_hex(skip_blanks(p, end), end, &value) == NULL) {
+			return -1;
+		}
+		ops[0].byte = (unsigned char)value;
+	}
+	
+	return 1;
+}
+
+static int parse_din_line(const char *p, const char *end, Cache_Op *ops, int data_only) {
+	p = skip_blanks(p, end);
+	if (p == end || *p == '#') {
+		return 0;
+	}
+	
+	if (*p < '0' || *p > '9') {
+		return -1;
+	}
+	
+	int label = *p - '0';
+	
+	if (parse_hex(skip_blanks(p + 1, end), end, &ops[0].address) == NULL) {
+		return -1;
+	}
+	
+	ops[0].byte = 0;
+	ops[0].is_fetch = (label == 2);
+	
+	switch (label) {
+		case 0: /* read */
+			ops[0].is_write = 0;
+			return 1;
+			
+		case 1: /* write */
+			ops[0].is_write = 1;
+			return 1;
+			
+		case 2: /* instruction fetch */
+			ops[0].is_write = 0;
+			return data_only ? 0 : 1;
+			
+		case 3: /* escapes and flushes; nothing for us to do */
+		case 4:
+			return 0;
+			
+		default:
+			return -1;
+	}
+}
+
+static int parse_lackey_line(const char *p, const char *end, Cache_Op *ops, int data_only) {
+	/* valgrind's own chatter */
+	if (end - p >= 2 && p[0] == '=' && p[1] == '=') {
+		return 0;
+	}
+	
+	p = skip_blanks(p, end);
+	if (p == end) {
+		return 0;
+	}
+	
+	char kind = *p;
+	const char *q = parse_hex(skip_blanks(p + 1, end), end, &ops[0].address);
+	
+	if (q == NULL || q == end || *q != ',') {
+		return -1;
+	}
+	
+	ops[0].byte = 0;
+	ops[0].is_fetch = (kind == 'I');
+	
+	switch (kind) {
+		case 'I':
+			ops[0].is_write = 0;
+			return data_only ? 0 : 1;
+			
+		case 'L':
+			ops[0].is_write = 0;
+			return 1;
+			
+		case 'S':
+			ops[0].is_write = 1;
+			return 1;
+			
+		case 'M':
+			ops[0].is_write = 0;
+			ops[1] = ops[0];
+			ops[1].is_write = 1;
+			return 2;
+			
+		default:
+			return -1;
+	}
+}
+
+/**
+ * Top up the buffer, keeping the unparsed tail. Returns 0 at end of file.
+ */
+static int refill(Text_Reader *reader) {
+	if (reader->eof) {
+		return 0;
+	}
+	
+	memmove(reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+	reader->end -= reader->start;
+	reader->start = 0;
+	
+	size_t n = fread(reader->buffer + reader->end, 1, TEXT_BUFFER_SIZE - reader->end, reader->file);
+	reader->end += n;
+	
+	if (n == 0) {
+		reader->eof = 1;
+		return 0;
+	}
+	
+	return 1;
+}
+
+/**
+ * Guess the format from the first line that says anything
+ */
+static int detect_format(Text_Reader *reader) {
+	const char *p = reader->buffer + reader->start;
+	const char *end = reader->buffer + reader->end;
+	
+	while (p < end) {
+		const char *eol = memchr(p, '\n', end - p);
+		const char *line_end = eol ? eol : end;
+		const char *c = skip_blanks(p, line_end);
+		
+		if (line_end - p >= 2 && p[0] == '=' && p[1] == '=') {
+			return TEXT_FORMAT_LACKEY;
+		}
+		
+		if (c < line_end && *c != '#') {
+			if (*c == 'r' || *c == 'w') {
+				return TEXT_FORMAT_COMMANDS;
+			}
+			
+			if (*c >= '0' && *c <= '9') {
+				return TEXT_FORMAT_DIN;
+			}
+			
+			if (memchr(c, ',', line_end - c) != NULL) {
+				return TEXT_FORMAT_LACKEY;
+			}
+			
+			return TEXT_FORMAT_COMMANDS;
+		}
+		
+		if (eol == NULL) {
+			break;
+		}
+		p = eol + 1;
+	}
+	
+	return TEXT_FORMAT_COMMANDS;
+}
+
+Text_Reader *text_reader_open(FILE *file, int format, int data_only) {
+	Text_Reader *reader = calloc(1, sizeof(Text_Reader));
+	
+	if (reader == NULL) {
+		return NULL;
+	}
+	
+	reader->buffer = malloc(TEXT_BUFFER_SIZE);
+	if (reader->buffer == NULL) {
+		free(reader);
+		return NULL;
+	}
+	
+	if (!hex_table_built) {
+		build_hex_table();
+	}
+	
+	reader->file = file;
+	reader->data_only = data_only;
+	
+	refill(reader);
+	reader->format = (format == TEXT_FORMAT_AUTO) ? detect_format(reader) : format;
+	
+	return reader;
+}
+
+/**
+ * Parse up to 'max' accesses into ops. Returns 0 at the end of the trace.
+ */
+size_t text_read(Text_Reader *reader, Cache_Op *ops, size_t max) {
+	Cache_Op line_ops[2];
+	size_t n = 0;
+	
+	if (reader->pending && n < max) {
+		ops[n++] = reader->pending_op;
+		reader->pending = 0;
+	}
+	
+	while (n < max) {
+		char *p = reader->buffer + reader->start;
+		char *end = reader->buffer + reader->end;
+		char *eol = memchr(p, '\n', end - p);
+		
+		/* already counted as bad, so drop it up to its newline */
+		if (reader->skipping) {
+			if (eol == NULL) {
+				reader->start = reader->end;
+				if (refill(reader)) {
+					continue;
+				}
+				break;
+			}
+			
+			reader->start = (size_t)(eol + 1 - reader->buffer);
+			reader->skipping = 0;
+			continue;
+		}
+		
+		if (eol == NULL) {
+			if (refill(reader)) {
+				continue;
+			}
+			
+			if (reader->start == reader->end) {
+				break;
+			}
+			
+			if (reader->end == TEXT_BUFFER_SIZE && reader->start == 0) {
+				/* a line longer than the whole buffer */
+				reader->bad_lines++;
+				reader->start = reader->end;
+				reader->eof = 0;
+				reader->skipping = 1;
+				continue;
+			}
+			
+			/* last line without a newline */
+			eol = end;
+		}
+		
+		int count;
+		switch (reader->format) {
+			case TEXT_FORMAT_DIN:
+				count = parse_din_line(p, eol, line_ops, reader->data_only);
+				break;
+				
+			case TEXT_FORMAT_LACKEY:
+				count = parse_lackey_line(p, eol, line_ops, reader->data_only);
+				break;
+				
+			default:
+				count = parse_command_line(p, eol, line_ops);
+				break;
+		}
+		
+		reader->start = (eol == end) ? reader->end : (size_t)(eol + 1 - reader->buffer);
+		
+		if (count < 0) {
+			reader->bad_lines++;
+			continue;
+		}
+		
+		for (int i=0; i < count; i++) {
+			if (n < max) {
+				ops[n++] = line_ops[i];
+			} else {
+				reader->pending_op = line_ops[i];
+				reader->pending = 1;
+			}
+		}
+	}
+	
+	return n;
+}
+
+int text_reader_format(const Text_Reader *reader) {
+	return reader->format;
+}
+
+uint64_t text_reader_bad_lines(const Text_Reader *reader) {
+	return reader->bad_lines;
+}
+
+void text_reader_close(Text_Reader *reader) {
+	if (reader != NULL) {
+		free(reader->buffer);
+		free(reader);
+	}
+}
+
+/**
+ * "cmd", "din" or "lackey"; -1 for anything else
+ */
+int text_format_from_name(const char *name) {
+	if (strcmp(name, "cmd") == 0) {
+		return TEXT_FORMAT_COMMANDS;
+	} else if (strcmp(name, "din") == 0) {
+		return TEXT_FORMAT_DIN;
+	} else if (strcmp(name, "lackey") == 0) {
+		return TEXT_FORMAT_LACKEY;
+	} else if (strcmp(name, "auto") == 0) {
+		return TEXT_FORMAT_AUTO;
+	}
+	
+	return -1;
+}
@@ -0,0 +1,36 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Text trace readers: cachesim commands, Dinero din and Valgrind lackey
+ *
+ *   commands   r 7ae / w 7ae 2b
+ *   din        <label> <hex address>, label 0 read, 1 write, 2 fetch
+ *   lackey     "I  04010173,3", " L 1ffefffd48,8", " S ...", " M ..."
+ *
+ * Lackey modifies (M) replay as a read then a write. Text traces carry no
+ * data, so writes other than cachesim's own commands store 0.
+ */
+
+#ifndef Text_trace_h
+#define Text_trace_h
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "cache.h"
+
+#define TEXT_FORMAT_AUTO 0
+#define TEXT_FORMAT_COMMANDS 1
+#define TEXT_FORMAT_DIN 2
+#define TEXT_FORMAT_LACKEY 3
+
+typedef struct _Text_Reader Text_Reader;
+
+Text_Reader *text_reader_open(FILE *file, int format, int data_only);
+size_t text_read(Text_Reader *reader, Cache_Op *ops, size_t max);
+int text_reader_format(const Text_Reader *reader);
+uint64_t text_reader_bad_lines(const Text_Reader *reader);
+void text_reader_close(Text_Reader *reader);
+
+int text_format_from_name(const char *name);
+
+#endif
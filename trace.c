@@ -0,0 +1,479 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Compressed memory/instruction trace files
+ */
+
+#define _FILE_OFFSET_BITS 64
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "trace.h"
+
+#define BLOCK_MAGIC "BLK0"
+#define INDEX_MAGIC "IDX0"
+#define END_MAGIC "END0"
+
+#define BLOCK_HEADER_SIZE 20
+#define TRAILER_SIZE 12
+
+/* kind byte, two 10 byte varints and a value */
+#define MAX_RECORD_SIZE 22
+
+typedef struct _Block_Entry {
+	uint64_t offset;
+	uint64_t first_record;
+} Block_Entry;
+
+struct _Trace_Writer {
+	FILE *file;
+	uint64_t file_offset; /* tracked by hand, ftell doesn't work on pipes */
+	
+	unsigned char *payload;
+	size_t payload_size;
+	uint32_t block_records;
+	uint64_t records;
+	
+	uint64_t prev_address[3];
+	uint64_t prev_cycle;
+	
+	Block_Entry *blocks;
+	uint32_t num_blocks;
+	uint32_t max_blocks;
+};
+
+struct _Trace_Reader {
+	FILE *file;
+	
+	unsigned char *payload;
+	size_t payload_size;
+	size_t payload_pos;
+	uint32_t block_records; /* records left in this block */
+	uint64_t position;      /* index of the next record */
+	
+	uint64_t prev_address[3];
+	uint64_t prev_cycle;
+	
+	Block_Entry *blocks; /* loaded the first time we seek */
+	uint32_t num_blocks;
+};
+
+static void put_u32(unsigned char *p, uint32_t v) {
+	for (int i=0; i < 4; i++) {
+		p[i] = v >> (8 * i);
+	}
+}
+
+static void put_u64(unsigned char *p, uint64_t v) {
+	for (int i=0; i < 8; i++) {
+		p[i] = v >> (8 * i);
+	}
+}
+
+static uint32_t get_u32(const unsigned char *p) {
+	uint32_t v = 0;
+	
+	for (int i=3; i >= 0; i--) {
+		v = (v << 8) | p[i];
+	}
+	
+	return v;
+}
+
+static uint64_t get_u64(const unsigned char *p) {
+	uint64_t v = 0;
+	
+	for (int i=7; i >= 0; i--) {
+		v = (v << 8) | p[i];
+	}
+	
+	return v;
+}
+
+static size_t put_varint(unsigned char *p, uint64_t v) {
+	size_t n = 0;
+	
+	while (v >= 0x80) {
+		p[n++] = (v & 0x7F) | 0x80;
+		v >>= 7;
+	}
+	p[n++] = v;
+	
+	return n;
+}
+
+/**
+ * Decode a varint from p[*pos..size); returns -1 if it runs off the end
+ */
+static int get_varint(const unsigned char *p, size_t size, size_t *pos, uint64_t *v) {
+	uint64_t result = 0;
+	
+	for (int shift=0; shift < 64 && *pos < size; shift += 7) {
+		unsigned char byte = p[(*pos)++];
+		
+		result |= (uint64_t)(byte & 0x7F) << shift;
+		if ((byte & 0x80) == 0) {
+			*v = result;
+			return 0;
+		}
+	}
+	
+	return -1;
+}
+
+static uint64_t zigzag(int64_t v) {
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static int64_t unzigzag(uint64_t v) {
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static unsigned int size_log2(unsigned char size) {
+	switch (size) {
+		case 2: return 1;
+		case 4: return 2;
+		case 8: return 3;
+		default: return 0;
+	}
+}
+
+static int write_bytes(Trace_Writer *writer, const void *p, size_t n) {
+	if (fwrite(p, 1, n, writer->file) != n) {
+		return -1;
+	}
+	
+	writer->file_offset += n;
+	return 0;
+}
+
+Trace_Writer *trace_writer_open(FILE *file) {
+	Trace_Writer *writer = calloc(1, sizeof(Trace_Writer));
+	unsigned char version[4];
+	
+	if (writer == NULL) {
+		return NULL;
+	}
+	
+	writer->file = file;
+	writer->payload = malloc(TRACE_BLOCK_RECORDS * MAX_RECORD_SIZE);
+	if (writer->payload == NULL) {
+		free(writer);
+		return NULL;
+	}
+	
+	put_u32(version, TRACE_VERSION);
+	if (write_bytes(writer, TRACE_MAGIC, TRACE_MAGIC_SIZE) < 0 || write_bytes(writer, version, 4) < 0) {
+		free(writer->payload);
+		free(writer);
+		return NULL;
+	}
+	
+	return writer;
+}
+
+static int flush_block(Trace_Writer *writer) {
+	unsigned char header[BLOCK_HEADER_SIZE];
+	
+	if (writer->block_records == 0) {
+		return 0;
+	}
+	
+	if (writer->num_blocks == writer->max_blocks) {
+		uint32_t max_blocks = writer->max_blocks ? writer->max_blocks * 2 : 64;
+		Block_Entry *blocks = realloc(writer->blocks, sizeof(Block_Entry) * max_blocks);
+		
+		if (blocks == NULL) {
+			return -1;
+		}
+		writer->blocks = blocks;
+		writer->max_blocks = max_blocks;
+	}
+	
+	uint64_t first_record = writer->records - writer->block_records;
+	
+	writer->blocks[writer->num_blocks].offset = writer->file_offset;
+	writer->blocks[writer->num_blocks].first_record = first_record;
+	writer->num_blocks++;
+	
+	memcpy(header, BLOCK_MAGIC, 4);
+	put_u32(header + 4, writer->payload_size);
+	put_u32(header + 8, writer->block_records);
+	put_u64(header + 12, first_record);
+	
+	if (write_bytes(writer, header, sizeof(header)) < 0
+		|| write_bytes(writer, writer->payload, writer->payload_size) < 0) {
+		return -1;
+	}
+	
+	/* the next block starts over */
+	writer->payload_size = 0;
+	writer->block_records = 0;
+	memset(writer->prev_address, 0, sizeof(writer->prev_address));
+	writer->prev_cycle = 0;
+	
+	return 0;
+}
+
+/**
+ * Append a record; returns -1 if the file can't be written
+ */
+int trace_write(Trace_Writer *writer, const Trace_Record *record) {
+	unsigned char *p = writer->payload + writer->payload_size;
+	unsigned int type = record->type & 3;
+	size_t n = 0;
+	
+	p[n++] = type | (size_log2(record->size) << 2);
+	n += put_varint(p + n, zigzag((int64_t)(record->address - writer->prev_address[type])));
+	n += put_varint(p + n, record->cycle - writer->prev_cycle);
+	if (type == TRACE_WRITE) {
+		p[n++] = record->value;
+	}
+	
+	writer->payload_size += n;
+	writer->prev_address[type] = record->address;
+	writer->prev_cycle = record->cycle;
+	writer->block_records++;
+	writer->records++;
+	
+	if (writer->block_records == TRACE_BLOCK_RECORDS) {
+		return flush_block(writer);
+	}
+	
+	return 0;
+}
+
+/**
+ * Write out the last block and the index. Doesn't close the FILE.
+ */
+int trace_writer_close(Trace_Writer *writer) {
+	unsigned char buf[16];
+	int status = flush_block(writer);
+	uint64_t index_offset = writer->file_offset;
+	
+	memcpy(buf, INDEX_MAGIC, 4);
+	put_u32(buf + 4, writer->num_blocks);
+	if (status == 0 && write_bytes(writer, buf, 8) < 0) {
+		status = -1;
+	}
+	
+	for (uint32_t n=0; status == 0 && n < writer->num_blocks; n++) {
+		put_u64(buf, writer->blocks[n].offset);
+		put_u64(buf + 8, writer->blocks[n].first_record);
+		status = write_bytes(writer, buf, 16);
+	}
+	
+	put_u64(buf, index_offset);
+	memcpy(buf + 8, END_MAGIC, 4);
+	if (status == 0 && write_bytes(writer, buf, TRAILER_SIZE) < 0) {
+		status = -1;
+	}
+	
+	if (fflush(writer->file) != 0) {
+		status = -1;
+	}
+	
+	free(writer->blocks);
+	free(writer->payload);
+	free(writer);
+	
+	return status;
+}
+
+Trace_Reader *trace_reader_open(FILE *file) {
+	unsigned char header[TRACE_MAGIC_SIZE + 4];
+	
+	if (fread(header, 1, sizeof(header), file) != sizeof(header)
+		|| memcmp(header, TRACE_MAGIC, TRACE_MAGIC_SIZE) != 0
+		|| get_u32(header + TRACE_MAGIC_SIZE) != TRACE_VERSION) {
+		return NULL;
+	}
+	
+	Trace_Reader *reader = calloc(1, sizeof(Trace_Reader));
+	if (reader == NULL) {
+		return NULL;
+	}
+	
+	reader->file = file;
+	reader->payload = malloc(TRACE_BLOCK_RECORDS * MAX_RECORD_SIZE);
+	if (reader->payload == NULL) {
+		free(reader);
+		return NULL;
+	}
+	
+	return reader;
+}
+
+/**
+ * Load the next block. Returns 1 on success, 0 at the index (end of
+ * records) and -1 if the file is damaged.
+ */
+static int next_block(Trace_Reader *reader) {
+	unsigned char header[BLOCK_HEADER_SIZE];
+	
+	if (fread(header, 1, 4, reader->file) != 4 || memcmp(header, INDEX_MAGIC, 4) == 0) {
+		return 0;
+	}
+	
+	if (memcmp(header, BLOCK_MAGIC, 4) != 0
+		|| fread(header + 4, 1, BLOCK_HEADER_SIZE - 4, reader->file) != BLOCK_HEADER_SIZE - 4) {
+		return -1;
+	}
+	
+	reader->payload_size = get_u32(header + 4);
+	reader->block_records = get_u32(header + 8);
+	reader->position = get_u64(header + 12);
+	reader->payload_pos = 0;
+	
+	if (reader->payload_size > TRACE_BLOCK_RECORDS * MAX_RECORD_SIZE
+		|| reader->block_records > TRACE_BLOCK_RECORDS
+		|| fread(reader->payload, 1, reader->payload_size, reader->file) != reader->payload_size) {
+		return -1;
+	}
+	
+	memset(reader->prev_address, 0, sizeof(reader->prev_address));
+	reader->prev_cycle = 0;
+	
+	return 1;
+}
+
+/**
+ * Read the next record. Returns 1 for a record, 0 at the end of the trace
+ * and -1 if the file is damaged.
+ */
+int trace_read(Trace_Reader *reader, Trace_Record *record) {
+	while (reader->block_records == 0) {
+		int status = next_block(reader);
+		
+		if (status <= 0) {
+			return status;
+		}
+	}
+	
+	const unsigned char *p = reader->payload;
+	size_t size = reader->payload_size;
+	uint64_t delta, cycles;
+	
+	if (reader->payload_pos >= size) {
+		return -1;
+	}
+	
+	unsigned char kind = p[reader->payload_pos++];
+	unsigned int type = kind & 3;
+	
+	if (type > TRACE_IFETCH
+		|| get_varint(p, size, &reader->payload_pos, &delta) < 0
+		|| get_varint(p, size, &reader->payload_pos, &cycles) < 0) {
+		return -1;
+	}
+	
+	record->type = type;
+	record->size = 1 << ((kind >> 2) & 3);
+	record->address = reader->prev_address[type] + (uint64_t)unzigzag(delta);
+	record->cycle = reader->prev_cycle + cycles;
+	record->value = 0;
+	
+	if (type == TRACE_WRITE) {
+		if (reader->payload_pos >= size) {
+			return -1;
+		}
+		record->value = p[reader->payload_pos++];
+	}
+	
+	reader->prev_address[type] = record->address;
+	reader->prev_cycle = record->cycle;
+	reader->block_records--;
+	reader->position++;
+	
+	return 1;
+}
+
+static int load_index(Trace_Reader *reader) {
+	unsigned char buf[16];
+	
+	if (fseeko(reader->file, -TRAILER_SIZE, SEEK_END) != 0
+		|| fread(buf, 1, TRAILER_SIZE, reader->file) != TRAILER_SIZE
+		|| memcmp(buf + 8, END_MAGIC, 4) != 0
+		|| fseeko(reader->file, (off_t)get_u64(buf), SEEK_SET) != 0
+		|| fread(buf, 1, 8, reader->file) != 8
+		|| memcmp(buf, INDEX_MAGIC, 4) != 0) {
+		return -1;
+	}
+	
+	reader->num_blocks = get_u32(buf + 4);
+	reader->blocks = malloc(sizeof(Block_Entry) * (reader->num_blocks + 1));
+	if (reader->blocks == NULL) {
+		reader->num_blocks = 0;
+		return -1;
+	}
+	
+	for (uint32_t n=0; n < reader->num_blocks; n++) {
+		/* a short index is no index */
+		if (fread(buf, 1, 16, reader->file) != 16) {
+			free(reader->blocks);
+			reader->blocks = NULL;
+			reader->num_blocks = 0;
+			return -1;
+		}
+		reader->blocks[n].offset = get_u64(buf);
+		reader->blocks[n].first_record = get_u64(buf + 8);
+	}
+	
+	return 0;
+}
+
+/**
+ * Position the reader so the next trace_read() returns record number
+ * 'record'. Needs a seekable file. Returns -1 if the trace has no such
+ * record or can't be seeked.
+ */
+int trace_seek(Trace_Reader *reader, uint64_t record) {
+	Trace_Record skipped;
+	
+	if (reader->blocks == NULL && load_index(reader) < 0) {
+		return -1;
+	}
+	
+	/* last block starting at or before the record */
+	uint32_t lo = 0, hi = reader->num_blocks;
+	while (hi - lo > 1) {
+		uint32_t mid = (lo + hi) / 2;
+		
+		if (reader->blocks[mid].first_record <= record) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	
+	if (reader->num_blocks == 0
+		|| fseeko(reader->file, (off_t)reader->blocks[lo].offset, SEEK_SET) != 0
+		|| next_block(reader) != 1) {
+		return -1;
+	}
+	
+	while (reader->position < record) {
+		if (trace_read(reader, &skipped) != 1) {
+			return -1;
+		}
+	}
+	
+	return 0;
+}
+
+uint64_t trace_reader_position(const Trace_Reader *reader) {
+	return reader->position;
+}
+
+/**
+ * Free the reader. Doesn't close the FILE.
+ */
+void trace_reader_close(Trace_Reader *reader) {
+	if (reader != NULL) {
+		free(reader->blocks);
+		free(reader->payload);
+		free(reader);
+	}
+}
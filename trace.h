@@ -0,0 +1,64 @@
+/**
+ * Niall Kavanagh <niall@kst.com>
+ * Compressed memory/instruction trace files
+ *
+ * A trace is a file header followed by independent blocks of records and
+ * an index of those blocks:
+ *
+ *   header   magic (8 bytes), version (u32)
+ *   block    'BLK0', payload bytes (u32), records (u32), first record (u64),
+ *            payload
+ *   ...
+ *   index    'IDX0', blocks (u32), then per block: file offset (u64),
+ *            first record (u64)
+ *   trailer  index offset (u64), 'END0'
+ *
+ * All integers in headers are little endian. Each record in a payload is
+ * a kind byte (type in bits 0-1, log2 of the access size in bits 2-3)
+ * followed by the zigzag varint address delta from the previous record of
+ * the same type, the varint cycle delta from the previous record and, for
+ * writes, the byte written. Deltas restart at every block so blocks decode
+ * on their own: a reader can stream a trace from a pipe, or seek to any
+ * record through the index.
+ */
+
+#ifndef Trace_h
+#define Trace_h
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* first byte is not printable text so readers can tell traces from text */
+#define TRACE_MAGIC "\x89MTRACE\n"
+#define TRACE_MAGIC_SIZE 8
+#define TRACE_VERSION 1
+
+/* records per block */
+#define TRACE_BLOCK_RECORDS 65536
+
+#define TRACE_READ 0
+#define TRACE_WRITE 1
+#define TRACE_IFETCH 2
+
+typedef struct _Trace_Record {
+	uint64_t address;
+	uint64_t cycle;
+	unsigned char type;
+	unsigned char size;  /* bytes accessed: 1, 2, 4 or 8 */
+	unsigned char value; /* byte written, for TRACE_WRITE */
+} Trace_Record;
+
+typedef struct _Trace_Writer Trace_Writer;
+typedef struct _Trace_Reader Trace_Reader;
+
+Trace_Writer *trace_writer_open(FILE *file);
+int trace_write(Trace_Writer *writer, const Trace_Record *record);
+int trace_writer_close(Trace_Writer *writer);
+
+Trace_Reader *trace_reader_open(FILE *file);
+int trace_read(Trace_Reader *reader, Trace_Record *record);
+int trace_seek(Trace_Reader *reader, uint64_t record);
+uint64_t trace_reader_position(const Trace_Reader *reader);
+void trace_reader_close(Trace_Reader *reader);
+
+#endif